@@ -0,0 +1,65 @@
+#!/usr/bin/python
+# numpy loader of the binary bar files (*_B<sec>S[_bc].bar) written by tickrec
+# with BarFormat = bin or both, see BarFileHeader/BarRecord in src/tp/bookL2.hpp
+#
+# Example:
+#   b = barbin.load('bar/NYM_CL_B1S.bar')
+#   mid = (b['bp'] + b['ap'])/2
+#
+import numpy as np
+import struct
+
+HEADER_SIZE = 64
+HEADER_FMT = '<8sIIii40s'
+VERSION = 1
+
+# the same fields as the csv bar line
+BAR_DTYPE = np.dtype([('bar_sec','<i8'), ('bp','<f8'), ('ap','<f8'), ('ism_twap','<f8'),
+                      ('upd_micro','<i8'), ('bsz','<i4'), ('asz','<i4'), ('bv','<i4'),
+                      ('sv','<i4'), ('bqcnt','<i4'), ('aqcnt','<i4'), ('btcnt','<i4'),
+                      ('stcnt','<i4')])
+
+def read_header(fname) :
+    """
+    returns dict of symbol, barsec, version, record_size
+    """
+    with open(fname, 'rb') as f :
+        magic, version, record_size, barsec, reserved, symbol = struct.unpack(HEADER_FMT, f.read(HEADER_SIZE))
+    if magic.rstrip(b'\0') != b'KRBAR' :
+        raise ValueError('not a binary bar file: ' + fname)
+    if version != VERSION or record_size != BAR_DTYPE.itemsize :
+        raise ValueError('unsupported binary bar file version %d record size %d: %s'%(version, record_size, fname))
+    return {'symbol': symbol.rstrip(b'\0').decode(), 'barsec': barsec, 'version': version, 'record_size': record_size}
+
+def load(fname) :
+    """
+    returns a read only np.memmap of BAR_DTYPE records
+    """
+    read_header(fname)
+    import os
+    n = (os.path.getsize(fname) - HEADER_SIZE) // BAR_DTYPE.itemsize
+    if n <= 0 :
+        return np.zeros(0, dtype=BAR_DTYPE)
+    return np.memmap(fname, dtype=BAR_DTYPE, mode='r', offset=HEADER_SIZE, shape=(n,))
+
+def load_files(fname_list) :
+    """
+    bars of a list of files, i.e. the weekly bar dirs, concatenated
+    and sorted by bar_sec
+    """
+    b = np.concatenate([ np.array(load(f)) for f in fname_list ])
+    return b[np.argsort(b['bar_sec'], kind='stable')]
+
+def csv_to_bin(csv_fname, bar_fname, symbol, barsec) :
+    """
+    convert a csv bar file to a binary one, i.e. for the bars recorded
+    before BarFormat
+    """
+    d = np.genfromtxt(csv_fname, delimiter=',', ndmin=2)
+    b = np.zeros(d.shape[0], dtype=BAR_DTYPE)
+    # bar_sec,bsz,bp,ap,asz,buyVol,sellVol,updMicro,bqcnt,aqcnt,btcnt,stcnt,ismTwap
+    for i, col in enumerate(['bar_sec','bsz','bp','ap','asz','bv','sv','upd_micro','bqcnt','aqcnt','btcnt','stcnt','ism_twap']) :
+        b[col] = d[:, i]
+    with open(bar_fname, 'wb') as f :
+        f.write(struct.pack(HEADER_FMT, b'KRBAR', VERSION, BAR_DTYPE.itemsize, barsec, 0, symbol.encode()))
+        f.write(b.tobytes())
@@ -0,0 +1,89 @@
+#!/usr/bin/python
+# numpy loader of the bar repository written by barrepo (see src/tp/barrepo.hpp)
+# BarRepoPath/venue_sym_B<sec>S[_bc]/<column>.<numpy type code> and day.idx
+#
+# Example:
+#   b = barrepo.load('NYM_CL_B1S', start_sec=1546950000, end_sec=1547036400)
+#   mid = (b['bp'] + b['ap'])/2
+#
+import numpy as np
+import glob
+import os
+from ibbar import CFG_FILE, read_cfg
+
+DAY_DTYPE = np.dtype([('day','<i4'), ('reserved','<i4'), ('first_row','<i8'),
+                      ('rows','<i8'), ('first_sec','<i8'), ('last_sec','<i8')])
+
+def repo_path(cfg_file=CFG_FILE) :
+    path = read_cfg('BarRepoPath', cfg_file)
+    if path is None :
+        path = read_cfg('BarPath', cfg_file) + '/repo'
+    return path
+
+def repo_dir(name, repo_path_str=None) :
+    """
+    name is the bar file name without extension, i.e. NYM_CL_B1S
+    """
+    if repo_path_str is None :
+        repo_path_str = repo_path()
+    return os.path.join(repo_path_str, name)
+
+def days(name, repo_path_str=None) :
+    """
+    returns the latest day.idx entry of each trading day, sorted by day
+    """
+    fn = os.path.join(repo_dir(name, repo_path_str), 'day.idx')
+    idx = np.fromfile(fn, dtype=DAY_DTYPE)
+    latest = {}
+    for e in idx :
+        latest[int(e['day'])] = e
+    return np.array([ latest[d] for d in sorted(latest.keys()) ], dtype=DAY_DTYPE)
+
+def columns(name, repo_path_str=None, cols=None) :
+    """
+    returns a dict of column name to a read only np.memmap of all rows,
+    including the ones of the replaced days, see days() for the rows in use
+    """
+    d = {}
+    for fn in glob.glob(os.path.join(repo_dir(name, repo_path_str), '*.*')) :
+        col, code = os.path.basename(fn).split('.')
+        if code == 'idx' or (cols is not None and col not in cols) :
+            continue
+        if os.path.getsize(fn) == 0 :
+            d[col] = np.zeros(0, dtype='<'+code)
+        else :
+            d[col] = np.memmap(fn, dtype='<'+code, mode='r')
+    return d
+
+def load(name, start_sec=0, end_sec=2**62, repo_path_str=None, cols=None) :
+    """
+    returns a dict of column name to an array of the bars with
+    start_sec <= bar_sec < end_sec in time order, a view of the columns
+    without copy if the rows are contiguous, i.e. after compact
+    """
+    c = columns(name, repo_path_str, cols=None)
+    ts = c['bar_sec']
+    rng = []
+    for e in days(name, repo_path_str) :
+        if e['rows'] == 0 or e['last_sec'] < start_sec or e['first_sec'] >= end_sec :
+            continue
+        r0, r1 = e['first_row'], e['first_row'] + e['rows']
+        i0 = r0 + np.searchsorted(ts[r0:r1], start_sec)
+        i1 = r0 + np.searchsorted(ts[r0:r1], end_sec)
+        if i1 <= i0 :
+            continue
+        if len(rng) > 0 and rng[-1][1] == i0 :
+            rng[-1][1] = i1
+        else :
+            rng.append([i0, i1])
+    out = {}
+    for col, arr in c.items() :
+        if cols is not None and col not in cols :
+            continue
+        if len(rng) == 1 :
+            out[col] = arr[rng[0][0]:rng[0][1]]
+        elif len(rng) == 0 :
+            out[col] = np.zeros(0, dtype=arr.dtype)
+        else :
+            out[col] = np.concatenate([ arr[i0:i1] for i0, i1 in rng ])
+    return out
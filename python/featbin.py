@@ -0,0 +1,47 @@
+#!/usr/bin/python
+# numpy loader of the feature files (<name>_F<sec>S.feat) written by featrec,
+# see FeatFileHeader/FeatWriter in src/tp/featcol.hpp
+#
+# Example:
+#   f = featbin.load('bar/feat/NYM_CL_L2_F60S.feat')
+#   f['bar_sec'], f['ewma:30']
+#
+import numpy as np
+import struct
+import os
+
+HEADER_SIZE = 64
+HEADER_FMT = '<8sIIii40s'
+NAME_LEN = 32
+VERSION = 1
+
+def read_header(fname) :
+    """
+    returns dict of name, barsec, version, cols (feature names) and
+    header_size, the offset of the first record
+    """
+    with open(fname, 'rb') as f :
+        magic, version, ncol, barsec, reserved, name = struct.unpack(HEADER_FMT, f.read(HEADER_SIZE))
+        if magic.rstrip(b'\0') != b'KRFEAT' :
+            raise ValueError('not a feature file: ' + fname)
+        if version != VERSION :
+            raise ValueError('unsupported feature file version %d: %s'%(version, fname))
+        names = f.read(ncol*NAME_LEN)
+    cols = [ names[i*NAME_LEN:(i+1)*NAME_LEN].rstrip(b'\0').decode() for i in range(ncol) ]
+    return {'name': name.rstrip(b'\0').decode(), 'barsec': barsec, 'version': version,
+            'cols': cols, 'header_size': HEADER_SIZE + ncol*NAME_LEN}
+
+def dtype(cols) :
+    return np.dtype([('bar_sec','<i8')] + [ (c,'<f8') for c in cols ])
+
+def load(fname) :
+    """
+    returns a read only np.memmap of records of bar_sec and the features,
+    NaN for a feature not available at the bar
+    """
+    h = read_header(fname)
+    dt = dtype(h['cols'])
+    n = (os.path.getsize(fname) - h['header_size']) // dt.itemsize
+    if n <= 0 :
+        return np.zeros(0, dtype=dt)
+    return np.memmap(fname, dtype=dt, mode='r', offset=h['header_size'], shape=(n,))
@@ -502,7 +502,7 @@ def move_bar(rsync_dir_list=None, dt=None) :
     print 'moving bar files to ', bar_path +'/' + yyyymmdd
     os.system('mkdir -p ' + bar_path+'/'+yyyymmdd)
 
-    for ft in ['csv','bin'] :
+    for ft in ['csv','bin','idx','bar'] :
         os.system('mv ' + bar_path+'/*.' + ft + ' ' + bar_path+'/' + yyyymmdd)
     os.system('gzip '+bar_path+'/'+yyyymmdd+'/*')
 
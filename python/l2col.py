@@ -0,0 +1,43 @@
+#!/usr/bin/python
+# numpy loader of the L2 column files written by l2col (see src/tp/l2col.hpp)
+# ColPath/yyyymmdd/venue_sym_type[_bc]/<column>.<numpy type code>
+#
+# Example:
+#   d = l2col.load_day('20190108', 'NYM_CL_L2')
+#   mid = (d['bp'] + d['ap'])/2
+#
+import numpy as np
+import glob
+import os
+from ibbar import CFG_FILE, read_cfg
+
+def col_path(cfg_file=CFG_FILE) :
+    path = read_cfg('ColPath', cfg_file)
+    if path is None :
+        path = read_cfg('BarPath', cfg_file) + '/col'
+    return path
+
+def load_day(day, name, col_path_str=None, cols=None) :
+    """
+    returns a dict of column name to a read only np.memmap, i.e.
+    'ts','type','side','level','px','qty','bp','bsz','ap','asz'
+    name is the L2 file name without extension, i.e. NYM_CL_L2
+    cols, if given, is a list of column names to load
+    """
+    if col_path_str is None :
+        col_path_str = col_path()
+    d = {}
+    for fn in glob.glob(os.path.join(col_path_str, str(day), name, '*.*')) :
+        col, code = os.path.basename(fn).split('.')
+        if cols is not None and col not in cols :
+            continue
+        if os.path.getsize(fn) == 0 :
+            d[col] = np.zeros(0, dtype='<'+code)
+        else :
+            d[col] = np.memmap(fn, dtype='<'+code, mode='r')
+    return d
+
+def list_days(name, col_path_str=None) :
+    if col_path_str is None :
+        col_path_str = col_path()
+    return sorted([ os.path.basename(os.path.dirname(p)) for p in glob.glob(os.path.join(col_path_str, '*', name)) ])
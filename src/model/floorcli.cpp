@@ -0,0 +1,150 @@
+#include "floorclient.hpp"
+#include "time_util.h"
+#include "plcc/PLCC.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <vector>
+#include <algorithm>
+
+using namespace trader;
+using namespace utils;
+
+// floorcli, the binary order entry of the floor on the command line.
+// Requests from stdin, one per line
+//     B|S SYM QTY PX       new limit order, PX 0 for a market order
+//     R OID QTY PX         replace
+//     C OID                cancel
+// and the replies printed as they come.  With -b n, the round trip of
+// n new orders of qty 0, rejected by the floor without going to IB.
+
+volatile bool user_stopped = false;
+
+void sig_handler(int signo)
+{
+  if (signo == SIGINT) {
+    printf("Received SIGINT, exiting...\n");
+  }
+  user_stopped = true;
+}
+
+static const char* statusName(int status) {
+	static const char* names[] = { "Sent", "Submitted", "PendingCancel", "Cancelled",
+			"Filled", "Inactive", "Unknown" };
+	return (status >= 0) && (status <= FS_Unknown)? names[status] : "?";
+}
+
+struct Printer {
+	int replies;
+	Printer() : replies(0) {};
+	void onAck(const FloorAck& a) {
+		printf("ack req(%u) oid(%d) %s filled(%g) remaining(%g) avg_px(%.7f)\n",
+				(unsigned)a.hdr.req_id, (int)a.oid, statusName(a.status), a.filled, a.remaining, a.avg_px);
+		++replies;
+	}
+	void onFill(const FloorFill& f) {
+		printf("fill req(%u) oid(%d) %g@%.7f exec(%s)\n",
+				(unsigned)f.hdr.req_id, (int)f.oid, f.qty, f.px, f.exec_id);
+		++replies;
+	}
+	void onReject(const FloorReject& r) {
+		printf("reject req(%u) oid(%d) code(%d) %s\n",
+				(unsigned)r.hdr.req_id, (int)r.oid, (int)r.code, r.msg);
+		++replies;
+	}
+};
+
+struct Counter {
+	int replies;
+	Counter() : replies(0) {};
+	void onAck(const FloorAck&) { ++replies; }
+	void onFill(const FloorFill&) { ++replies; }
+	void onReject(const FloorReject&) { ++replies; }
+};
+
+static int bench(FloorClient& cli, int n) {
+	Counter quiet;
+	std::vector<int64_t> rt;
+	for (int i = 0; (i < n) && !user_stopped; ++i) {
+		const int cnt = quiet.replies;
+		const int64_t t0 = TimeUtil::cur_time_micro();
+		if (!cli.newOrder("", 0, 0, true)) {
+			return -1;
+		}
+		while ((quiet.replies == cnt) && !user_stopped) {
+			if (cli.poll(quiet, 1000) < 0) {
+				return -1;
+			}
+		}
+		rt.push_back(TimeUtil::cur_time_micro() - t0);
+	}
+	if (rt.empty()) {
+		return -1;
+	}
+	std::sort(rt.begin(), rt.end());
+	printf("%d round trips, p50 %lldus p99 %lldus max %lldus\n", (int)rt.size(),
+			(long long)rt[rt.size()/2], (long long)rt[rt.size()*99/100], (long long)rt.back());
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int bench_cnt = 0;
+	if ((argc != 3) && !((argc == 5) && (strcmp(argv[3], "-b") == 0) && ((bench_cnt = atoi(argv[4])) > 0))) {
+		printf("Usage: %s IP Port [-b n]\n", argv[0]);
+		printf("  requests from stdin:  B|S SYM QTY PX, R OID QTY PX, C OID\n");
+		return 0;
+	}
+	if (signal(SIGINT, sig_handler) == SIG_ERR)
+	{
+		printf("\ncan't catch SIGINT\n");
+		return -1;
+	}
+	utils::PLCC::instance("floorcli");
+	FloorClient cli;
+	if (!cli.connect(argv[1], atoi(argv[2]))) {
+		printf("cannot connect to %s:%s\n", argv[1], argv[2]);
+		return -1;
+	}
+	if (bench_cnt) {
+		return bench(cli, bench_cnt);
+	}
+
+	Printer printer;
+	char line[256];
+	while (!user_stopped && fgets(line, sizeof(line), stdin)) {
+		char c = 0;
+		char sym[64];
+		int oid = 0, qty = 0;
+		double px = 0;
+		uint32_t req_id = 0;
+		if ((sscanf(line, " %c %63s %d %lf", &c, sym, &qty, &px) == 4) && ((c == 'B') || (c == 'S'))) {
+			req_id = cli.newOrder(sym, qty, px, c == 'B', false, px == 0);
+		} else if ((sscanf(line, " %c %d %d %lf", &c, &oid, &qty, &px) == 4) && (c == 'R')) {
+			req_id = cli.replace(oid, qty, px);
+		} else if ((sscanf(line, " %c %d", &c, &oid) == 2) && (c == 'C')) {
+			req_id = cli.cancel(oid);
+		} else {
+			printf("unknown request: %s", line);
+			continue;
+		}
+		if (!req_id) {
+			break;
+		}
+		printf("sent req(%u)\n", (unsigned)req_id);
+		// the first replies, the later ones come with the next request
+		if (cli.poll(printer, 1000) < 0) {
+			break;
+		}
+		fflush(stdout);
+	}
+	// the rest of the acks and fills
+	while (!user_stopped && cli.isConnected()) {
+		if (cli.poll(printer, 1000) < 0) {
+			break;
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * floorclient.hpp
+ *
+ * FloorClient, the binary order entry of the floor (floorproto.hpp)
+ * for a model process.  Each request goes in a single write, the
+ * replies are read by poll() into the callbacks of a Handler
+ *
+ *     void onAck(const FloorAck& ack);
+ *     void onFill(const FloorFill& fill);
+ *     void onReject(const FloorReject& rej);
+ *
+ * bound at compile time.
+ *
+ *     FloorClient cli;
+ *     cli.connect("127.0.0.1", plcc_getInt("FloorPort"));
+ *     const uint32_t req_id = cli.newOrder("NYM/CLZ9", 1, 55.25, true);
+ *     cli.poll(handler, 1);
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <string>
+#include <vector>
+#include "floorproto.hpp"
+#include "sys_utils.h"
+#include "plcc/PLCC.hpp"
+
+namespace trader {
+
+class FloorClient {
+public:
+	FloorClient() : _fd(-1), _next_req_id(1), _rx_len(0) {};
+
+	~FloorClient() {
+		disconnect();
+	}
+
+	bool connect(const char* ip, int port) {
+		disconnect();
+		_fd = utils::tcp_socket(ip, port, false);
+		_rx_len = 0;
+		if (_fd < 0) {
+			logError("FloorClient cannot connect to %s:%d", ip, port);
+			return false;
+		}
+		return true;
+	}
+
+	void disconnect() {
+		if (_fd >= 0) {
+			close(_fd);
+			_fd = -1;
+		}
+	}
+
+	bool isConnected() const {
+		return _fd >= 0;
+	}
+
+	// for an epoll of the caller
+	int fd() const {
+		return _fd;
+	}
+
+	// the req_id of the request, 0 if not sent.  The order id comes
+	// with its FloorAck
+	uint32_t newOrder(const char* sym, int qty, double px, bool is_buy,
+			bool is_ioc = false, bool is_mkt = false) {
+		FloorNew o;
+		floorInit(o, FM_New, _next_req_id);
+		floorCopy(o.sym, sizeof(o.sym), sym);
+		o.qty = qty;
+		o.px = px;
+		o.is_buy = is_buy;
+		o.is_ioc = is_ioc;
+		o.is_mkt = is_mkt;
+		return sendMsg(o);
+	}
+
+	uint32_t replace(int oid, int qty, double px) {
+		FloorReplace r;
+		floorInit(r, FM_Replace, _next_req_id);
+		r.oid = oid;
+		r.qty = qty;
+		r.px = px;
+		return sendMsg(r);
+	}
+
+	uint32_t cancel(int oid) {
+		FloorCancel c;
+		floorInit(c, FM_Cancel, _next_req_id);
+		c.oid = oid;
+		return sendMsg(c);
+	}
+
+	// the replies read, waiting up to timeout_milli (-1 forever) for
+	// the first, -1 if disconnected
+	template<typename Handler>
+	int poll(Handler& handler, int timeout_milli = 0) {
+		if (_fd < 0) {
+			return -1;
+		}
+		if (timeout_milli != 0) {
+			struct pollfd pfd;
+			pfd.fd = _fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if (::poll(&pfd, 1, timeout_milli) <= 0) {
+				return 0;
+			}
+		}
+		int cnt = 0;
+		while (true) {
+			const ssize_t n = read(_fd, _rx + _rx_len, sizeof(_rx) - _rx_len);
+			if (n <= 0) {
+				if ((n < 0) && (errno == EAGAIN)) {
+					return cnt;
+				}
+				logError("FloorClient disconnected by the floor, errno(%d)", n<0? errno : 0);
+				disconnect();
+				return -1;
+			}
+			_rx_len += n;
+			int off = 0;
+			FloorMsg m;
+			while (_rx_len - off >= (int)sizeof(FloorHdr)) {
+				memcpy(&m.hdr, _rx + off, sizeof(FloorHdr));
+				const int len = floorMsgLen(m.hdr.type);
+				if (__builtin_expect((m.hdr.magic != FloorMagic) || (len == 0) || (m.hdr.len != len), 0)) {
+					logError("FloorClient bad record type(%d) len(%d), disconnecting",
+							(int)m.hdr.type, (int)m.hdr.len);
+					disconnect();
+					return -1;
+				}
+				if (_rx_len - off < len) {
+					break;
+				}
+				memcpy(&m, _rx + off, len);
+				off += len;
+				switch (m.hdr.type) {
+				case FM_Ack:
+					handler.onAck(m.ack);
+					break;
+				case FM_Fill:
+					handler.onFill(m.fill);
+					break;
+				case FM_Reject:
+					handler.onReject(m.reject);
+					break;
+				default:
+					logError("FloorClient got a request type(%d) from the floor", (int)m.hdr.type);
+					break;
+				}
+				++cnt;
+			}
+			_rx_len -= off;
+			memmove(_rx, _rx + off, _rx_len);
+		}
+	}
+
+private:
+	int _fd;
+	uint32_t _next_req_id;
+	int _rx_len;
+	char _rx[4096];
+
+	template<typename Msg>
+	uint32_t sendMsg(const Msg& m) {
+		if (__builtin_expect(_fd < 0, 0)) {
+			return 0;
+		}
+		const ssize_t n = send(_fd, &m, sizeof(Msg), MSG_NOSIGNAL);
+		if (__builtin_expect(n != (ssize_t)sizeof(Msg), 0)) {
+			logError("FloorClient failed to send record type(%d), sent %d errno(%d), disconnecting",
+					(int)m.hdr.type, (int)n, errno);
+			disconnect();
+			return 0;
+		}
+		return _next_req_id++;
+	}
+};
+
+}
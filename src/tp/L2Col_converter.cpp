@@ -0,0 +1,185 @@
+#include <l2query.hpp>
+#include <l2col.hpp>
+#include <thread_utils.h>
+
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+volatile bool user_stopped = false;
+void sig_handler(int signo)
+{
+  if (signo == SIGINT) {
+    printf("Received SIGINT, exiting...\n");
+  }
+  user_stopped = true;
+}
+
+// a symbol-day to convert
+struct ColJob {
+	int file;
+	int day;
+	uint64_t start_micro;
+	uint64_t end_micro;
+};
+
+class ColWorker {
+public:
+	ColWorker(const std::vector<BookConfig>& bcfg,
+			  const std::vector<L2SnapIndex>& index,
+			  const std::vector<ColJob>& jobs,
+			  std::atomic<int>& next_job) :
+		_bcfg(bcfg), _index(index), _jobs(jobs), _next_job(next_job), _count(0) {};
+
+	void run(void*) {
+		int j;
+		while (!user_stopped && ((j = _next_job++) < (int)_jobs.size())) {
+			const ColJob& job(_jobs[j]);
+			try {
+				L2BookQuery query(_bcfg[job.file], 0, &_index[job.file]);
+				L2ColumnWriter writer(_bcfg[job.file], false);
+				long long cnt = query.replay(job.start_micro, job.end_micro, writer);
+				logInfo("%s %d: %lld rows", _bcfg[job.file].toString().c_str(), job.day, cnt);
+				_count += cnt;
+			} catch (const std::exception& e) {
+				logError("%s %d failed: %s", _bcfg[job.file].toString().c_str(), job.day, e.what());
+			}
+		}
+	}
+
+	void stop() {}
+
+	long long getCount() const {
+		return _count;
+	}
+
+private:
+	const std::vector<BookConfig>& _bcfg;
+	const std::vector<L2SnapIndex>& _index;
+	const std::vector<ColJob>& _jobs;
+	std::atomic<int>& _next_job;
+	long long _count;
+};
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-j threads(4)] [start_yyyymmdd(0)] [end_yyyymmdd(99999999)] [symbol:[L2|L1|L1n] ...]\n", argv[0]);
+        printf("    convert the L2 delta files to daily column files in ColPath, in parallel per symbol-day.\n");
+        printf("    all of the tickrecL2 subscriptions (SubL2, SubL1 and SubL1n) if no symbol given.\n");
+        return 0;
+    }
+    int arg = 1;
+    int threads = 4;
+    if (argc > arg+1 && strcmp(argv[arg], "-j") == 0) {
+    	threads = std::max(atoi(argv[arg+1]), 1);
+    	arg += 2;
+    }
+    int start_day = 0;
+    if (argc > arg) {
+    	start_day = atoi(argv[arg++]);
+    }
+    int end_day = 99999999;
+    if (argc > arg) {
+    	end_day = atoi(argv[arg++]);
+    }
+
+    if (signal(SIGINT, sig_handler) == SIG_ERR)
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("L2Col");
+
+    std::vector<BookConfig> bcfg;
+    if (argc > arg) {
+    	for (; arg < argc; ++arg) {
+    		const std::string spec(argv[arg]);
+    		auto pos = spec.find(":");
+    		if (pos == std::string::npos) {
+    			printf("symbol:type expected, got %s\n", argv[arg]);
+    			return -1;
+    		}
+    		const std::string bt = spec.substr(pos+1);
+    		bcfg.push_back(BookConfig(spec.substr(0,pos), bt=="L1n"?"L1":bt, bt=="L1n"));
+    	}
+    } else {
+        const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+        for (const auto& sym : symL2) {
+        	bcfg.push_back(BookConfig(sym, "L2"));
+        }
+        const std::vector<std::string> symL1(plcc_getStringArr("SubL1"));
+        for (const auto& sym : symL1) {
+        	if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+        		bcfg.push_back(BookConfig(sym, "L1"));
+        	}
+        }
+        const std::vector<std::string> symL1n(plcc_getStringArr("SubL1n"));
+        for (const auto& sym : symL1n) {
+        	if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+        		bcfg.push_back(BookConfig(sym, "L1", true));
+        	}
+        }
+    }
+
+    // index each file once, split into trading days
+    const int start_hour = tradeDayStartHour();
+    std::vector<L2SnapIndex> index(bcfg.size());
+    std::vector<ColJob> jobs;
+    for (int f = 0; f < (int)bcfg.size(); ++f) {
+    	try {
+    		L2BookQuery query(bcfg[f], 0);
+    		index[f] = query.getIndex();
+    	} catch (const std::exception& e) {
+    		logError("skipping %s: %s", bcfg[f].toString().c_str(), e.what());
+    		continue;
+    	}
+    	const L2SnapIndex& idx(index[f]);
+    	if (idx.getEntries().size() == 0) {
+    		continue;
+    	}
+    	const uint64_t last_ts = idx.getLastTs();
+    	int day = TimeUtil::utc_to_trade_day(idx.getEntries()[0].ts_micro/1000000ULL, start_hour);
+    	while (true) {
+    		const uint64_t start_micro = (uint64_t)TimeUtil::trade_day_start_utc(day, start_hour)*1000000ULL;
+    		const uint64_t end_micro = (uint64_t)TimeUtil::trade_day_start_utc(day, start_hour, 1)*1000000ULL;
+    		if (start_micro > last_ts) {
+    			break;
+    		}
+    		if (day >= start_day && day <= end_day) {
+    			ColJob job = { f, day, start_micro, end_micro };
+    			jobs.push_back(job);
+    		}
+    		day = TimeUtil::utc_to_trade_day(end_micro/1000000ULL, start_hour);
+    	}
+    }
+    printf("%d files, %d symbol-days, %d threads\n", (int)bcfg.size(), (int)jobs.size(), threads);
+
+    const uint64_t t0 = TimeUtil::cur_time_micro();
+    std::atomic<int> next_job(0);
+    std::vector<ColWorker*> workers;
+    std::vector<ThreadWrapper<ColWorker>*> tw;
+    for (int i = 0; i < threads; ++i) {
+    	workers.push_back(new ColWorker(bcfg, index, jobs, next_job));
+    	tw.push_back(new ThreadWrapper<ColWorker>(*workers.back()));
+    	tw.back()->run(NULL);
+    }
+    long long cnt = 0;
+    for (int i = 0; i < threads; ++i) {
+    	tw[i]->join();
+    	cnt += workers[i]->getCount();
+    	delete tw[i];
+    	delete workers[i];
+    }
+    const uint64_t t1 = TimeUtil::cur_time_micro();
+    printf("%lld rows in %.3f seconds\n", cnt, (double)(t1-t0)/1000000.0);
+    printf("Done.\n");
+    return 0;
+}
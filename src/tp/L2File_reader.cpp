@@ -1,4 +1,5 @@
 #include <bookL2.hpp>
+#include <l2query.hpp>
 
 #include <sstream>
 #include <string>
@@ -21,9 +22,68 @@ void sig_handler(int signo)
   user_stopped = true;
 }
 
+// utc seconds with optional fraction, i.e. 1546950600.25
+uint64_t parseUtcMicro(const char* str) {
+    const char* dot = strchr(str, '.');
+    uint64_t micro = strtoull(str, NULL, 10)*1000000ULL;
+    if (dot) {
+        uint64_t frac = 100000ULL;
+        for (const char* p = dot+1; *p>='0' && *p<='9' && frac>0; ++p, frac/=10) {
+            micro += (*p-'0')*frac;
+        }
+    }
+    return micro;
+}
+
+class BookAtPrinter {
+public:
+    explicit BookAtPrinter(std::vector<std::string>& out) : _out(out) {};
+    void onBook(size_t idx, uint64_t ts_micro, const BookDepot* book) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%llu.%06llu ",
+                (unsigned long long)ts_micro/1000000ULL,
+                (unsigned long long)ts_micro%1000000ULL);
+        _out[idx] = std::string(buf) + (book? book->prettyPrint() : std::string("N/A"));
+    }
+private:
+    std::vector<std::string>& _out;
+};
+
+// books at the given times, in the order given
+int bookAt(const BookConfig& bcfg, int argc, char** argv) {
+    std::vector<uint64_t> ts_list;
+    if (argc == 0 || (argc == 1 && strcmp(argv[0], "-") == 0)) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (line.size() > 0) {
+                ts_list.push_back(parseUtcMicro(line.c_str()));
+            }
+        }
+    } else {
+        for (int i = 0; i < argc; ++i) {
+            ts_list.push_back(parseUtcMicro(argv[i]));
+        }
+    }
+    L2BookQuery query(bcfg);
+    std::vector<std::string> out(ts_list.size());
+    BookAtPrinter printer(out);
+    const uint64_t t0 = utils::TimeUtil::cur_time_micro();
+    query.query(ts_list, printer);
+    const uint64_t t1 = utils::TimeUtil::cur_time_micro();
+    for (const auto& s : out) {
+        printf("%s\n", s.c_str());
+    }
+    fprintf(stderr, "%d books, %d snapshots, %lld records applied in %.3f seconds\n",
+            (int)ts_list.size(), (int)query.getIndex().getEntries().size(),
+            query.getRecords(), (double)(t1-t0)/1000000.0);
+    return 0;
+}
+
 int main(int argc, char**argv) {
     if (argc < 4) {
         printf("Usage: %s symbol [L2|L1|L1n] [full|tail] [throttle_micro(250000)] [start_utc_second(-1)] [end_utc_second(0x7fffffff)]\n", argv[0]);
+        printf("       %s symbol [L2|L1|L1n] at [utc_second[.fraction] ...|-]\n", argv[0]);
+        printf("    books at the given times, read from stdin if - or none given\n");
         printf("\nL2 subscriptions: ");
         std::vector<std::string> l2 = plcc_getStringArr("SubL2");
         for (auto s : l2) {
@@ -80,6 +140,9 @@ int main(int argc, char**argv) {
     }
     utils::PLCC::instance("L2Reader");
     BookConfig bcfg(argv[1],bt,next_contract);
+    if (strcmp(argv[3], "at")==0) {
+        return bookAt(bcfg, argc-4, argv+4);
+    }
     L2DeltaReader reader(bcfg, tail);
     user_stopped = false;
     const BookDepot* book;
@@ -0,0 +1,91 @@
+#include <l2merge.hpp>
+
+#include <sstream>
+#include <string>
+#include <iostream>
+#include <cctype>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+L2MergeReplay* replay = NULL;
+void sig_handler(int signo)
+{
+  if (signo == SIGINT) {
+    printf("Received SIGINT, exiting...\n");
+  }
+  if (replay) {
+	  replay->stop();
+  }
+}
+
+class MergePrinter {
+public:
+	explicit MergePrinter(bool quiet) : _quiet(quiet) {};
+	void onBook(const BookConfig& bcfg, const BookDepot& book) {
+		if (!_quiet) {
+			printf("%s %s\n", bcfg.toString().c_str(), book.prettyPrint().c_str());
+		}
+	}
+private:
+	const bool _quiet;
+};
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-q] [start_utc_second(0)] [end_utc_second(0x7fffffff)] [symbol:[L2|L1|L1n] ...]\n", argv[0]);
+        printf("    merge replay of the L2 delta files ordered by update time, -q counts only.\n");
+        printf("    all of the tickrecL2 subscriptions (SubL2, SubL1 and SubL1n) if no symbol given.\n");
+        return 0;
+    }
+    int arg = 1;
+    bool quiet = false;
+    if (argc > arg && strcmp(argv[arg], "-q") == 0) {
+    	quiet = true;
+    	++arg;
+    }
+    int64_t start_utc = 0;
+    if (argc > arg) {
+        start_utc = (int64_t)atoi(argv[arg++]);
+    }
+    int64_t end_utc = 0x7fffffff;
+    if (argc > arg) {
+        end_utc = (int64_t)atoi(argv[arg++]);
+    }
+
+    if (signal(SIGINT, sig_handler) == SIG_ERR)
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("L2Merge");
+    replay = new L2MergeReplay(start_utc*1000000ULL, end_utc*1000000ULL);
+    if (argc > arg) {
+    	for (; arg < argc; ++arg) {
+    		const std::string spec(argv[arg]);
+    		auto pos = spec.find(":");
+    		if (pos == std::string::npos) {
+    			printf("symbol:type expected, got %s\n", argv[arg]);
+    			return -1;
+    		}
+    		const std::string bt = spec.substr(pos+1);
+    		replay->addFile(BookConfig(spec.substr(0,pos), bt=="L1n"?"L1":bt, bt=="L1n"));
+    	}
+    } else {
+    	replay->addSubscriptions();
+    }
+
+    MergePrinter printer(quiet);
+    const uint64_t t0 = utils::TimeUtil::cur_time_micro();
+    long long cnt = replay->run(printer);
+    const uint64_t t1 = utils::TimeUtil::cur_time_micro();
+    fprintf(stderr, "%lld updates in %.3f seconds\n", cnt, (double)(t1-t0)/1000000.0);
+    delete replay;
+    replay = NULL;
+    printf("Done.\n");
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <l2merge.hpp>
+
+#include <sstream>
+#include <string>
+#include <iostream>
+#include <cctype>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+typedef BookQ<ShmCircularBuffer> BookQType;
+
+L2MergeReplay* replay = NULL;
+void sig_handler(int signo)
+{
+  if (signo == SIGINT || signo == SIGTERM) {
+    printf("Received signal, exiting...\n");
+  }
+  if (replay) {
+	  replay->stop();
+  }
+}
+
+// Publishes the merged books to the book queues of the same names as
+// tpib, paced by the recorded update time.  speed is the multiple of
+// real time, 0 for as fast as possible.  With restamp the books are
+// put with the current time instead of the recorded time.
+//
+// tickrecL2 doesn't record L1 of the SubL2 symbols, the L1 queue of
+// such a symbol is derived from the top level of its L2 book.
+class QPublisher {
+public:
+	// usleep() wakes up late by the timer slack, 50 micro by default,
+	// only the last SpinMicro before a book is spun
+	static const int64_t SpinMicro = 60LL;
+
+	QPublisher(double speed, bool restamp) :
+		_speed(speed), _restamp(restamp),
+		_ts0(0), _wall0(0), _last_ts(0), _count(0) {};
+
+	~QPublisher() {
+		for (auto q : _qs) {
+			delete q;
+		}
+	}
+
+	void addQueue(const BookConfig& bcfg) {
+		_qidx[bcfg.qname()] = (int)_qs.size();
+		_qs.push_back(new BookQType(bcfg, false));
+		_l1_of_l2.push_back(NULL);
+	}
+
+	// L1 queue fed by the L2 book of the same symbol
+	void addL1FromL2(const BookConfig& bcfgL2) {
+		auto iter = _qidx.find(bcfgL2.qname());
+		if (iter == _qidx.end()) {
+			return;
+		}
+		_l1_of_l2[iter->second] = new BookQType(BookConfig(bcfgL2.venue+"/"+bcfgL2.symbol, "L1"), false);
+		_qs.push_back(_l1_of_l2[iter->second]);
+		_l1_of_l2.push_back(NULL);
+	}
+
+	void onBook(const BookConfig& bcfg, const BookDepot& book) {
+		auto iter = _qidx.find(bcfg.qname());
+		if (__builtin_expect(iter == _qidx.end(), 0)) {
+			return;
+		}
+		pace(book.update_ts_micro);
+		const uint64_t ts = _restamp? TimeUtil::cur_time_micro() : book.update_ts_micro;
+		_qs[iter->second]->theWriter().updBook(book, ts);
+		BookQType* l1 = _l1_of_l2[iter->second];
+		if (l1) {
+			const L2Delta& d(book.l2_delta);
+			if ((d.level == 0) || (d.type == 0) || (d.type == 4)) {
+				_book_l1 = book;
+				for (int side = 0; side < 2; ++side) {
+					if (_book_l1.avail_level[side] > 1) {
+						_book_l1.avail_level[side] = 1;
+					}
+				}
+				l1->theWriter().updBook(_book_l1, ts);
+			}
+		}
+		_last_ts = book.update_ts_micro;
+		++_count;
+	}
+
+	long long getCount() const {
+		return _count;
+	}
+
+	// recorded time span replayed in micro
+	uint64_t getSpanMicro() const {
+		return _last_ts > _ts0? _last_ts - _ts0 : 0;
+	}
+
+private:
+	const double _speed;
+	const bool _restamp;
+	std::vector<BookQType*> _qs;
+	std::vector<BookQType*> _l1_of_l2;
+	std::unordered_map<std::string, int> _qidx;
+	BookDepot _book_l1;
+	uint64_t _ts0;
+	int64_t _wall0;
+	uint64_t _last_ts;
+	long long _count;
+
+	void pace(uint64_t ts) {
+		if (__builtin_expect(_ts0 == 0, 0)) {
+			_ts0 = ts;
+			_wall0 = (int64_t)TimeUtil::cur_time_micro();
+			return;
+		}
+		if ((_speed <= 0) || (ts <= _ts0)) {
+			return;
+		}
+		const int64_t target = _wall0 + (int64_t)((double)(ts - _ts0)/_speed);
+		const int64_t diff = target - (int64_t)TimeUtil::cur_time_micro();
+		if (diff > SpinMicro) {
+			usleep(diff - SpinMicro);
+		}
+		while ((int64_t)TimeUtil::cur_time_micro() < target);
+	}
+};
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-s speed(1)] [-r] [start_utc_second(0)] [end_utc_second(0x7fffffff)] [symbol:[L2|L1|L1n] ...]\n", argv[0]);
+        printf("    replay the L2 delta files to the tpib book queues merged by update time.\n");
+        printf("    -s speed: multiple of real time, 0 as fast as possible\n");
+        printf("    -r: restamp the books with current time\n");
+        printf("    all of the tickrecL2 subscriptions (SubL2, SubL1 and SubL1n) if no symbol given,\n");
+        printf("    with the L1 of the SubL2 symbols derived from the L2 books.\n");
+        return 0;
+    }
+    int arg = 1;
+    double speed = 1.0;
+    bool restamp = false;
+    while (argc > arg && argv[arg][0] == '-') {
+    	if (strcmp(argv[arg], "-s") == 0 && argc > arg+1) {
+    		speed = atof(argv[arg+1]);
+    		arg += 2;
+    	} else if (strcmp(argv[arg], "-r") == 0) {
+    		restamp = true;
+    		++arg;
+    	} else {
+    		printf("unknown option %s, see -h\n", argv[arg]);
+    		return -1;
+    	}
+    }
+    int64_t start_utc = 0;
+    if (argc > arg) {
+        start_utc = (int64_t)atoi(argv[arg++]);
+    }
+    int64_t end_utc = 0x7fffffff;
+    if (argc > arg) {
+        end_utc = (int64_t)atoi(argv[arg++]);
+    }
+
+    if ((signal(SIGINT, sig_handler) == SIG_ERR) ||
+    	(signal(SIGTERM, sig_handler) == SIG_ERR))
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("L2Replay");
+    replay = new L2MergeReplay(start_utc*1000000ULL, end_utc*1000000ULL);
+    QPublisher pub(speed, restamp);
+    if (argc > arg) {
+    	for (; arg < argc; ++arg) {
+    		const std::string spec(argv[arg]);
+    		auto pos = spec.find(":");
+    		if (pos == std::string::npos) {
+    			printf("symbol:type expected, got %s\n", argv[arg]);
+    			return -1;
+    		}
+    		const std::string bt = spec.substr(pos+1);
+    		BookConfig bcfg(spec.substr(0,pos), bt=="L1n"?"L1":bt, bt=="L1n");
+    		replay->addFile(bcfg);
+    		pub.addQueue(bcfg);
+    	}
+    } else {
+    	replay->addSubscriptions();
+    	const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+    	const std::vector<std::string> symL1(plcc_getStringArr("SubL1"));
+    	const std::vector<std::string> symL1n(plcc_getStringArr("SubL1n"));
+    	for (const auto& sym : symL2) {
+    		pub.addQueue(BookConfig(sym, "L2"));
+    	}
+    	for (const auto& sym : symL1) {
+    		if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+    			pub.addQueue(BookConfig(sym, "L1"));
+    		} else {
+    			pub.addL1FromL2(BookConfig(sym, "L2"));
+    		}
+    	}
+    	for (const auto& sym : symL1n) {
+    		if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+    			pub.addQueue(BookConfig(sym, "L1", true));
+    		}
+    	}
+    }
+
+    const uint64_t t0 = TimeUtil::cur_time_micro();
+    long long cnt = replay->run(pub);
+    const uint64_t t1 = TimeUtil::cur_time_micro();
+    const double wall = (double)(t1-t0)/1000000.0;
+    printf("%lld updates of %.3f recorded seconds in %.3f seconds, %.0f updates/second\n",
+    		cnt, (double)pub.getSpanMicro()/1000000.0, wall, wall>0? (double)cnt/wall : 0.0);
+    delete replay;
+    replay = NULL;
+    printf("Done.\n");
+    return 0;
+}
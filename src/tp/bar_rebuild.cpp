@@ -0,0 +1,380 @@
+#include <l2query.hpp>
+#include <thread_utils.h>
+
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <algorithm>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+volatile bool user_stopped = false;
+void sig_handler(int signo)
+{
+  if (signo == SIGINT) {
+    printf("Received SIGINT, exiting...\n");
+  }
+  user_stopped = true;
+}
+
+// a recorded file to rebuild the bars of a symbol from
+struct BarSource {
+	BookConfig fcfg;   // the L1 or L2 delta file
+	BookConfig bcfg;   // the bar files, as of tickrec
+	bool top_only;     // L2 file, only the updates of the top level
+	L2SnapIndex index;
+	uint64_t last_ts;
+};
+
+// a trading day of a file, or the whole file if the days are not
+// aligned with the bar periods
+struct BarJob {
+	int src;
+	int day;
+	uint64_t start_micro;
+	uint64_t end_micro;
+	std::string part_path;
+};
+
+// Feeds the books of a job to a BarSeries the same way as tickrec with
+// BarByUpdateTime.  The books go to the bars by their update time, and
+// the bars are closed at every boundary between the first book and the
+// last one of the job, so a day without a book has no bar.
+//
+// tickrecL2 records no L1 of a SubL2 symbol.  The bars of such a symbol
+// are of the top of the L2 book instead of the L1 quote of tickrec, so
+// they are close to but not the same as the live ones.
+class RebuildHandler {
+public:
+	RebuildHandler(BarSeries& bars, bool top_only) :
+		_bars(bars), _top_only(top_only),
+		_bar_micro(bars.getBarSec()*1000000LL), _next_bar(0), _last_ts(0) {};
+
+	// resumes from the book before the job's start, a bar boundary
+	void initFromBook(const BookDepot& book, int64_t start_micro) {
+		_bars.initFromBook(book, start_micro);
+		_next_bar = start_micro + _bar_micro;
+	}
+
+	void onBook(const BookDepot& book) {
+		if (_top_only) {
+			const L2Delta& d(book.l2_delta);
+			if ((d.level != 0) && (d.type != 0) && (d.type != 4)) {
+				return;
+			}
+		}
+		const int64_t ts = (int64_t)book.update_ts_micro;
+		_last_ts = ts;
+		if (__builtin_expect(_next_bar == 0, 0)) {
+			// the first book of the file, as the latest book of tickrec's init
+			initFromBook(book, ts);
+			_next_bar = (ts/_bar_micro + 1)*_bar_micro;
+			return;
+		}
+		closeBars(ts);
+		_bars.update(book);
+	}
+
+	// closes the bars up to and including upto_micro
+	void closeBars(int64_t upto_micro) {
+		while (_next_bar && (_next_bar <= upto_micro)) {
+			_bars.onBar(_next_bar);
+			_next_bar += _bar_micro;
+		}
+	}
+
+	// closes the bars up to the close of the longest period's bar of
+	// the last book, but not after end_micro
+	void closeLast(int64_t end_micro) {
+		if (_last_ts == 0) {
+			return;
+		}
+		const int64_t max_micro = _bars.getMaxBarSec()*1000000LL;
+		closeBars(getMin(end_micro, (_last_ts/max_micro + 1)*max_micro));
+	}
+
+private:
+	BarSeries& _bars;
+	const bool _top_only;
+	const int64_t _bar_micro;
+	int64_t _next_bar;
+	int64_t _last_ts;   // of the last book of the job
+};
+
+class RebuildWorker {
+public:
+	RebuildWorker(const std::vector<BarSource>& src,
+				  const std::vector<BarJob>& jobs,
+				  const std::vector<int>& bsecs,
+				  std::atomic<int>& next_job) :
+		_src(src), _jobs(jobs), _bsecs(bsecs), _next_job(next_job), _count(0), _failed(0) {};
+
+	void run(void*) {
+		int j;
+		while (!user_stopped && ((j = _next_job++) < (int)_jobs.size())) {
+			const BarJob& job(_jobs[j]);
+			const BarSource& src(_src[job.src]);
+			try {
+				L2BookQuery query(src.fcfg, 1, &src.index);
+				BarSeries bars(src.bcfg, _bsecs, job.part_path, true);
+				RebuildHandler handler(bars, src.top_only);
+				if (job.start_micro > 0) {
+					const BookDepot* book = query.at(job.start_micro - 1);
+					if (book) {
+						handler.initFromBook(*book, (int64_t)job.start_micro);
+					}
+				}
+				long long cnt = query.replay(job.start_micro, job.end_micro, handler);
+				handler.closeLast((int64_t)job.end_micro);
+				logInfo("%s %d: %lld books", src.fcfg.toString().c_str(), job.day, cnt);
+				_count += cnt;
+			} catch (const std::exception& e) {
+				logError("%s %d failed: %s", src.fcfg.toString().c_str(), job.day, e.what());
+				++_failed;
+			}
+		}
+	}
+
+	void stop() {}
+
+	long long getCount() const {
+		return _count;
+	}
+
+	int getFailed() const {
+		return _failed;
+	}
+
+private:
+	const std::vector<BarSource>& _src;
+	const std::vector<BarJob>& _jobs;
+	const std::vector<int>& _bsecs;
+	std::atomic<int>& _next_job;
+	long long _count;
+	int _failed;
+};
+
+static void makeDir(const std::string& dir) {
+	if ((mkdir(dir.c_str(), 0755) != 0) && (errno != EEXIST)) {
+		logError("cannot create directory %s", dir.c_str());
+		throw std::runtime_error(std::string("cannot create directory ") + dir);
+	}
+}
+
+// appends a part to the output, the header of a binary part is only
+// kept for a new output
+static void appendPart(const std::string& part, const std::string& out, bool is_bin) {
+	FILE* in = fopen(part.c_str(), "rb");
+	if (!in) {
+		return;
+	}
+	FILE* fp = fopen(out.c_str(), "ab");
+	if (!fp) {
+		fclose(in);
+		throw std::runtime_error(std::string("fopen error")+out);
+	}
+	fseek(fp, 0, SEEK_END);
+	if (is_bin && ftell(fp) > 0) {
+		fseek(in, sizeof(BarFileHeader), SEEK_SET);
+	}
+	char buf[64*1024];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, n, fp);
+	}
+	fclose(fp);
+	fclose(in);
+	unlink(part.c_str());
+}
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-j threads(4)] [-o out_path(BarPath/rebuild)] [start_yyyymmdd(0)] [end_yyyymmdd(99999999)] [symbol:[L2|L1|L1n] ...]\n", argv[0]);
+        printf("    rebuild the bar files of BarSecList (or BarSec) and BarFormat from the L1/L2 delta files,\n");
+        printf("    in parallel per symbol-day, as tickrec with BarByUpdateTime of the recorded books.\n");
+        printf("    all of the tickrec symbols (SubL1 and SubL1n) if no symbol given, from the top of\n");
+        printf("    the L2 file for the SubL2 symbols, which have no L1 file.\n");
+        return 0;
+    }
+    int arg = 1;
+    int threads = 4;
+    std::string out_path;
+    while (argc > arg+1 && argv[arg][0] == '-') {
+    	if (strcmp(argv[arg], "-j") == 0) {
+    		threads = std::max(atoi(argv[arg+1]), 1);
+    	} else if (strcmp(argv[arg], "-o") == 0) {
+    		out_path = argv[arg+1];
+    	} else {
+    		printf("unknown option %s, see -h\n", argv[arg]);
+    		return -1;
+    	}
+    	arg += 2;
+    }
+    int start_day = 0;
+    if (argc > arg) {
+    	start_day = atoi(argv[arg++]);
+    }
+    int end_day = 99999999;
+    if (argc > arg) {
+    	end_day = atoi(argv[arg++]);
+    }
+
+    if (signal(SIGINT, sig_handler) == SIG_ERR)
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("BarRebuild");
+    if (out_path.size() == 0) {
+    	out_path = plcc_getString("BarPath") + "/rebuild";
+    }
+    std::vector<int> bsecs;
+    for (const auto& s : plcc_getStringArr("BarSecList")) {
+    	bsecs.push_back(atoi(s.c_str()));
+    }
+    if (bsecs.size() == 0) {
+    	bsecs.push_back(plcc_getInt("BarSec"));
+    }
+    BarSeries::baseSec(bsecs);  // throws on an invalid list
+    const int64_t max_bar_sec = *std::max_element(bsecs.begin(), bsecs.end());
+
+    std::vector<BookConfig> bcfg;
+    if (argc > arg) {
+    	for (; arg < argc; ++arg) {
+    		const std::string spec(argv[arg]);
+    		auto pos = spec.find(":");
+    		if (pos == std::string::npos) {
+    			printf("symbol:type expected, got %s\n", argv[arg]);
+    			return -1;
+    		}
+    		const std::string bt = spec.substr(pos+1);
+    		bcfg.push_back(BookConfig(spec.substr(0,pos), bt=="L1n"?"L1":bt, bt=="L1n"));
+    	}
+    } else {
+    	const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+    	for (const auto& sym : plcc_getStringArr("SubL1")) {
+    		const bool isL2 = std::find(symL2.begin(), symL2.end(), sym) != symL2.end();
+    		bcfg.push_back(BookConfig(sym, isL2? "L2":"L1"));
+    	}
+    	for (const auto& sym : plcc_getStringArr("SubL1n")) {
+    		bcfg.push_back(BookConfig(sym, "L1", true));
+    	}
+    }
+
+    // index each file once, split into trading days if the days
+    // start at a boundary of all of the bar periods
+    const int start_hour = tradeDayStartHour();
+    makeDir(out_path);
+    makeDir(out_path + "/.parts");
+    std::vector<BarSource> src;
+    std::vector<BarJob> jobs;
+    for (const auto& cfg : bcfg) {
+    	BarSource s = { cfg, BookConfig(cfg.venue+"/"+cfg.symbol, "L1", cfg.isbc), cfg.type == "L2", L2SnapIndex(), 0 };
+    	try {
+    		L2BookQuery query(cfg, 0);
+    		s.index = query.getIndex();
+    	} catch (const std::exception& e) {
+    		logError("skipping %s: %s", cfg.toString().c_str(), e.what());
+    		continue;
+    	}
+    	if (s.index.getEntries().size() == 0) {
+    		continue;
+    	}
+    	s.last_ts = s.index.getLastTs();
+    	const int f = (int)src.size();
+    	src.push_back(s);
+
+    	const std::string part = out_path + "/.parts/" + cfg.L2stem();
+    	int day = TimeUtil::utc_to_trade_day(s.index.getEntries()[0].ts_micro/1000000ULL, start_hour);
+    	std::vector<BarJob> days;
+    	bool aligned = true;
+    	while (true) {
+    		const time_t start_utc = TimeUtil::trade_day_start_utc(day, start_hour);
+    		const time_t end_utc = TimeUtil::trade_day_start_utc(day, start_hour, 1);
+    		if ((uint64_t)start_utc*1000000ULL > s.last_ts) {
+    			break;
+    		}
+    		aligned &= (start_utc % max_bar_sec == 0);
+    		if (day >= start_day && day <= end_day) {
+    			BarJob job = { f, day, (uint64_t)start_utc*1000000ULL, (uint64_t)end_utc*1000000ULL,
+    					part + "_" + std::to_string(day) };
+    			days.push_back(job);
+    		}
+    		day = TimeUtil::utc_to_trade_day(end_utc, start_hour);
+    	}
+    	if (days.size() == 0) {
+    		continue;
+    	}
+    	if (!aligned) {
+    		// the bars of a day could straddle the next, in one go
+    		logInfo("%s: trading days not aligned with %d seconds bars, not split", cfg.toString().c_str(), (int)max_bar_sec);
+    		days[0].end_micro = days.back().end_micro;
+    		days.resize(1);
+    	}
+    	for (int sec : bsecs) {
+    		unlink(s.bcfg.bfname(sec, ".csv", out_path).c_str());
+    		unlink(s.bcfg.bfname(sec, ".bar", out_path).c_str());
+    	}
+    	for (auto& job : days) {
+    		makeDir(job.part_path);
+    		jobs.push_back(job);
+    	}
+    }
+    printf("%d files, %d jobs, %d threads\n", (int)src.size(), (int)jobs.size(), threads);
+
+    const uint64_t t0 = TimeUtil::cur_time_micro();
+    std::atomic<int> next_job(0);
+    std::vector<RebuildWorker*> workers;
+    std::vector<ThreadWrapper<RebuildWorker>*> tw;
+    for (int i = 0; i < threads; ++i) {
+    	workers.push_back(new RebuildWorker(src, jobs, bsecs, next_job));
+    	tw.push_back(new ThreadWrapper<RebuildWorker>(*workers.back()));
+    	tw.back()->run(NULL);
+    }
+    long long cnt = 0;
+    int failed = 0;
+    for (int i = 0; i < threads; ++i) {
+    	tw[i]->join();
+    	cnt += workers[i]->getCount();
+    	failed += workers[i]->getFailed();
+    	delete tw[i];
+    	delete workers[i];
+    }
+    if (failed || user_stopped) {
+    	// no bar file with a day missing
+    	for (const auto& job : jobs) {
+    		const BookConfig& cfg(src[job.src].bcfg);
+    		for (int sec : bsecs) {
+    			unlink(cfg.bfname(sec, ".csv", job.part_path).c_str());
+    			unlink(cfg.bfname(sec, ".bar", job.part_path).c_str());
+    		}
+    		rmdir(job.part_path.c_str());
+    	}
+    	rmdir((out_path + "/.parts").c_str());
+    	printf("%d of %d jobs failed%s, no bars written, see the log\n", failed, (int)jobs.size(),
+    			user_stopped? " or stopped" : "");
+    	return -1;
+    }
+
+    // the parts in the order of the days, to the bar files as of tickrec
+    for (const auto& job : jobs) {
+    	const BookConfig& cfg(src[job.src].bcfg);
+    	for (int sec : bsecs) {
+    		appendPart(cfg.bfname(sec, ".csv", job.part_path), cfg.bfname(sec, ".csv", out_path), false);
+    		appendPart(cfg.bfname(sec, ".bar", job.part_path), cfg.bfname(sec, ".bar", out_path), true);
+    	}
+    	rmdir(job.part_path.c_str());
+    }
+    rmdir((out_path + "/.parts").c_str());
+    const uint64_t t1 = TimeUtil::cur_time_micro();
+    printf("%lld books in %.3f seconds, bars in %s\n", cnt, (double)(t1-t0)/1000000.0, out_path.c_str());
+    printf("Done.\n");
+    return 0;
+}
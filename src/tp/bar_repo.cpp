@@ -0,0 +1,134 @@
+#include <barrepo.hpp>
+
+#include <string>
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+BookConfig getBookConfig(const std::string& spec) {
+	const bool isbc = (spec.size() > 4) && (spec.substr(spec.size()-4) == ":L1n");
+	return BookConfig(isbc? spec.substr(0, spec.size()-4) : spec, "L1", isbc);
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+	return (s.size() >= suffix.size()) && (s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+// history files paired by the name before _qt.csv/_trd.csv, merged
+// before the live bar files, so the live bars are kept
+int put(BarRepoWriter& writer, int barsec, int argc, char** argv, int arg) {
+	std::map<std::string, std::pair<std::string, std::string> > hist;
+	std::vector<BarRecord> live;
+	for (; arg < argc; ++arg) {
+		const std::string fname(argv[arg]);
+		if (endsWith(fname, "_qt.csv")) {
+			hist[fname.substr(0, fname.size()-7)].first = fname;
+		} else if (endsWith(fname, "_trd.csv")) {
+			hist[fname.substr(0, fname.size()-8)].second = fname;
+		} else if (!BarRepo::readBarFile(fname, barsec, live)) {
+			return -1;
+		}
+	}
+	std::vector<BarRecord> bars;
+	for (const auto& kv : hist) {
+		if (!BarRepo::readHistCsv(kv.second.first, kv.second.second, barsec, bars)) {
+			return -1;
+		}
+	}
+	BarRepo::sortBars(bars);
+	int days = writer.merge(bars);
+	printf("%d history bars of %d days\n", (int)bars.size(), days);
+	BarRepo::sortBars(live);
+	days = writer.merge(live);
+	printf("%d live bars of %d days\n", (int)live.size(), days);
+	return 0;
+}
+
+// bar_sec, bsz, bp, ap, asz, bv, sv, updMicro, bqcnt, aqcnt, btcnt, stcnt, ismTwap
+// as the csv bar line
+int get(const BarRepoReader& reader, int64_t start_sec, int64_t end_sec) {
+	long long cnt = 0;
+	for (const auto& v : reader.query(start_sec, end_sec)) {
+		for (size_t i = 0; i < v.size(); ++i) {
+			FmtBuf<512> line;
+			line.i64(v.barSec()[i]).str(", ").i64(v.bsz()[i]).str(", ")
+				.fixed(v.bp()[i], 7).str(", ").fixed(v.ap()[i], 7).str(", ")
+				.i64(v.asz()[i]).str(", ").i64(v.bv()[i]).str(", ").i64(v.sv()[i]).str(", ")
+				.i64(v.updMicro()[i]).str(", ").i64(v.bqcnt()[i]).str(", ").i64(v.aqcnt()[i]).str(", ")
+				.i64(v.btcnt()[i]).str(", ").i64(v.stcnt()[i]).str(", ").fixed(v.ismTwap()[i], 7).ch('\n');
+			fwrite(line.data(), 1, line.size(), stdout);
+			++cnt;
+		}
+	}
+	fprintf(stderr, "%lld bars\n", cnt);
+	return 0;
+}
+
+void printDays(const std::vector<BarRepoDay>& days) {
+	for (const auto& d : days) {
+		printf("%d rows(%lld) first_row(%lld) first_sec(%lld) last_sec(%lld)\n",
+				d.day, (long long)d.rows, (long long)d.first_row,
+				(long long)d.first_sec, (long long)d.last_sec);
+	}
+}
+
+int main(int argc, char**argv) {
+    if ((argc < 3) || (strcmp(argv[1], "-h") == 0)) {
+        printf("Usage: %s [-b barsec] [-p repo_path] put venue/symbol[:L1n] bar_file ...\n", argv[0]);
+        printf("       %s [-b barsec] [-p repo_path] get venue/symbol[:L1n] start_utc_second end_utc_second\n", argv[0]);
+        printf("       %s [-b barsec] [-p repo_path] days|compact venue/symbol[:L1n]\n", argv[0]);
+        printf("    the bar repository of a symbol and bar period (BarSec), in repo_path (BarRepoPath).\n");
+        printf("    put merges the tickrec bar files (.bar or .csv) and the history files (*_qt.csv and\n");
+        printf("    *_trd.csv of ibbar) by trading day, a live bar is kept over a history one.\n");
+        return 0;
+    }
+    utils::PLCC::instance("barrepo");
+    int arg = 1;
+    int barsec = 0;
+    std::string path;
+    while ((arg + 1 < argc) && (argv[arg][0] == '-')) {
+    	if (strcmp(argv[arg], "-b") == 0) {
+    		barsec = atoi(argv[arg+1]);
+    	} else if (strcmp(argv[arg], "-p") == 0) {
+    		path = argv[arg+1];
+    	} else {
+    		printf("unknown option %s\n", argv[arg]);
+    		return -1;
+    	}
+    	arg += 2;
+    }
+    if (barsec <= 0) {
+    	barsec = plcc_getInt("BarSec");
+    }
+    if (argc < arg + 2) {
+    	printf("command and symbol expected, see -h\n");
+    	return -1;
+    }
+    const std::string cmd(argv[arg]);
+    const BookConfig bcfg(getBookConfig(argv[arg+1]));
+    arg += 2;
+    if (cmd == "put") {
+    	BarRepoWriter writer(bcfg, barsec, path);
+    	return put(writer, barsec, argc, argv, arg);
+    }
+    if (cmd == "compact") {
+    	BarRepoWriter writer(bcfg, barsec, path);
+    	writer.compact();
+    	printDays(writer.getDays());
+    	return 0;
+    }
+    BarRepoReader reader(bcfg, barsec, path);
+    if (cmd == "days") {
+    	printDays(reader.getDays());
+    	return 0;
+    }
+    if ((cmd == "get") && (argc >= arg + 2)) {
+    	return get(reader, atoll(argv[arg]), atoll(argv[arg+1]));
+    }
+    printf("unknown command %s, see -h\n", cmd.c_str());
+    return -1;
+}
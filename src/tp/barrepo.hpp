@@ -0,0 +1,798 @@
+/*
+ * barrepo.hpp
+ *
+ * Bar repository, the bars of a symbol and bar period in columnar files,
+ * mapped by the research and the models instead of parsing the bar and
+ * the history csv files again.
+ *
+ * A repository is a directory per symbol and period named as the bar
+ * files, with a file per BarRecord field and the day index:
+ *
+ *     BarRepoPath/venue_sym_B<sec>S[_bc]/bar_sec.i8
+ *                                        bp.f8
+ *                                        ...
+ *                                        day.idx
+ *
+ * The column files have the numpy type code as the extension, as of
+ * l2col, and day.idx is an array of BarRepoDay, see python/barrepo.py.
+ * BarRepoPath defaults to BarPath/repo, a trading day starts at
+ * TradeDayStartHour (default 18) local time of the previous day.
+ *
+ * The bars are put a trading day at a time, sorted by bar_sec.  The rows
+ * are only appended, a day put again, i.e. today updated by the live bars
+ * during the day, is appended and its latest index entry wins, so a row of
+ * the index is never written again under a reader.  compact() rewrites the
+ * files in day order without the replaced rows into a new directory renamed
+ * in place of the old one, a reader opens the new files at its next
+ * refresh().  The columns are written
+ * before the index entry, the rows after the last one of the index, i.e.
+ * of a crash, are truncated by the next writer.
+ *
+ * A history bar from the IB history csv of ibbar.py has no book update
+ * and is told by upd_micro of 0.  Its bp, ap and ism_twap are the close
+ * of the midpoint bar, bv and btcnt the volume and count of the trade bar.
+ * bar_sec is the bar close time as of tickrec, the history bar's time
+ * plus the period.  When merged, a live bar replaces a history bar of the
+ * same bar_sec but not the other way round.
+ */
+
+#pragma once
+
+#include "bookL2.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstddef>
+#include <algorithm>
+#include <map>
+
+namespace tp {
+
+struct BarRepoCol {
+	const char* fname;   // <field>.<numpy type code>
+	size_t size;
+	size_t offset;       // in BarRecord
+};
+
+#define BarRepoField(f, code) { #f "." code, sizeof(((BarRecord*)0)->f), offsetof(BarRecord, f) }
+static const BarRepoCol BarRepoCols[] = {
+	BarRepoField(bar_sec, "i8"),
+	BarRepoField(bp, "f8"),
+	BarRepoField(ap, "f8"),
+	BarRepoField(ism_twap, "f8"),
+	BarRepoField(upd_micro, "i8"),
+	BarRepoField(bsz, "i4"),
+	BarRepoField(asz, "i4"),
+	BarRepoField(bv, "i4"),
+	BarRepoField(sv, "i4"),
+	BarRepoField(bqcnt, "i4"),
+	BarRepoField(aqcnt, "i4"),
+	BarRepoField(btcnt, "i4"),
+	BarRepoField(stcnt, "i4")
+};
+#undef BarRepoField
+
+static const int BarRepoNCol = sizeof(BarRepoCols)/sizeof(BarRepoCols[0]);
+
+// an entry of day.idx, rows [first_row, first_row+rows) of the columns
+struct BarRepoDay {
+	int32_t day;         // trading day yyyymmdd
+	int32_t reserved;
+	int64_t first_row;
+	int64_t rows;
+	int64_t first_sec;   // bar_sec of the first and the last row
+	int64_t last_sec;
+
+	int64_t endRow() const {
+		return first_row + rows;
+	}
+};
+
+// rows of a contiguous range of the mapped columns, valid until the
+// reader is refreshed or deleted
+class BarView {
+public:
+	BarView() : _n(0) {
+		memset(_col, 0, sizeof(_col));
+	}
+
+	size_t size() const { return _n; }
+
+	const int64_t* barSec() const   { return (const int64_t*)_col[0]; }
+	const double* bp() const        { return (const double*)_col[1]; }
+	const double* ap() const        { return (const double*)_col[2]; }
+	const double* ismTwap() const   { return (const double*)_col[3]; }
+	const int64_t* updMicro() const { return (const int64_t*)_col[4]; }
+	const int32_t* bsz() const      { return (const int32_t*)_col[5]; }
+	const int32_t* asz() const      { return (const int32_t*)_col[6]; }
+	const int32_t* bv() const       { return (const int32_t*)_col[7]; }
+	const int32_t* sv() const       { return (const int32_t*)_col[8]; }
+	const int32_t* bqcnt() const    { return (const int32_t*)_col[9]; }
+	const int32_t* aqcnt() const    { return (const int32_t*)_col[10]; }
+	const int32_t* btcnt() const    { return (const int32_t*)_col[11]; }
+	const int32_t* stcnt() const    { return (const int32_t*)_col[12]; }
+
+	// a copy of row i
+	void get(size_t i, BarRecord& bar) const {
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			memcpy((char*)&bar + BarRepoCols[c].offset, _col[c] + i*BarRepoCols[c].size, BarRepoCols[c].size);
+		}
+	}
+
+private:
+	friend class BarRepoReader;
+	const char* _col[BarRepoNCol];
+	size_t _n;
+};
+
+class BarRepo {
+public:
+	static std::string repoPath() {
+		bool found = false;
+		const std::string path = plcc_getString("BarRepoPath", &found);
+		if (found) {
+			return path;
+		}
+		return plcc_getString("BarPath") + "/repo";
+	}
+
+	// directory of a symbol and period, in path if given
+	static std::string repoDir(const BookConfig& bcfg, int barsec, const std::string& path = "") {
+		return bcfg.bfname(barsec, "", path.size()? path : repoPath());
+	}
+
+	// trading day of the bar closed at bar_sec
+	static int tradeDay(int64_t bar_sec, int barsec, int start_hour) {
+		return utils::TimeUtil::utc_to_trade_day((time_t)(bar_sec - barsec), start_hour);
+	}
+
+	static void sortBars(std::vector<BarRecord>& bars) {
+		std::stable_sort(bars.begin(), bars.end(),
+				[](const BarRecord& b1, const BarRecord& b2) { return b1.bar_sec < b2.bar_sec; });
+	}
+
+	static bool isHistory(const BarRecord& bar) {
+		return bar.upd_micro == 0;
+	}
+
+	// a bar replaces a previous one of the same bar_sec, unless it is a
+	// history bar replacing a live one
+	static const BarRecord& pick(const BarRecord& prev, const BarRecord& bar) {
+		return (isHistory(bar) && !isHistory(prev))? prev : bar;
+	}
+
+	// merges the sorted add into the sorted base by pick(), the bars of
+	// the same bar_sec in add, i.e. of overlapping files, are picked in order
+	static void merge(std::vector<BarRecord>& base, const std::vector<BarRecord>& add_bars) {
+		std::vector<BarRecord> add;
+		add.reserve(add_bars.size());
+		for (const auto& bar : add_bars) {
+			if (add.size() && (add.back().bar_sec == bar.bar_sec)) {
+				add.back() = pick(add.back(), bar);
+			} else {
+				add.push_back(bar);
+			}
+		}
+		std::vector<BarRecord> out;
+		out.reserve(base.size() + add.size());
+		size_t i = 0, j = 0;
+		while ((i < base.size()) || (j < add.size())) {
+			if ((j == add.size()) || ((i < base.size()) && (base[i].bar_sec < add[j].bar_sec))) {
+				out.push_back(base[i++]);
+			} else if ((i == base.size()) || (add[j].bar_sec < base[i].bar_sec)) {
+				out.push_back(add[j++]);
+			} else {
+				out.push_back(pick(base[i], add[j]));
+				++i;
+				++j;
+			}
+		}
+		base.swap(out);
+	}
+
+	// appends the bars of a tickrec bar file, binary (.bar) or csv,
+	// returns false if the file cannot be read
+	static bool readBarFile(const std::string& fname, int barsec, std::vector<BarRecord>& bars) {
+		FILE* fp = fopen(fname.c_str(), "rb");
+		if (!fp) {
+			logError("cannot open bar file %s", fname.c_str());
+			return false;
+		}
+		bool ret = true;
+		if (endsWith(fname, ".bar")) {
+			BarFileHeader hdr;
+			if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) || !hdr.isValid(barsec)) {
+				logError("not a binary bar file of %d seconds: %s", barsec, fname.c_str());
+				ret = false;
+			} else {
+				BarRecord bar;
+				while (fread(&bar, sizeof(bar), 1, fp) == 1) {
+					bars.push_back(bar);
+				}
+			}
+		} else {
+			// bar_sec, bsz, bp, ap, asz, bv, sv, updMicro, bqcnt, aqcnt, btcnt, stcnt, ismTwap
+			char line[512];
+			while (fgets(line, sizeof(line), fp)) {
+				double v[13];
+				const int n = parseCsv(line, v, 13);
+				if (n < 8) {
+					continue;
+				}
+				BarRecord bar;
+				memset(&bar, 0, sizeof(bar));
+				bar.bar_sec = (int64_t)v[0];
+				bar.bsz = (int32_t)v[1];
+				bar.bp = v[2];
+				bar.ap = v[3];
+				bar.asz = (int32_t)v[4];
+				bar.bv = (int32_t)v[5];
+				bar.sv = (int32_t)v[6];
+				bar.upd_micro = (int64_t)v[7];
+				bar.bqcnt = (int32_t)(n > 8? v[8] : 0);
+				bar.aqcnt = (int32_t)(n > 9? v[9] : 0);
+				bar.btcnt = (int32_t)(n > 10? v[10] : 0);
+				bar.stcnt = (int32_t)(n > 11? v[11] : 0);
+				bar.ism_twap = (n > 12)? v[12] : (bar.bp + bar.ap)/2;
+				bars.push_back(bar);
+			}
+		}
+		fclose(fp);
+		return ret;
+	}
+
+	// appends the history bars of the midpoint (qt) and/or the trade (trd)
+	// csv of HistClient, "utc, open, high, low, close, volume, count, wap",
+	// either could be empty.  Sorted by bar_sec.
+	static bool readHistCsv(const std::string& qt_fname, const std::string& trd_fname,
+			int barsec, std::vector<BarRecord>& bars) {
+		std::map<int64_t, BarRecord> hist;
+		for (int is_trade = 0; is_trade < 2; ++is_trade) {
+			const std::string& fname(is_trade? trd_fname : qt_fname);
+			if (fname.size() == 0) {
+				continue;
+			}
+			FILE* fp = fopen(fname.c_str(), "rb");
+			if (!fp) {
+				logError("cannot open history file %s", fname.c_str());
+				return false;
+			}
+			char line[512];
+			while (fgets(line, sizeof(line), fp)) {
+				double v[8];
+				if (parseCsv(line, v, 8) < 7) {
+					continue;
+				}
+				const int64_t bar_sec = (int64_t)v[0] + barsec;
+				auto iter = hist.find(bar_sec);
+				if (iter == hist.end()) {
+					BarRecord bar;
+					memset(&bar, 0, sizeof(bar));
+					bar.bar_sec = bar_sec;
+					bar.bp = bar.ap = bar.ism_twap = v[4];
+					iter = hist.insert(std::make_pair(bar_sec, bar)).first;
+				}
+				if (is_trade) {
+					iter->second.bv = (int32_t)v[5];
+					iter->second.btcnt = (int32_t)v[6];
+				} else {
+					// the midpoint is preferred to the trade close
+					iter->second.bp = iter->second.ap = iter->second.ism_twap = v[4];
+				}
+			}
+			fclose(fp);
+		}
+		for (const auto& kv : hist) {
+			bars.push_back(kv.second);
+		}
+		return true;
+	}
+
+	static void makeDirs(const std::string& dir) {
+		for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+			const std::string d = dir.substr(0, pos);
+			if ((mkdir(d.c_str(), 0755) != 0) && (errno != EEXIST)) {
+				logError("cannot create directory %s", d.c_str());
+				throw std::runtime_error(std::string("cannot create directory ") + d);
+			}
+			if (pos == std::string::npos) {
+				return;
+			}
+		}
+	}
+
+	// the files of a repository directory and the directory
+	static void removeDir(const std::string& dir) {
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			unlink((dir + "/" + BarRepoCols[c].fname).c_str());
+		}
+		unlink((dir + "/day.idx").c_str());
+		if ((rmdir(dir.c_str()) != 0) && (errno != ENOENT)) {
+			logError("cannot remove bar repository directory %s: %s", dir.c_str(), strerror(errno));
+		}
+	}
+
+	// the latest entry of each day in day.idx, by day, and the rows
+	// of the columns up to the last one of any entry
+	static int64_t readIndex(int fd, std::map<int, BarRepoDay>& days) {
+		days.clear();
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			return 0;
+		}
+		const size_t n = st.st_size / sizeof(BarRepoDay);
+		std::vector<BarRepoDay> entries(n);
+		if (n && (pread(fd, &entries[0], n*sizeof(BarRepoDay), 0) != (ssize_t)(n*sizeof(BarRepoDay)))) {
+			throw std::runtime_error("day.idx read error");
+		}
+		int64_t rows = 0;
+		for (const auto& e : entries) {
+			days[e.day] = e;
+			rows = getMax(rows, e.endRow());
+		}
+		return rows;
+	}
+
+private:
+	static bool endsWith(const std::string& s, const char* suffix) {
+		const size_t n = strlen(suffix);
+		return (s.size() >= n) && (s.compare(s.size() - n, n, suffix) == 0);
+	}
+
+	// comma separated numbers of a line, returns the count
+	static int parseCsv(const char* line, double* v, int max_cnt) {
+		int n = 0;
+		const char* p = line;
+		while (n < max_cnt) {
+			char* end;
+			v[n] = strtod(p, &end);
+			if (end == p) {
+				break;
+			}
+			++n;
+			while (*end == ' ') {
+				++end;
+			}
+			if (*end != ',') {
+				break;
+			}
+			p = end + 1;
+		}
+		return n;
+	}
+};
+
+class BarRepoReader {
+public:
+	BarRepoReader(const BookConfig& bcfg, int barsec, const std::string& path = "") :
+		_dir(BarRepo::repoDir(bcfg, barsec, path)),
+		_idx_fd(-1), _rows(0)
+	{
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			_fd[c] = -1;
+			_ptr[c] = NULL;
+			_size[c] = 0;
+		}
+		_idx_fd = open((_dir + "/day.idx").c_str(), O_RDONLY);
+		if (_idx_fd < 0) {
+			logError("cannot open bar repository %s", _dir.c_str());
+			throw std::runtime_error(std::string("cannot open bar repository ") + _dir);
+		}
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			const std::string fname = _dir + "/" + BarRepoCols[c].fname;
+			_fd[c] = open(fname.c_str(), O_RDONLY);
+			if (_fd[c] < 0) {
+				logError("cannot open bar repository column %s", fname.c_str());
+				throw std::runtime_error(std::string("cannot open bar repository column ") + fname);
+			}
+		}
+		refresh();
+	}
+
+	~BarRepoReader() {
+		unmap();
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			close(_fd[c]);
+		}
+		close(_idx_fd);
+	}
+
+	// picks up the days put since, the views given before are invalid.
+	// The files replaced by a compact() since are opened again
+	void refresh() {
+		unmap();
+		if (replaced()) {
+			reopen();
+		}
+		_rows = BarRepo::readIndex(_idx_fd, _days);
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			struct stat st;
+			if (fstat(_fd[c], &st) != 0) {
+				throw std::runtime_error(std::string("bar repository fstat error ") + _dir);
+			}
+			// the rows being put by a writer are not in the index yet
+			_rows = getMin(_rows, (int64_t)(st.st_size / BarRepoCols[c].size));
+		}
+		for (auto iter = _days.begin(); iter != _days.end(); ) {
+			if (iter->second.endRow() > _rows) {
+				iter = _days.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			_size[c] = _rows * BarRepoCols[c].size;
+			if (_size[c] == 0) {
+				continue;
+			}
+			void* ptr = mmap(NULL, _size[c], PROT_READ, MAP_SHARED, _fd[c], 0);
+			if (ptr == MAP_FAILED) {
+				logError("cannot map bar repository column %s", BarRepoCols[c].fname);
+				throw std::runtime_error(std::string("cannot map bar repository ") + _dir);
+			}
+			_ptr[c] = (const char*)ptr;
+		}
+	}
+
+	// bars of start_sec <= bar_sec < end_sec, in time order, a view per
+	// run of rows contiguous in the files, one if the days were put in order
+	std::vector<BarView> query(int64_t start_sec, int64_t end_sec) const {
+		std::vector<BarView> views;
+		for (const auto& kv : _days) {
+			const BarRepoDay& d(kv.second);
+			if ((d.rows == 0) || (d.last_sec < start_sec) || (d.first_sec >= end_sec)) {
+				continue;
+			}
+			const int64_t* ts = (const int64_t*)_ptr[0];
+			const int64_t r0 = std::lower_bound(ts + d.first_row, ts + d.endRow(), start_sec) - ts;
+			const int64_t r1 = std::lower_bound(ts + r0, ts + d.endRow(), end_sec) - ts;
+			if (r0 == r1) {
+				continue;
+			}
+			if (views.size() && (views.back().barSec() + views.back().size() == ts + r0)) {
+				views.back()._n += (size_t)(r1 - r0);
+			} else {
+				views.push_back(view(r0, r1 - r0));
+			}
+		}
+		return views;
+	}
+
+	// bars of a trading day, empty if not in the repository
+	BarView getDay(int day) const {
+		auto iter = _days.find(day);
+		if (iter == _days.end()) {
+			return BarView();
+		}
+		return view(iter->second.first_row, iter->second.rows);
+	}
+
+	// the latest entry of each day, in day order
+	std::vector<BarRepoDay> getDays() const {
+		std::vector<BarRepoDay> days;
+		for (const auto& kv : _days) {
+			days.push_back(kv.second);
+		}
+		return days;
+	}
+
+	const std::string& getDir() const {
+		return _dir;
+	}
+
+private:
+	const std::string _dir;
+	int _idx_fd;
+	int _fd[BarRepoNCol];
+	const char* _ptr[BarRepoNCol];
+	size_t _size[BarRepoNCol];
+	int64_t _rows;
+	std::map<int, BarRepoDay> _days;
+
+	// day.idx of the directory is not the one opened, i.e. of a compact()
+	bool replaced() const {
+		struct stat st, fst;
+		return (stat((_dir + "/day.idx").c_str(), &st) == 0) && (fstat(_idx_fd, &fst) == 0) &&
+			   ((st.st_ino != fst.st_ino) || (st.st_dev != fst.st_dev));
+	}
+
+	// the files of the directory instead of the ones opened, which are
+	// kept if any new one cannot be opened, i.e. during a compact()
+	void reopen() {
+		const int idx_fd = open((_dir + "/day.idx").c_str(), O_RDONLY);
+		int fd[BarRepoNCol];
+		int c = 0;
+		for (; (idx_fd >= 0) && (c < BarRepoNCol); ++c) {
+			fd[c] = open((_dir + "/" + BarRepoCols[c].fname).c_str(), O_RDONLY);
+			if (fd[c] < 0) {
+				break;
+			}
+		}
+		if (c < BarRepoNCol) {
+			while (c > 0) {
+				close(fd[--c]);
+			}
+			if (idx_fd >= 0) {
+				close(idx_fd);
+			}
+			logError("bar repository %s replaced but cannot be opened, the old files are kept", _dir.c_str());
+			return;
+		}
+		for (c = 0; c < BarRepoNCol; ++c) {
+			close(_fd[c]);
+			_fd[c] = fd[c];
+		}
+		close(_idx_fd);
+		_idx_fd = idx_fd;
+		logInfo("bar repository %s replaced, opened again", _dir.c_str());
+	}
+
+	BarView view(int64_t first_row, int64_t rows) const {
+		BarView v;
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			v._col[c] = _ptr[c] + first_row*BarRepoCols[c].size;
+		}
+		v._n = (size_t)rows;
+		return v;
+	}
+
+	void unmap() {
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			if (_ptr[c]) {
+				munmap((void*)_ptr[c], _size[c]);
+				_ptr[c] = NULL;
+				_size[c] = 0;
+			}
+		}
+	}
+
+	BarRepoReader(const BarRepoReader&);
+	BarRepoReader& operator=(const BarRepoReader&);
+};
+
+// one writer at a time per repository
+class BarRepoWriter {
+public:
+	BarRepoWriter(const BookConfig& bcfg, int barsec, const std::string& path = "") :
+		_dir(BarRepo::repoDir(bcfg, barsec, path)),
+		_barsec(barsec),
+		_start_hour(tradeDayStartHour()),
+		_idx_fd(-1), _rows(0)
+	{
+		recoverCompact();
+		BarRepo::makeDirs(_dir);
+		openFiles();
+	}
+
+	~BarRepoWriter() {
+		closeFiles();
+	}
+
+	// replaces the bars of a trading day, the bars not of the day are ignored
+	void putDay(int day, const std::vector<BarRecord>& bars) {
+		std::vector<BarRecord> rows;
+		rows.reserve(bars.size());
+		for (const auto& bar : bars) {
+			if (BarRepo::tradeDay(bar.bar_sec, _barsec, _start_hour) == day) {
+				rows.push_back(bar);
+			}
+		}
+		BarRepo::sortBars(rows);
+		BarRepoDay entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.day = day;
+		entry.first_row = _rows;
+		entry.rows = (int64_t)rows.size();
+		if (rows.size()) {
+			entry.first_sec = rows.front().bar_sec;
+			entry.last_sec = rows.back().bar_sec;
+		}
+		writeRows(_fd, _rows, rows);
+		if (write(_idx_fd, &entry, sizeof(entry)) != (ssize_t)sizeof(entry)) {
+			logError("bar repository %s index write error", _dir.c_str());
+			throw std::runtime_error(std::string("bar repository index write error ") + _dir);
+		}
+		_days[day] = entry;
+		_rows = entry.endRow();
+	}
+
+	// splits the bars by trading day and merges each day into the
+	// repository, see BarRepo::merge(), returns the number of days
+	int merge(const std::vector<BarRecord>& bars) {
+		std::map<int, std::vector<BarRecord> > by_day;
+		for (const auto& bar : bars) {
+			by_day[BarRepo::tradeDay(bar.bar_sec, _barsec, _start_hour)].push_back(bar);
+		}
+		for (auto& kv : by_day) {
+			BarRepo::sortBars(kv.second);
+			std::vector<BarRecord> cur;
+			getDay(kv.first, cur);
+			BarRepo::merge(cur, kv.second);
+			putDay(kv.first, cur);
+		}
+		return (int)by_day.size();
+	}
+
+	// the bars of a trading day in the repository
+	void getDay(int day, std::vector<BarRecord>& bars) const {
+		bars.clear();
+		auto iter = _days.find(day);
+		if (iter == _days.end()) {
+			return;
+		}
+		readRows(_fd, iter->second.first_row, iter->second.rows, bars);
+	}
+
+	// rewrites the files in day order without the replaced rows, the
+	// readers keep the old files until their refresh()
+	void compact() {
+		recoverCompact();
+		const std::string tmp = _dir + ".compact";
+		BarRepo::makeDirs(tmp);
+		int fd[BarRepoNCol];
+		openColumns(tmp, fd, true);
+		const int idx_fd = open((tmp + "/day.idx").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		int64_t rows = 0;
+		std::vector<BarRecord> bars;
+		for (const auto& kv : _days) {
+			readRows(_fd, kv.second.first_row, kv.second.rows, bars);
+			writeRows(fd, rows, bars);
+			// _days is of the files in use until the rename
+			BarRepoDay entry(kv.second);
+			entry.first_row = rows;
+			rows += entry.rows;
+			if ((idx_fd < 0) || (write(idx_fd, &entry, sizeof(BarRepoDay)) != (ssize_t)sizeof(BarRepoDay))) {
+				logError("bar repository %s index write error", tmp.c_str());
+				throw std::runtime_error(std::string("bar repository index write error ") + tmp);
+			}
+		}
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			close(fd[c]);
+		}
+		close(idx_fd);
+		closeFiles();
+		const std::string old = _dir + ".old";
+		bool renamed = (rename(_dir.c_str(), old.c_str()) == 0);
+		if (renamed && (rename(tmp.c_str(), _dir.c_str()) != 0)) {
+			const int err = errno;
+			rename(old.c_str(), _dir.c_str());
+			errno = err;
+			renamed = false;
+		}
+		if (!renamed) {
+			logError("bar repository %s compact rename error: %s", _dir.c_str(), strerror(errno));
+			openFiles();
+			throw std::runtime_error(std::string("bar repository compact rename error ") + _dir);
+		}
+		BarRepo::removeDir(old);
+		openFiles();
+		logInfo("bar repository %s compacted, %lld rows", _dir.c_str(), (long long)_rows);
+	}
+
+	std::vector<BarRepoDay> getDays() const {
+		std::vector<BarRepoDay> days;
+		for (const auto& kv : _days) {
+			days.push_back(kv.second);
+		}
+		return days;
+	}
+
+	const std::string& getDir() const {
+		return _dir;
+	}
+
+	int64_t getRows() const {
+		return _rows;
+	}
+
+private:
+	const std::string _dir;
+	const int _barsec;
+	const int _start_hour;
+	int _idx_fd;
+	int _fd[BarRepoNCol];
+	int64_t _rows;
+	std::map<int, BarRepoDay> _days;
+
+	// a compact() interrupted by a crash: the new directory is taken if the
+	// repository was renamed away, otherwise the old one is put back, a
+	// leftover old directory is removed
+	void recoverCompact() {
+		const std::string tmp = _dir + ".compact";
+		const std::string old = _dir + ".old";
+		struct stat st;
+		if (stat(_dir.c_str(), &st) != 0) {
+			const std::string& from((stat(tmp.c_str(), &st) == 0)? tmp : old);
+			if (stat(from.c_str(), &st) == 0) {
+				logError("bar repository %s recovered from %s", _dir.c_str(), from.c_str());
+				rename(from.c_str(), _dir.c_str());
+			}
+		}
+		if ((stat(old.c_str(), &st) == 0) && (stat(_dir.c_str(), &st) == 0)) {
+			logError("bar repository %s removes the leftover %s", _dir.c_str(), old.c_str());
+			BarRepo::removeDir(old);
+		}
+	}
+
+	void openColumns(const std::string& dir, int* fd, bool trunc) {
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			const std::string fname = dir + "/" + BarRepoCols[c].fname;
+			fd[c] = open(fname.c_str(), O_RDWR | O_CREAT | (trunc? O_TRUNC : 0), 0644);
+			if (fd[c] < 0) {
+				logError("cannot open bar repository column %s", fname.c_str());
+				throw std::runtime_error(std::string("cannot open bar repository column ") + fname);
+			}
+		}
+	}
+
+	// the rows not in the index, and a torn index entry, are truncated
+	void openFiles() {
+		openColumns(_dir, _fd, false);
+		const std::string idx = _dir + "/day.idx";
+		_idx_fd = open(idx.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+		if (_idx_fd < 0) {
+			logError("cannot open bar repository index %s", idx.c_str());
+			throw std::runtime_error(std::string("cannot open bar repository index ") + idx);
+		}
+		struct stat st;
+		if ((fstat(_idx_fd, &st) == 0) && (st.st_size % sizeof(BarRepoDay))) {
+			if (ftruncate(_idx_fd, st.st_size - st.st_size % sizeof(BarRepoDay)) != 0) {
+				throw std::runtime_error(std::string("bar repository index truncate error ") + idx);
+			}
+		}
+		_rows = BarRepo::readIndex(_idx_fd, _days);
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			if (ftruncate(_fd[c], _rows*BarRepoCols[c].size) != 0) {
+				throw std::runtime_error(std::string("bar repository column truncate error ") + _dir);
+			}
+		}
+	}
+
+	void closeFiles() {
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			close(_fd[c]);
+			_fd[c] = -1;
+		}
+		close(_idx_fd);
+		_idx_fd = -1;
+	}
+
+	// first_row is after the rows of the index, they are mapped by the readers
+	void writeRows(const int* fd, int64_t first_row, const std::vector<BarRecord>& rows) {
+		std::vector<char> buf;
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			const BarRepoCol& col(BarRepoCols[c]);
+			buf.resize(rows.size()*col.size);
+			for (size_t i = 0; i < rows.size(); ++i) {
+				memcpy(&buf[i*col.size], (const char*)&rows[i] + col.offset, col.size);
+			}
+			if (buf.size() && (pwrite(fd[c], &buf[0], buf.size(), first_row*col.size) != (ssize_t)buf.size())) {
+				logError("bar repository %s column %s write error", _dir.c_str(), col.fname);
+				throw std::runtime_error(std::string("bar repository column write error ") + _dir);
+			}
+		}
+	}
+
+	void readRows(const int* fd, int64_t first_row, int64_t n, std::vector<BarRecord>& rows) const {
+		rows.resize(n);
+		std::vector<char> buf;
+		for (int c = 0; c < BarRepoNCol; ++c) {
+			const BarRepoCol& col(BarRepoCols[c]);
+			buf.resize(n*col.size);
+			if (buf.size() && (pread(fd[c], &buf[0], buf.size(), first_row*col.size) != (ssize_t)buf.size())) {
+				logError("bar repository %s column %s read error", _dir.c_str(), col.fname);
+				throw std::runtime_error(std::string("bar repository column read error ") + _dir);
+			}
+			for (int64_t i = 0; i < n; ++i) {
+				memcpy((char*)&rows[i] + col.offset, &buf[i*col.size], col.size);
+			}
+		}
+	}
+
+	BarRepoWriter(const BarRepoWriter&);
+	BarRepoWriter& operator=(const BarRepoWriter&);
+};
+
+}  // namespace tp
@@ -10,6 +10,7 @@
 
 #include "plcc/PLCC.hpp"
 #include "time_util.h"
+#include "fmt_util.h"
 #include "queue.h"  // needed for SwQueue for BookQ
 #include <set>
 
@@ -37,6 +38,15 @@ bool  px_equal(Price x, Price y) {
 	return ((x-y<minpx) && (x-y>-minpx));
 }
 
+// the start_hour of utils::TimeUtil::utc_to_trade_day() by the config,
+// TradeDayStartHour (default 18)
+static inline
+int tradeDayStartHour() {
+	bool found = false;
+	const int hour = plcc_getInt("TradeDayStartHour", &found);
+	return found? hour : 18;
+}
+
 struct PriceEntry {
 #pragma pack(push,1)
     Price price;  // price is integer - pip adjusted and side signed (bid+ ask-)
@@ -66,9 +76,15 @@ struct PriceEntry {
     }
 
     std::string toString() const {
-        char buf[64];
-        snprintf(buf, sizeof(buf), "%lld(%.7lf:%d)", (unsigned long long) ts_micro, getPrice(), size);
-        return std::string(buf);
+        utils::FmtBuf<64> buf;
+        fmt(buf);
+        return buf.toString();
+    }
+
+    // "%lld(%.7lf:%d)"
+    template<int N>
+    void fmt(utils::FmtBuf<N>& buf) const {
+        buf.i64((long long)ts_micro).ch('(').fixed(getPrice(), 7).ch(':').i64(size).ch(')');
     }
 };
 
@@ -123,26 +139,36 @@ struct BookConfig {
     	return qname();
     }
 
-    std::string bfname(int barsec) const {
-    	return plcc_getString("BarPath")+"/"+
+    // ext is .csv for the text bars, .bar for the binary ones,
+    // in path if given instead of BarPath
+    std::string bfname(int barsec, const std::string& ext = ".csv", const std::string& path = "") const {
+    	return (path.size()? path : plcc_getString("BarPath"))+"/"+
     		   venue+"_"+
 			   (isFuture(symbol)?
 					   symbol.substr(0,symbol.size()-2):
 					   symbol)+
 			   "_B"+std::to_string(barsec)+"S"+
 			   (isbc? "_bc":"") +
-			   ".csv";
+			   ext;
     }
 
-    std::string L2fname() const {
-    	return plcc_getString("BarPath")+"/"+
-    		   venue+"_"+
+    // L2 file name without path and extension, i.e. NYM_CL_L2
+    std::string L2stem() const {
+    	return venue+"_"+
 			   (isFuture(symbol)?
 					   symbol.substr(0,symbol.size()-2):
 					   symbol)+
 			   "_" + type +
-			   (isbc? "_bc":"") +
-			   ".bin";
+			   (isbc? "_bc":"");
+    }
+
+    std::string L2fname() const {
+    	return plcc_getString("BarPath")+"/"+L2stem()+".bin";
+    }
+
+    // snapshot index of the L2 file, see L2SnapEntry
+    std::string L2idxname() const {
+    	return plcc_getString("BarPath")+"/"+L2stem()+".idx";
     }
 
     static inline
@@ -219,9 +245,9 @@ struct L2Delta {
     }
 
     std::string toString() const {
-    	char buf[256];
-    	snprintf(buf, sizeof(buf), "%d %d %d %f %d", (int) type, (int) side, (int) level, px, qty);
-    	return std::string(buf);
+    	utils::FmtBuf<256> buf;
+    	buf.i64(type).ch(' ').i64(side).ch(' ').i64(level).ch(' ').fixed(px, 6).ch(' ').i64(qty);
+    	return buf.toString();
     }
 
 };
@@ -239,7 +265,8 @@ struct BookDepot {
     Price trade_price;
     Quantity trade_size;
     int trade_attr;  // buy(0)/sell(1) possible implied
-    Quantity bvol_cum; // the cumulative buy volume since tp up
+    Quantity bvol_cum; // the cumulative buy volume since tp up, or since
+                       // its cold start with the warm restarts
     Quantity svol_cum; // the cummulative sell volume since tp up
     //Price close_px;    // the close price of previous session.
     L2Delta l2_delta;
@@ -413,58 +440,47 @@ struct BookDepot {
     }
 
     std::string toString() const {
-        char buf[1024];
-        int n = 0;
+        utils::FmtBuf<1024> buf;
         const char* update_type = getUpdateType();
-        n += snprintf(buf+n, sizeof(buf)-n, "%llu (%s-%d)",
-        		(unsigned long long)update_ts_micro,update_type,update_level);
+        buf.u64(update_ts_micro).str(" (").str(update_type).ch('-').i64(update_level).ch(')');
 		for (int s = 0; s < 2; ++s)
 		{
 			int levels = avail_level[s];
-			n += snprintf(buf+n, sizeof(buf)-n, " %s(%d) [ ", s==0?"Bid":"Ask", levels);
+			buf.ch(' ').str(s==0?"Bid":"Ask").ch('(').i64(levels).str(") [ ");
 			const PriceEntry* pe_ = &(pe[s*BookLevel]);
 			for (int i = 0; i<levels; ++i) {
 				if (pe_->size) {
-					n += snprintf(buf+n, sizeof(buf)-n, " (%d)%s ", i, pe_->toString().c_str());
+					buf.str(" (").i64(i).ch(')');
+					pe_->fmt(buf);
+					buf.ch(' ');
 				}
 				++pe_;
 			}
-			n += snprintf(buf+n, sizeof(buf)-n, " ] ");
+			buf.str(" ] ");
 		}
 		const char* bs = trade_attr==0?"Buy":"Sell";
-		n += snprintf(buf+n, sizeof(buf)-n, "%s %d@%f %d-%d",
-				bs, trade_size, trade_price, bvol_cum, svol_cum);
-        return std::string(buf);
+		buf.str(bs).ch(' ').i64(trade_size).ch('@').fixed(trade_price, 6).ch(' ').i64(bvol_cum).ch('-').i64(svol_cum);
+        return buf.toString();
     }
 
     std::string prettyPrint() const {
-    	char buf[1024];
-    	size_t n = snprintf(buf,sizeof(buf), "%lld:%s,upd_lvl(%d-%d:%d)\n",
-    			(long long)update_ts_micro,
-				getUpdateType(),
-				update_level,
-				avail_level[0],
-				avail_level[1]);
+    	utils::FmtBuf<1024> buf;
+    	buf.i64((long long)update_ts_micro).ch(':').str(getUpdateType())
+    	   .str(",upd_lvl(").i64(update_level).ch('-').i64(avail_level[0]).ch(':').i64(avail_level[1]).str(")\n");
     	if (update_type==2) {
     		// trade
-    		n+=snprintf(buf+n,sizeof(buf)-n,"   %s %d@%.7lf %d-%d\n",
-    				trade_attr==0?"B":"S",
-    			    trade_size,
-					trade_price,
-					bvol_cum,svol_cum);
+    		buf.str("   ").str(trade_attr==0?"B":"S").ch(' ').i64(trade_size).ch('@').fixed(trade_price, 7)
+    		   .ch(' ').i64(bvol_cum).ch('-').i64(svol_cum).ch('\n');
     	} else {
     		// quote
     		int lvl=avail_level[0];
     		if (lvl > avail_level[1]) lvl=avail_level[1];
     		for (int i=0;i<lvl;++i) {
-    			n+=snprintf(buf+n,sizeof(buf)-n,"\t%d\t%.7lf:%.7lf\t%d\n",
-    					pe[i].size,
-						pe[i].price,
-						pe[i+BookLevel].price,
-						pe[i+BookLevel].size);
+    			buf.ch('\t').i64(pe[i].size).ch('\t').fixed(pe[i].price, 7).ch(':')
+    			   .fixed(pe[i+BookLevel].price, 7).ch('\t').i64(pe[i+BookLevel].size).ch('\n');
     		}
     	}
-    	return std::string(buf);
+    	return buf.toString();
     }
 
     // Use it to preserve the quote accounting
@@ -762,6 +778,14 @@ struct BookL2 {
         //_last_size = 0;
     }
 
+    // the levels only, the last trade and the cumulative volumes kept
+    void resetQuotes() {
+        for (int i = 0; i < 2*BookLevel; ++i) {
+            _book.pe[i] = PriceEntry();
+        }
+        _book.avail_level[0] = _book.avail_level[1] = 0;
+    }
+
     void plccLogError(const char* msg, int number) {
         logError("book (%s) update error: "
                 "%s, %d",
@@ -854,6 +878,7 @@ public:
         // TP will ensure secid is valid. constructor of writer
         // will ensure book is not NULL
         void newPrice(double price, Quantity size, int level, bool is_bid, uint64_t ts_micro) {
+            restartIfStale();
             if (__builtin_expect(_bookL2.newPrice(price, size, level, is_bid, ts_micro), 1)) {
 				updateQ(ts_micro);
 				return;
@@ -862,6 +887,7 @@ public:
         }
 
         void delPrice(int level, bool is_bid, uint64_t ts_micro) {
+            restartIfStale();
             if (__builtin_expect((_bookL2.delPrice(level, is_bid)),1)) {
 				updateQ(ts_micro);
 				return;
@@ -870,6 +896,7 @@ public:
         }
 
         void updPrice(double price, Quantity size, int level, bool is_bid, uint64_t ts_micro) {
+            restartIfStale();
             if (__builtin_expect(_bookL2.updPrice(price, size, level, is_bid, ts_micro),1)) {
 				updateQ(ts_micro);
 				return;
@@ -939,8 +966,46 @@ public:
         	return false;
         };
 
+        // put a whole book as is, i.e. replayed from the L2 delta files
+        void updBook(const BookDepot& book, uint64_t ts_micro) {
+            _bookL2._book = book;
+            updateQ(ts_micro);
+        }
+
         void resetBook() {
             _bookL2.reset();
+            _stale = false;
+        }
+
+        // warm restart: the book of the latest update in the queue, i.e.
+        // of the previous run, taken for the BBO and trade updates.  It is
+        // stale for the depth updates, see markStale().  False if there
+        // isn't a valid one, the cumulative volumes go on still.
+        bool seedFromQ() {
+            typename QType::Reader* rq = _bq._q.newReader();
+            BookDepot book;
+            const bool ok = (rq->copyTopIn((char*)&book) == utils::QStat_OK);
+            delete rq;
+            if (!ok) {
+                return false;
+            }
+            if (!book.isValidQuote()) {
+                _bookL2._book.bvol_cum = book.bvol_cum;
+                _bookL2._book.svol_cum = book.svol_cum;
+                return false;
+            }
+            _bookL2._book = book;
+            markStale();
+            return true;
+        }
+
+        // the book is kept as is, published with the BBO and trade
+        // updates, until the first depth update starts it over, as IB
+        // sends the whole depth after a subscription or an error 317
+        void markStale() {
+            _stale = true;
+            // the next write is a snapshot for the L2 delta readers
+            _l2_snap = true;
         }
 
         const BookL2* getBook() const {
@@ -956,6 +1021,7 @@ public:
         BookQ& _bq;
         typename BookQ::QType::Writer& _wq;  // the writer's queue
         BookL2 _bookL2; // the L2 books, each book per queue
+        bool _stale;    // see markStale()
         bool _l2_snap;  // only used in updateQ(), true if current
                         // book is not written due to valid check
                         // and so next write should be a snapshot
@@ -966,10 +1032,17 @@ public:
 
         friend class BookQ<BufferType>;
         Writer(BookQ& bq) : _bq(bq), _wq(_bq._q.theWriter()),
-        		_bookL2(_bq._cfg), _l2_snap(false) {
+        		_bookL2(_bq._cfg), _stale(false), _l2_snap(false) {
         	resetBook();
         }
 
+        void restartIfStale() {
+        	if (__builtin_expect(_stale, 0)) {
+        		_bookL2.resetQuotes();
+        		_stale = false;
+        	}
+        }
+
         void updateQ(uint64_t ts_micro) {
         	if (__builtin_expect(_bookL2.isValid(), 1)) {
 				if (__builtin_expect(_l2_snap, 0)) {
@@ -1053,6 +1126,12 @@ public:
         	return false;
         }
 
+        // the next read is of the oldest update still in the queue
+        void seekToOldest() {
+            _rq->seekToBottom();
+            _rq->catchUp();
+        }
+
         ~Reader() {
             delete _rq;
             _rq = NULL;
@@ -1070,38 +1149,85 @@ public:
 
 };
 
-// A file writer
-class BarLineWriter {
-public:
-    const std::string bfname;
+// Statistics of a bar, mergeable so that bars of a base
+// period roll into bars of its multiples
+struct BarStats {
+    // state of the book at the bar close
+    Price bp,ap;
+    Quantity bsz,asz;
+    // accumulated within the bar
+    Quantity bv,sv;
+    int bqcnt, aqcnt, btcnt, stcnt;
+    Price ism_cum;
+    int64_t total_ism_micro;
+    // update_ts_micro of the latest book update
+    int64_t upd_micro;
 
-    explicit BarLineWriter(const char* barfile_name) :
-    		bfname(barfile_name), bfp(0), bvol(0),svol(0),
-			bqcnt(0), aqcnt(0), btcnt(0), stcnt(0),
-			ism(0), ism_cum(0), bp(0),ap(0),bsz(0),asz(0),bv(0),sv(0),
-			prev_ism_micro(0), total_ism_micro(0) {
-    	bfp=fopen(bfname.c_str(), "at+");
-    	if (!bfp) {
-    		throw std::runtime_error(std::string("fopen error")+bfname);
-    	}
+    BarStats() : bp(0),ap(0),bsz(0),asz(0),upd_micro(0) {
+        reset();
     }
 
+    void reset() {
+    	bqcnt=0;
+    	aqcnt=0;
+    	btcnt=0;
+    	stcnt=0;
+    	ism_cum=0;
+        total_ism_micro=0;
+    	bv=0;
+    	sv=0;
+    }
+
+    // merge a later bar into this one
+    void merge(const BarStats& bar) {
+    	bp=bar.bp;
+    	ap=bar.ap;
+    	bsz=bar.bsz;
+    	asz=bar.asz;
+    	upd_micro=bar.upd_micro;
+    	bv+=bar.bv;
+    	sv+=bar.sv;
+    	bqcnt+=bar.bqcnt;
+    	aqcnt+=bar.aqcnt;
+    	btcnt+=bar.btcnt;
+    	stcnt+=bar.stcnt;
+    	ism_cum+=bar.ism_cum;
+    	total_ism_micro+=bar.total_ism_micro;
+    }
+};
+
+// Accumulates the book updates into the current bar.  By the update
+// time (upd_time), as the bars rebuilt from the recorded books, an
+// update earlier than the last update or bar close is taken as of
+// that time and no ISM time is accumulated before the first valid book.
+class BarAccumulator {
+public:
+    explicit BarAccumulator(bool upd_time = false) :
+    	by_upd_time(upd_time),bvol(0),svol(0),ism(0),prev_ism_micro(0) {};
+
     void initFromBook(const BookDepot& book, int64_t cur_micro) {
-        reset();
+        bar.reset();
     	bvol=book.bvol_cum;
     	svol=book.svol_cum;
-    	bp=book.getBid(&bsz);
-    	ap=book.getAsk(&asz);
-    	if ( bp*ap*bsz*asz != 0 ) {
+    	bar.bp=book.getBid(&bar.bsz);
+    	bar.ap=book.getAsk(&bar.asz);
+    	bar.upd_micro=book.update_ts_micro;
+    	if ( bar.bp*bar.ap*bar.bsz*bar.asz != 0 ) {
     	    ism = getISM();
     	    prev_ism_micro = cur_micro;
+        } else if (by_upd_time) {
+        	prev_ism_micro = cur_micro;
         }
     }
 
     // new price update
     void update(const BookDepot& book,int64_t this_micro) {
-    	bp=book.getBid(&bsz);
-    	ap=book.getAsk(&asz);
+    	bar.bp=book.getBid(&bar.bsz);
+    	bar.ap=book.getAsk(&bar.asz);
+    	bar.upd_micro=book.update_ts_micro;
+    	if (__builtin_expect(by_upd_time && (this_micro < prev_ism_micro), 0)) {
+    		this_micro = prev_ism_micro;
+    	}
     	switch (book.update_type) {
     	case 2 : {
     		// trade update
@@ -1118,21 +1244,21 @@ public:
         	bvol=book.bvol_cum;
         	svol=book.svol_cum;
         	if (bv0 > 0) {
-        		++btcnt;
-        		bv+=bv0;
+        		++bar.btcnt;
+        		bar.bv+=bv0;
         	}
         	if (sv0 > 0) {
-        		++stcnt;
-        		sv+=sv0;
+        		++bar.stcnt;
+        		bar.sv+=sv0;
         	}
         	break;
     	};
     	case 0 : {
-			++bqcnt;
+			++bar.bqcnt;
 			break;
     	}
     	case 1 : {
-			++aqcnt;
+			++bar.aqcnt;
 			break;
     	}
     	default :
@@ -1144,26 +1270,193 @@ public:
 			// account for previous ism into ism_cum
 			uint64_t ism_micro = 0;
 			ism_micro = this_micro - prev_ism_micro;
-            total_ism_micro += ism_micro;
-			ism_cum += ism*ism_micro;
+			if ((ism != 0) || !by_upd_time) {
+				bar.total_ism_micro += ism_micro;
+				bar.ism_cum += ism*ism_micro;
+			}
 			prev_ism_micro = this_micro;
 			ism = getISM();
     	}
     }
 
-    void onBar(int64_t cur_micro) {
-        // cur_micro should be this bar second
+    // closes the current bar at cur_micro, the bar second, and
+    // starts the next one.  The returned bar is valid until
+    // the next update.
+    const BarStats& onBar(int64_t cur_micro) {
     	uint64_t ism_micro = 0;
 		ism_micro = cur_micro - prev_ism_micro;
-        total_ism_micro += ism_micro;
-		ism_cum += ism*ism_micro;
-		writeBarLine(cur_micro);
+		if ((ism != 0) || !by_upd_time) {
+			bar.total_ism_micro += ism_micro;
+			bar.ism_cum += ism*ism_micro;
+		}
 		prev_ism_micro = cur_micro;
-		reset();
+		closed = bar;
+		bar.reset();
+		return closed;
+    }
+
+private:
+    const bool by_upd_time;
+    Quantity bvol, svol;
+    Price ism;
+    int64_t prev_ism_micro;
+    BarStats bar;
+    BarStats closed;
+
+    Price getISM() {
+    	return (bar.bp*bar.asz + bar.ap*bar.bsz)/(bar.bsz + bar.asz);
+    }
+};
+
+/*
+ * Binary bar file, a BarFileHeader followed by fixed width BarRecord,
+ * the same fields as the csv bar line.  Little endian, no padding,
+ * see python/barbin.py.
+ */
+struct BarFileHeader {
+	static const uint32_t Version = 1;
+	char magic[8];        // "KRBAR"
+	uint32_t version;
+	uint32_t record_size;
+	int32_t barsec;
+	int32_t reserved;
+	char symbol[40];      // venue/symbol of the writer that created the file
+
+	BarFileHeader() {
+		memset(this, 0, sizeof(BarFileHeader));
+	}
+
+	BarFileHeader(const BookConfig& cfg, int bar_sec);
+
+	bool isValid(int bar_sec) const;
+};
+
+struct BarRecord {
+	int64_t bar_sec;
+	double bp;
+	double ap;
+	double ism_twap;
+	int64_t upd_micro;
+	int32_t bsz;
+	int32_t asz;
+	int32_t bv;
+	int32_t sv;
+	int32_t bqcnt;
+	int32_t aqcnt;
+	int32_t btcnt;
+	int32_t stcnt;
+};
+
+inline BarFileHeader::BarFileHeader(const BookConfig& cfg, int bar_sec) {
+	memset(this, 0, sizeof(BarFileHeader));
+	strncpy(magic, "KRBAR", sizeof(magic));
+	version = Version;
+	record_size = sizeof(BarRecord);
+	barsec = bar_sec;
+	snprintf(symbol, sizeof(symbol), "%s/%s", cfg.venue.c_str(), cfg.symbol.c_str());
+}
+
+inline bool BarFileHeader::isValid(int bar_sec) const {
+	return (strncmp(magic, "KRBAR", sizeof(magic)) == 0) &&
+		   (version == Version) &&
+		   (record_size == sizeof(BarRecord)) &&
+		   (barsec == bar_sec);
+}
+
+// A file writer, the csv and/or the binary bar file
+class BarLineWriter {
+public:
+    const std::string bfname;
+
+    explicit BarLineWriter(const char* barfile_name) :
+    		bfname(barfile_name), by_upd_time(false), bfp(0), bbfp(0) {
+    	bfp=fopen(bfname.c_str(), "at+");
+    	if (!bfp) {
+    		throw std::runtime_error(std::string("fopen error")+bfname);
+    	}
+    }
+
+    // BarFormat of csv (default), bin or both, in bar_path
+    // if given instead of BarPath.  See writeBarLine() for upd_time
+    BarLineWriter(const BookConfig& cfg, int barsec, const std::string& bar_path = "",
+    		bool upd_time = false) :
+    		bfname(cfg.bfname(barsec, ".csv", bar_path)), by_upd_time(upd_time),
+    		bfp(0), bbfp(0), acc(upd_time) {
+    	const std::string fmt = plcc_getString("BarFormat", NULL, "csv");
+    	if (fmt != "bin") {
+			bfp=fopen(bfname.c_str(), "at+");
+			if (!bfp) {
+				throw std::runtime_error(std::string("fopen error")+bfname);
+			}
+    	}
+    	if (fmt == "bin" || fmt == "both") {
+    		openBin(cfg, barsec, bar_path);
+    	}
     }
 
+    void initFromBook(const BookDepot& book, int64_t cur_micro) {
+    	acc.initFromBook(book, cur_micro);
+    }
+
+    // new price update
+    void update(const BookDepot& book,int64_t this_micro) {
+    	acc.update(book, this_micro);
+    }
+
+    void onBar(int64_t cur_micro) {
+        // cur_micro should be this bar second
+		writeBarLine(cur_micro, acc.onBar(cur_micro));
+    }
+
+	// in the format of
+    // bar_sec,bsz,bp,asz,ap,buyVol,sellVol,updMicro,bqcnt,aqcnt,btcnt,stcnt,ismTwap
+    // where updMicro is the time of writing, or by the update time
+    // (upd_time) the update time of the latest book and ismTwap 0
+    // instead of nan without a valid book in the bar
+    void writeBarLine(int64_t cur_micro, const BarStats& bar) {
+        if (bar.ap*bar.bp != 0) {
+        	const long long upd_micro = by_upd_time? (long long) bar.upd_micro :
+        			(long long) utils::TimeUtil::cur_time_micro();
+        	const double ism_twap = (by_upd_time && (bar.total_ism_micro == 0))? 0 :
+        			(double)bar.ism_cum/bar.total_ism_micro;
+        	if (bfp) {
+				// "%d, %d, %.7lf, %.7lf, %d, %d, %d, %lld, %d, %d, %d, %d, %.7lf\n"
+				utils::FmtBuf<512> line;
+				line.i64((int) (cur_micro/1000000ULL)).str(", ").i64(bar.bsz).str(", ")
+					.fixed(bar.bp, 7).str(", ").fixed(bar.ap, 7).str(", ")
+					.i64(bar.asz).str(", ").i64(bar.bv).str(", ").i64(bar.sv).str(", ")
+					.i64(upd_micro).str(", ")
+					.i64(bar.bqcnt).str(", ").i64(bar.aqcnt).str(", ").i64(bar.btcnt).str(", ").i64(bar.stcnt).str(", ")
+					.fixed(ism_twap, 7).ch('\n');
+				fwrite(line.data(), 1, line.size(), bfp);
+        	}
+        	if (bbfp) {
+        		BarRecord rec;
+        		rec.bar_sec = cur_micro/1000000LL;
+        		rec.bp = bar.bp;
+        		rec.ap = bar.ap;
+        		rec.ism_twap = ism_twap;
+        		rec.upd_micro = upd_micro;
+        		rec.bsz = bar.bsz;
+        		rec.asz = bar.asz;
+        		rec.bv = bar.bv;
+        		rec.sv = bar.sv;
+        		rec.bqcnt = bar.bqcnt;
+        		rec.aqcnt = bar.aqcnt;
+        		rec.btcnt = bar.btcnt;
+        		rec.stcnt = bar.stcnt;
+        		fwrite(&rec, sizeof(BarRecord), 1, bbfp);
+        	}
+        }
+    };
+
     void flush() const {
-    	fflush(bfp);
+    	if (bfp) {
+    		fflush(bfp);
+    	}
+    	if (bbfp) {
+    		fflush(bbfp);
+    	}
     }
 
     ~BarLineWriter() {
@@ -1171,88 +1464,242 @@ public:
     		fclose(bfp);
     		bfp=NULL;
     	}
+    	if (bbfp) {
+    		fclose(bbfp);
+    		bbfp=NULL;
+    	}
     }
 
 private:
+    const bool by_upd_time;
     FILE* bfp;
-    Quantity bvol, svol;
-    int bqcnt, aqcnt, btcnt, stcnt;
-    Price ism, ism_cum;
-    // state of previous book
-    Price bp,ap;
-    Quantity bsz,asz,bv,sv;
-    int64_t prev_ism_micro;
-    int64_t total_ism_micro;
+    FILE* bbfp;
+    BarAccumulator acc;
+
+    // append to the binary bar file, a new file gets the header,
+    // an existing one has to agree with it.  A partial record
+    // at the end, i.e. from a crash, is dropped.
+    void openBin(const BookConfig& cfg, int barsec, const std::string& bar_path) {
+    	const std::string fname = cfg.bfname(barsec, ".bar", bar_path);
+    	bbfp=fopen(fname.c_str(), "ab+");
+    	if (!bbfp) {
+    		throw std::runtime_error(std::string("fopen error")+fname);
+    	}
+    	fseek(bbfp, 0, SEEK_END);
+    	long size = ftell(bbfp);
+    	if (size == 0) {
+    		const BarFileHeader hdr(cfg, barsec);
+    		fwrite(&hdr, sizeof(BarFileHeader), 1, bbfp);
+    		fflush(bbfp);
+    		return;
+    	}
+    	BarFileHeader hdr;
+    	fseek(bbfp, 0, SEEK_SET);
+    	if ((size < (long)sizeof(BarFileHeader)) ||
+    		(fread(&hdr, sizeof(BarFileHeader), 1, bbfp) != 1) ||
+    		(!hdr.isValid(barsec))) {
+    		logError("binary bar file %s header mismatch", fname.c_str());
+    		throw std::runtime_error(std::string("binary bar file header mismatch ")+fname);
+    	}
+    	const long partial = (size - (long)sizeof(BarFileHeader)) % (long)sizeof(BarRecord);
+    	if (partial != 0) {
+    		logError("binary bar file %s dropping a partial record of %d bytes", fname.c_str(), (int)partial);
+    		if (ftruncate(fileno(bbfp), size - partial) != 0) {
+    			throw std::runtime_error(std::string("binary bar file truncate error ")+fname);
+    		}
+    	}
+    	fseek(bbfp, 0, SEEK_END);
+    }
+};
 
-	// in the format of
-    // bar_sec,bsz,bp,asz,ap,buyVol,sellVol,updMicro,bqcnt,aqcnt,btcnt,stcnt,ismTwap
-    void writeBarLine(int64_t cur_micro) {
-        if (ap*bp != 0) {
-            fprintf(bfp, "%d, %d, %.7lf, %.7lf, %d, %d, %d, %lld, %d, %d, %d, %d, %.7lf\n",
-                    (int) (cur_micro/1000000ULL), bsz,bp,ap,asz,bv,sv,
-                    (long long) utils::TimeUtil::cur_time_micro(),
-                    bqcnt,aqcnt,btcnt,stcnt,(double)ism_cum/total_ism_micro);
-        }
-    };
+// Bars of a list of periods of a symbol.  The updates are
+// accumulated into bars of the shortest period, which roll into the
+// longer ones, each must be a multiple of the shortest.  Each period
+// is written to its own bar file, the same as from a BarSeries of
+// that period alone.  By the update time (upd_time) or the time of
+// the read, see BarAccumulator and BarLineWriter.
+class BarSeries {
+public:
+	BarSeries(const BookConfig& cfg, const std::vector<int>& bar_secs, const std::string& bar_path = "",
+			bool upd_time = false) :
+		bcfg(cfg), barsec(baseSec(bar_secs)), path(bar_path), by_upd_time(upd_time), acc(upd_time) {
+		for (int sec : bar_secs) {
+			if (sec % barsec != 0) {
+				logError("bar period %d not a multiple of %d", sec, barsec);
+				throw std::runtime_error("bar period not a multiple of the shortest");
+			}
+			addPeriod(sec);
+		}
+	}
 
-    void reset() {
-    	bqcnt=0;
-    	aqcnt=0;
-    	btcnt=0;
-    	stcnt=0;
-    	ism_cum=0;
-        total_ism_micro=0;
-    	bv=0;
-    	sv=0;
-    }
+	void initFromBook(const BookDepot& book, int64_t cur_micro) {
+		acc.initFromBook(book, cur_micro);
+	}
 
-    Price getISM() {
-    	return (bp*asz + ap*bsz)/(bsz + asz);
+	// the book's update time is the time of the update
+	void update(const BookDepot& book) {
+		acc.update(book, (int64_t)book.update_ts_micro);
+	}
+
+	void update(const BookDepot& book, int64_t this_micro) {
+		acc.update(book, this_micro);
+	}
+
+	// cur_micro is the bar second of the shortest period
+    void onBar(int64_t cur_micro) {
+    	const BarStats& bar(acc.onBar(cur_micro));
+    	for (auto p : periods) {
+    		p->bar.merge(bar);
+    		if (cur_micro % p->bar_micro == 0) {
+    			p->bw.writeBarLine(cur_micro, p->bar);
+    			p->bar.reset();
+    		}
+    	}
     }
 
-};
+	void flush() const {
+		for (auto p : periods) {
+			p->bw.flush();
+		}
+	}
 
+	// the shortest period, the bar second for onBar()
+	int getBarSec() const {
+		return barsec;
+	}
 
+	// the longest period
+	int getMaxBarSec() const {
+		int sec = barsec;
+		for (auto p : periods) {
+			sec = getMax(sec, (int)(p->bar_micro/1000000LL));
+		}
+		return sec;
+	}
+
+	~BarSeries() {
+		for (auto p : periods) {
+			delete p;
+		}
+	};
+
+	static int baseSec(const std::vector<int>& bar_secs) {
+		if (bar_secs.size() == 0) {
+			throw std::runtime_error("no bar period given");
+		}
+		int sec = bar_secs[0];
+		for (int s : bar_secs) {
+			if (s <= 0) {
+				throw std::runtime_error("bar period should be positive");
+			}
+			sec = getMin(sec, s);
+		}
+		return sec;
+	}
+
+private:
+	struct Period {
+		const int64_t bar_micro;
+		BarLineWriter bw;
+		BarStats bar;
+		Period(const BookConfig& cfg, int sec, const std::string& path, bool upd_time) :
+			bar_micro(sec*1000000LL), bw(cfg, sec, path, upd_time) {};
+	};
+
+	const BookConfig bcfg;
+	const int barsec;
+	const std::string path;
+	const bool by_upd_time;
+	BarAccumulator acc;
+	std::vector<Period*> periods;
+
+	void addPeriod(int sec) {
+		for (auto p : periods) {
+			if (p->bar_micro == sec*1000000LL) {
+				return;
+			}
+		}
+		periods.push_back(new Period(bcfg, sec, path, by_upd_time));
+	}
+};
+
+// The BarSeries of a book queue.  The updates go to the bar of the
+// time they are read, update_continous(), or by the update time
+// (upd_time) to the bar of their update_ts_micro, update_until(),
+// where an update of a later bar is kept until onBar() is called.
 template <template<int, int> class BufferType >
 class BarLine {
 public:
-	BarLine(const BookConfig& cfg, int bar_sec) :
-		bcfg(cfg), barsec(bar_sec),
-		bq(cfg,true), br(bq.newReader()),
-		bw(cfg.bfname(barsec).c_str()) {
+	BarLine(const BookConfig& cfg, int bar_sec, bool upd_time = false) :
+		bcfg(cfg), bars(cfg, std::vector<int>(1, bar_sec), "", upd_time),
+		bq(cfg,true), br(bq.newReader()), has_pending(false) {
+		init();
+	}
 
-		// refresh the book queue to only
-		// cares about the latest
-		BookDepot book;
-		br->getLatestUpdateAndAdvance(book);
-        bw.initFromBook(book, utils::TimeUtil::cur_time_micro());
+	BarLine(const BookConfig& cfg, const std::vector<int>& bar_secs, bool upd_time = false) :
+		bcfg(cfg), bars(cfg, bar_secs, "", upd_time),
+		bq(cfg,true), br(bq.newReader()), has_pending(false) {
+		init();
 	}
 
 	bool update_continous(int64_t cur_micro) {
 		BookDepot book;
 		//if (br->getLatestUpdateAndAdvance(book)) {
 		if (br->getNextUpdate(book)) {
-			bw.update(book, cur_micro);
+			bars.update(book, cur_micro);
 			return true;
 		}
 		return false;
 	}
 
+	// next_bar_micro is the close of the current bar
+	bool update_until(int64_t next_bar_micro) {
+		if (!has_pending) {
+			if (!br->getNextUpdate(pending)) {
+				return false;
+			}
+			has_pending = true;
+		}
+		if ((int64_t)pending.update_ts_micro >= next_bar_micro) {
+			return false;
+		}
+		bars.update(pending);
+		has_pending = false;
+		return true;
+	}
+
+	// cur_micro is the bar second of the shortest period
     void onBar(int64_t cur_micro) {
-        bw.onBar(cur_micro);
+    	bars.onBar(cur_micro);
     }
 
 	void flush() const {
-		bw.flush();
+		bars.flush();
 	}
 
-	~BarLine() { delete br ; br=NULL;};
+	// the shortest period, the bar second for onBar()
+	int getBarSec() const {
+		return bars.getBarSec();
+	}
+
+	~BarLine() {
+		delete br ; br=NULL;
+	};
 private:
 	const BookConfig bcfg;
-	const int barsec;
+	BarSeries bars;
 	BookQ<BufferType> bq;
 	typename BookQ<BufferType>::Reader* br;
-	BarLineWriter bw;
+	BookDepot pending;
+	bool has_pending;
+
+	void init() {
+		// refresh the book queue to only
+		// cares about the latest
+		BookDepot book;
+		br->getLatestUpdateAndAdvance(book);
+        bars.initFromBook(book, utils::TimeUtil::cur_time_micro());
+	}
 };
 
 /*
@@ -1262,23 +1709,86 @@ private:
  * Where PREAMBLE is a unique 8-bytes sequence to detect start of a snapshot
  * [TS_MICRO L2DELTA] is repeated and is supposed to be applied to the
  * snapshot until the next snapshot
+ *
+ * Each snapshot written is also appended to the index file (L2idxname())
+ * as a L2SnapEntry, for the readers to seek without scanning.
  */
 
 static const uint64_t SnapshotPreamble = 0xf0f0f0f0f0f0f0f0ULL;
 static const int SnapCount  = 1024;
 
+struct L2SnapEntry {
+	uint64_t ts_micro;  // update_ts_micro of the snapshot book
+	uint64_t pos;       // file offset of the preamble
+	L2SnapEntry() : ts_micro(0), pos(0) {};
+	L2SnapEntry(uint64_t ts, uint64_t p) : ts_micro(ts), pos(p) {};
+};
+
+/*
+ * When L2DeltaWriter writes a snapshot, other than a snapshot from
+ * the book queue:
+ * L2SnapBytes:       bytes of deltas since the last snapshot
+ * L2SnapReplayMicro: estimated micro to decode the deltas since the last
+ *                    snapshot, at L2SnapDeltaNano per delta, 0 disables
+ * L2SnapMaxSec:      seconds since the last snapshot
+ *
+ * Each key can be given per file as key_<L2stem>, i.e. L2SnapBytes_NYM_CL_L2,
+ * otherwise the key itself, otherwise the default of a snapshot every
+ * SnapCount deltas or 300 seconds.
+ */
+struct L2SnapPolicy {
+	uint64_t max_bytes;
+	uint64_t max_replay_micro;
+	uint64_t delta_nano;
+	uint64_t max_micro;
+
+	explicit L2SnapPolicy(const BookConfig& bcfg) :
+		max_bytes(getCfg("L2SnapBytes", bcfg, SnapCount*(sizeof(uint64_t)+sizeof(L2Delta)))),
+		max_replay_micro(getCfg("L2SnapReplayMicro", bcfg, 0)),
+		delta_nano(getCfg("L2SnapDeltaNano", bcfg, 50)),
+		max_micro(getCfg("L2SnapMaxSec", bcfg, 300)*1000000ULL) {};
+
+	// deltas and their bytes written since the last snapshot
+	bool needSnap(uint64_t bytes, uint64_t deltas, uint64_t micro_since) const {
+		return (bytes >= max_bytes) ||
+			   (max_replay_micro && (deltas*delta_nano >= max_replay_micro*1000ULL)) ||
+			   (micro_since > max_micro);
+	}
+
+	std::string toString() const {
+		char buf[256];
+		snprintf(buf, sizeof(buf), "bytes(%llu) replay_micro(%llu) delta_nano(%llu) max_sec(%llu)",
+				(unsigned long long) max_bytes, (unsigned long long) max_replay_micro,
+				(unsigned long long) delta_nano, (unsigned long long) max_micro/1000000ULL);
+		return std::string(buf);
+	}
+
+	static uint64_t getCfg(const char* key, const BookConfig& bcfg, uint64_t dflt) {
+		bool found = false;
+		int val = plcc_getInt((std::string(key) + "_" + bcfg.L2stem()).c_str(), &found);
+		if (!found) {
+			val = plcc_getInt(key, &found);
+		}
+		return (found && val >= 0)? (uint64_t) val : dflt;
+	}
+};
+
 template <template<int, int> class BufferType >
 class L2DeltaWriter {
 public:
 	static const int FlushCount = 1;
-	static const uint64_t MaxSnapMicro = 300ULL * 1000000ULL;
 
 	L2DeltaWriter(const BookConfig& bcfg) :
 		_bcfg(bcfg),
 		_fp(fopen(bcfg.L2fname().c_str(), "ab+")), // barsec=0 -> L2Delta
+		_idx_fp(fopen(bcfg.L2idxname().c_str(), "ab")),
+		_policy(bcfg),
 		_flushCount(0),
-		_snapCount(0),
-		_nextSnapSec(0),
+		_pos(0),
+		_snapBytes(0),
+		_snapDeltas(0),
+		_snapMicro(0),
+		_hasSnap(false),
 		_bq(_bcfg,true), _br(_bq.newReader())
 	{
 		if (!_fp) {
@@ -1286,16 +1796,26 @@ public:
 					std::string("cannot open file for L2 delta writer")
 			        + bcfg.toString());
 		}
+		if (!_idx_fp) {
+			throw std::runtime_error(
+					std::string("cannot open index file for L2 delta writer")
+			        + bcfg.toString());
+		}
 		if (!_br) {
 			throw std::runtime_error(
 					std::string("cannot open shm queue for L2 delta writer ")
 			        + bcfg.toString());
 		}
+		_pos = recoverEnd();
+		logInfo("L2 delta writer %s snapshot policy %s", _bcfg.toString().c_str(), _policy.toString().c_str());
 	};
 	~L2DeltaWriter() {
 		if (_fp)
 			fclose(_fp);
 		_fp=NULL;
+		if (_idx_fp)
+			fclose(_idx_fp);
+		_idx_fp=NULL;
 		delete _br;
 		_br = NULL;
 	}
@@ -1311,38 +1831,120 @@ public:
 private:
 	const BookConfig& _bcfg;
 	FILE* _fp;
+	FILE* _idx_fp;
+	const L2SnapPolicy _policy;
 	int _flushCount;
-	int _snapCount;
-	uint64_t _nextSnapSec;
+	uint64_t _pos;         // file size written
+	uint64_t _snapBytes;   // delta bytes since the last snapshot
+	uint64_t _snapDeltas;  // deltas since the last snapshot
+	uint64_t _snapMicro;   // ts of the last snapshot
+	bool _hasSnap;
 	BookQ<BufferType> _bq;
 	typename BookQ<BufferType>::Reader* _br;
 
+	// The end of the last complete record, where the writing goes on.
+	// A crash could leave a partial record at the end of the file, or
+	// index entries of the snapshots not in the file, both are truncated
+	// so the appended records and entries are not misaligned.  The records
+	// are walked from the last indexed snapshot, or from the start of the
+	// file without index.
+	uint64_t recoverEnd() {
+		fseek(_fp, 0, SEEK_END);
+		const uint64_t size = ftell(_fp);
+		const uint64_t snap_len = sizeof(uint64_t) + sizeof(BookDepot);
+
+		fseek(_idx_fp, 0, SEEK_END);
+		const long idx_size = ftell(_idx_fp);
+		long n = idx_size/(long)sizeof(L2SnapEntry);
+		uint64_t pos = 0;
+		FILE* fp = fopen(_bcfg.L2idxname().c_str(), "rb");
+		for (; fp && (n > 0); --n) {
+			L2SnapEntry entry;
+			uint64_t word = 0;
+			fseek(fp, (n-1)*sizeof(L2SnapEntry), SEEK_SET);
+			if ((fread(&entry, sizeof(L2SnapEntry), 1, fp) == 1) &&
+				(entry.pos + snap_len <= size)) {
+				fseek(_fp, entry.pos, SEEK_SET);
+				if ((fread(&word, sizeof(uint64_t), 1, _fp) == 1) &&
+					(word == SnapshotPreamble)) {
+					pos = entry.pos;
+					break;
+				}
+			}
+		}
+		if (fp) {
+			fclose(fp);
+		}
+		if (n*(long)sizeof(L2SnapEntry) != idx_size) {
+			logError("L2 delta index %s truncated from %ld to %ld entries",
+					_bcfg.L2idxname().c_str(), idx_size/(long)sizeof(L2SnapEntry), n);
+			if (ftruncate(fileno(_idx_fp), n*sizeof(L2SnapEntry)) != 0) {
+				throw std::runtime_error(std::string("cannot truncate L2 delta index ") + _bcfg.L2idxname());
+			}
+		}
+
+		char rec[sizeof(BookDepot)];
+		fseek(_fp, pos, SEEK_SET);
+		while (pos + sizeof(uint64_t) <= size) {
+			uint64_t header;
+			if (fread(&header, sizeof(uint64_t), 1, _fp) != 1) {
+				break;
+			}
+			const size_t len = (header == SnapshotPreamble)? sizeof(BookDepot) : sizeof(L2Delta);
+			if ((pos + sizeof(uint64_t) + len > size) || (fread(rec, len, 1, _fp) != 1)) {
+				break;
+			}
+			pos += sizeof(uint64_t) + len;
+		}
+		if (pos != size) {
+			logError("L2 delta file %s truncated a partial record from %llu to %llu bytes",
+					_bcfg.L2fname().c_str(), (unsigned long long) size, (unsigned long long) pos);
+			if (ftruncate(fileno(_fp), pos) != 0) {
+				throw std::runtime_error(std::string("cannot truncate L2 delta file ") + _bcfg.L2fname());
+			}
+		}
+		fseek(_fp, 0, SEEK_END);
+		return pos;
+	}
+
 	void writeSnap(const BookDepot& book) {
 		logDebug("write snap\n");
 		fwrite(&SnapshotPreamble, sizeof(uint64_t), 1, _fp);
 		fwrite(&book, sizeof(BookDepot), 1, _fp);
+		const L2SnapEntry entry(book.update_ts_micro, _pos);
+		fwrite(&entry, sizeof(L2SnapEntry), 1, _idx_fp);
+		_pos += (sizeof(uint64_t) + sizeof(BookDepot));
 	}
 	void writeDelta(const BookDepot& book) {
 		logDebug("write delta: %s\n", book.l2_delta.toString().c_str());
 		fwrite(&book.update_ts_micro, sizeof(uint64_t), 1, _fp);
 		fwrite(&book.l2_delta, sizeof(book.l2_delta), 1, _fp);
+		_pos += (sizeof(uint64_t) + sizeof(L2Delta));
 	}
 
 	void write(const BookDepot& book) {
 		// just write a timestamp and book.l2detal
-		// if a snapshot or _nextSnapSec, write a book
-		// with a 8 byte preamble
-		if (book.l2_delta.type == 0 || _snapCount == 0 || book.update_ts_micro > _nextSnapSec) {
+		// if a snapshot or the snapshot policy says so, write
+		// a book with a 8 byte preamble
+		if (book.l2_delta.type == 0 || !_hasSnap ||
+			_policy.needSnap(_snapBytes, _snapDeltas,
+					book.update_ts_micro > _snapMicro? book.update_ts_micro - _snapMicro : 0)) {
 			// write a snap, reset count
 			writeSnap(book);
-			_snapCount = SnapCount;
-			_nextSnapSec = book.update_ts_micro + MaxSnapMicro;
+			_hasSnap = true;
+			_snapBytes = 0;
+			_snapDeltas = 0;
+			_snapMicro = book.update_ts_micro;
 		} else {
-			--_snapCount;
 			writeDelta(book);
+			_snapBytes += (sizeof(uint64_t) + sizeof(L2Delta));
+			++_snapDeltas;
 		}
 		if (_flushCount == 0) {
+			// the index after the file, so an index entry
+			// is always readable from the file
 			fflush(_fp);
+			fflush(_idx_fp);
 			_flushCount = FlushCount;
 		} else {
 			--_flushCount;
@@ -1409,20 +2011,64 @@ private:
 	bool _has_header;
 	uint64_t _header;
 
+	// position to the latest snapshot
 	void sync() {
 		_file_size = updFileSize();
-		uint64_t seek_point = SnapCount*(sizeof(L2Delta)+sizeof(uint64_t)) + sizeof(uint64_t);
-		if (seek_point < _file_size) {
-			_last_pos = _file_size - seek_point;
+		_has_header = false;
+		L2SnapEntry entry;
+		if (lastIndexEntry(entry) &&
+			(entry.pos + sizeof(uint64_t) + sizeof(BookDepot) <= _file_size) &&
+			(readWord(entry.pos) == SnapshotPreamble)) {
+			_last_pos = entry.pos;
 			fseek(_fp, _last_pos, SEEK_SET);
+			return;
 		}
-		while(true) {
-			_has_header = false;
-			if (readHeader()) {
-				if (_header == SnapshotPreamble)
-					break;
+
+		// no index, look for the preamble within the snapshot
+		// policy's distance from the end, the records are 8 bytes aligned
+		const L2SnapPolicy policy(_bcfg);
+		const uint64_t seek_point = policy.max_bytes + 2*(sizeof(uint64_t)+sizeof(BookDepot));
+		uint64_t pos = 0;
+		if (seek_point < _file_size) {
+			pos = (_file_size - seek_point)/sizeof(uint64_t)*sizeof(uint64_t);
+		}
+		uint64_t snap_pos = 0;  // a file starts with a snapshot
+		fseek(_fp, pos, SEEK_SET);
+		uint64_t word;
+		while ((pos + sizeof(uint64_t) <= _file_size) &&
+			   (fread(&word, sizeof(uint64_t), 1, _fp) == 1)) {
+			if (word == SnapshotPreamble) {
+				snap_pos = pos;
 			}
+			pos += sizeof(uint64_t);
+		}
+		_last_pos = snap_pos;
+		fseek(_fp, _last_pos, SEEK_SET);
+	}
+
+	bool lastIndexEntry(L2SnapEntry& entry) const {
+		FILE* fp = fopen(_bcfg.L2idxname().c_str(), "rb");
+		if (!fp) {
+			return false;
+		}
+		bool ret = false;
+		fseek(fp, 0, SEEK_END);
+		const long n = ftell(fp)/(long)sizeof(L2SnapEntry);
+		if (n > 0) {
+			fseek(fp, (n-1)*sizeof(L2SnapEntry), SEEK_SET);
+			ret = (fread(&entry, sizeof(L2SnapEntry), 1, fp) == 1);
+		}
+		fclose(fp);
+		return ret;
+	}
+
+	uint64_t readWord(uint64_t pos) {
+		uint64_t word = 0;
+		fseek(_fp, pos, SEEK_SET);
+		if (fread(&word, sizeof(uint64_t), 1, _fp) != 1) {
+			return 0;
 		}
+		return word;
 	}
 
 	bool readHeader() {
@@ -0,0 +1,216 @@
+#include <featcol.hpp>
+#include <l2merge.hpp>
+#include <epoll_util.h>
+
+#include <string>
+#include <iostream>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <map>
+#include <unordered_map>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+typedef BookQ<ShmCircularBuffer> BookQType;
+
+volatile bool user_stopped = false;
+L2MergeReplay* replay = NULL;
+
+void sig_handler(int signo)
+{
+  if (signo == SIGINT || signo == SIGTERM) {
+    printf("Received signal, exiting...\n");
+  }
+  user_stopped = true;
+  if (replay) {
+	  replay->stop();
+  }
+}
+
+// The books of the SubL2 symbols are from their L2 queue or file,
+// the others from L1, the same in live and in replay.
+std::vector<BookConfig> getBookConfigs(int argc, char** argv, int arg) {
+	std::vector<BookConfig> bcfg;
+	if (argc > arg) {
+		for (; arg < argc; ++arg) {
+			const std::string spec(argv[arg]);
+			auto pos = spec.find(":");
+			if (pos == std::string::npos) {
+				throw std::runtime_error(std::string("symbol:type expected, got ") + spec);
+			}
+			const std::string bt = spec.substr(pos+1);
+			bcfg.push_back(BookConfig(spec.substr(0,pos), bt=="L1n"?"L1":bt, bt=="L1n"));
+		}
+		return bcfg;
+	}
+	const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+	for (const auto& sym : symL2) {
+		bcfg.push_back(BookConfig(sym, "L2"));
+	}
+	for (const auto& sym : plcc_getStringArr("SubL1")) {
+		if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+			bcfg.push_back(BookConfig(sym, "L1"));
+		}
+	}
+	for (const auto& sym : plcc_getStringArr("SubL1n")) {
+		if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+			bcfg.push_back(BookConfig(sym, "L1", true));
+		}
+	}
+	return bcfg;
+}
+
+// dispatches the merged books of the replay by the queue name
+class ReplayHandler {
+public:
+	void add(const BookConfig& bcfg, Collector* col) {
+		_col[bcfg.qname()] = col;
+	}
+
+	void onBook(const BookConfig& bcfg, const BookDepot& book) {
+		auto iter = _col.find(bcfg.qname());
+		if (__builtin_expect(iter != _col.end(), 1)) {
+			iter->second->onBook(book);
+		}
+	}
+
+private:
+	std::unordered_map<std::string, Collector*> _col;
+};
+
+// reads the book queues as tickrec, with the bars closed by a
+// timerfd FeatLateMicro after the boundaries, one timer for the
+// collectors of the same FeatBarSec and FeatLateMicro
+long long runLive(const std::vector<BookConfig>& bcfg, std::vector<Collector*>& cols) {
+	std::vector<BookQType*> qs;
+	std::vector<BookQType::Reader*> readers;
+	for (const auto& cfg : bcfg) {
+		qs.push_back(new BookQType(cfg, true));
+		readers.push_back(qs.back()->newReader());
+		BookDepot book;
+		readers.back()->getLatestUpdateAndAdvance(book);
+	}
+	bool found = false;
+	int poll_milli = plcc_getInt("QueuePollMilli", &found);
+	if (!found) {
+		poll_milli = 1;
+	}
+	std::map<std::pair<int, int64_t>, size_t> group_of;
+	std::vector<std::vector<Collector*> > groups;
+	std::vector<TimerFd*> timers;
+	const int64_t cur_micro = (int64_t)TimeUtil::cur_time_micro();
+	for (auto col : cols) {
+		const std::pair<int, int64_t> key(col->getBarSec(), col->getLateMicro());
+		auto iter = group_of.find(key);
+		if (iter == group_of.end()) {
+			const int64_t bar_micro = key.first*1000000LL;
+			timers.push_back(new TimerFd());
+			timers.back()->setAbsMicro((cur_micro/bar_micro + 1)*bar_micro + key.second, bar_micro);
+			iter = group_of.insert(std::make_pair(key, groups.size())).first;
+			groups.push_back(std::vector<Collector*>());
+		}
+		groups[iter->second].push_back(col);
+	}
+	Epoll ep((int)timers.size());
+	for (size_t g = 0; g < timers.size(); ++g) {
+		ep.add(timers[g]->fd(), EPOLLIN, g);
+	}
+
+	long long cnt = 0;
+	BookDepot book;
+	while (!user_stopped) {
+		bool has_update = false;
+		for (size_t i = 0; i < readers.size(); ++i) {
+			if (readers[i]->getNextUpdate(book)) {
+				cols[i]->onBook(book);
+				has_update = true;
+				++cnt;
+			}
+		}
+		const int n = ep.wait(has_update? 0 : poll_milli);
+		if (n > 0) {
+			const int64_t now = (int64_t)TimeUtil::cur_time_micro();
+			for (int e = 0; e < n; ++e) {
+				const size_t g = (size_t)ep.getData(e);
+				timers[g]->read();
+				for (auto col : groups[g]) {
+					col->onTime(now);
+					col->flush();
+				}
+			}
+		}
+	}
+	for (auto t : timers) {
+		delete t;
+	}
+	for (size_t i = 0; i < qs.size(); ++i) {
+		delete readers[i];
+		delete qs[i];
+	}
+	return cnt;
+}
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-r start_utc_second end_utc_second] [symbol:[L2|L1|L1n] ...]\n", argv[0]);
+        printf("    collects the features of FeatList per FeatBarSec bar into FeatPath/<L2stem>_F<sec>S.feat\n");
+        printf("    from the book queues, or with -r from the recorded L2 delta files with the same values.\n");
+        printf("    SubL2 symbols from their L2 books, SubL1 and SubL1n from L1, if no symbol given.\n");
+        return 0;
+    }
+    int arg = 1;
+    bool is_replay = false;
+    int64_t start_utc = 0, end_utc = 0x7fffffff;
+    if (argc > arg+2 && strcmp(argv[arg], "-r") == 0) {
+    	is_replay = true;
+    	start_utc = (int64_t)atoi(argv[arg+1]);
+    	end_utc = (int64_t)atoi(argv[arg+2]);
+    	arg += 3;
+    }
+
+    if ((signal(SIGINT, sig_handler) == SIG_ERR) ||
+    	(signal(SIGTERM, sig_handler) == SIG_ERR))
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("featrec");
+    const std::vector<BookConfig> bcfg(getBookConfigs(argc, argv, arg));
+    if (bcfg.size() == 0) {
+    	throw std::runtime_error("No symbol in config");
+    }
+    std::vector<Collector*> cols;
+    for (const auto& cfg : bcfg) {
+    	cols.push_back(new Collector(cfg.L2stem().c_str()));
+    }
+
+    long long cnt = 0;
+    if (is_replay) {
+    	replay = new L2MergeReplay(start_utc*1000000ULL, end_utc*1000000ULL);
+    	ReplayHandler handler;
+    	for (size_t i = 0; i < bcfg.size(); ++i) {
+    		replay->addFile(bcfg[i]);
+    		handler.add(bcfg[i], cols[i]);
+    	}
+    	cnt = replay->run(handler);
+    	delete replay;
+    	replay = NULL;
+    	if (!user_stopped) {
+    		// the bars of the last books, not closed by a later book
+    		for (auto col : cols) {
+    			col->closePending();
+    		}
+    	}
+    } else {
+    	cnt = runLive(bcfg, cols);
+    }
+    for (auto col : cols) {
+    	printf("%s: %lld bars, %lld late books\n", col->fname().c_str(), col->getBars(), col->getLate());
+    	delete col;
+    }
+    printf("%lld books. Done.\n", cnt);
+    return 0;
+}
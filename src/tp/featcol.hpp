@@ -10,28 +10,596 @@ The collector is notified on continuous book updates (each represented by a Book
 such as quote/trades.
 
 Specific indicator/feature subclass the base api to subscribe to book updates.
+
+Each feature keeps an O(1) state per update and gives its value at the bar
+close.  All of the times are the book's update_ts_micro, the bars are closed
+by the first book at or after the bar boundary, or by onTime() in live after
+FeatLateMicro, the last bar of a replay by closePending().  So a live collector and a replay of the recorded books give
+the same values, as long as the live books are not later than FeatLateMicro.
+
+The collector writes a feature vector per bar to a binary feature file,
+FeatPath/<name>_F<barsec>S.feat, see FeatFileHeader and python/featbin.py.
+
+Configurations, from the main config or the given cfg_file:
+    FeatBarSec   = 60                           (default BarSec)
+    FeatList     = [mid,ewma:30,rvol:60,tfi:5,ism_twap]
+    FeatLateMicro= 100000
+    FeatPath     = /path/to/feat                 (default BarPath/feat)
  */
 
 #include "bookL2.hpp"
+#include <cmath>
+#include <limits>
+#include <unistd.h>
+#include <sys/stat.h>
 #pragma once
 
 class FeatCol {
 public:
-	FeatCol(const char* name, const char* cfg_file);
-	virtual ~FeatCol();
+	enum {
+		SubQuote = 1,
+		SubTrade = 2
+	};
+
+	FeatCol(const std::string& name, int subscription) :
+		_name(name), _sub(subscription) {};
+	virtual ~FeatCol() {};
+
+	virtual void onQuote(const tp::BookDepot& book, bool isBid, int level) {};
+	virtual void onTrade(const tp::BookDepot& book, bool isBuy, int size) {};
+
+	// value of the bar closed at bar_micro, NaN if not available
+	virtual double onBar(int64_t bar_micro) = 0;
+
+	const std::string& getName() const {
+		return _name;
+	}
+
+	int getSubscription() const {
+		return _sub;
+	}
+
+	static double nan() {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	static bool getMid(const tp::BookDepot& book, double& mid) {
+		const tp::Price bp = book.getBid();
+		const tp::Price ap = book.getAsk();
+		if (bp*ap == 0) {
+			return false;
+		}
+		mid = (bp + ap)/2.0;
+		return true;
+	}
+
+private:
+	const std::string _name;
+	const int _sub;
+};
+
+// Fixed size window of the last n values
+template<typename T>
+class RingWindow {
+public:
+	explicit RingWindow(int n) : _buf(n>0?n:1), _pos(0), _cnt(0) {};
+
+	// returns the value evicted, if the window is full
+	bool push(const T& v, T* evicted) {
+		const bool full = (_cnt == (int)_buf.size());
+		if (full) {
+			*evicted = _buf[_pos];
+		} else {
+			++_cnt;
+		}
+		_buf[_pos] = v;
+		if (++_pos == (int)_buf.size()) {
+			_pos = 0;
+		}
+		return full;
+	}
+
+	int size() const {
+		return _cnt;
+	}
 
-	virtual void onQuote(const tp::BookDepot& book, bool isBid, int level);
-	virtual void onTrade(const tp::BookDepot& book, bool isBuy, int size);
+	int capacity() const {
+		return (int)_buf.size();
+	}
 
+	// the i-th value in the window, not in the order pushed
+	const T& at(int i) const {
+		return _buf[i];
+	}
+
+private:
+	std::vector<T> _buf;
+	int _pos;
+	int _cnt;
 };
 
+// mid at the bar close
+class FeatMid : public FeatCol {
+public:
+	FeatMid() : FeatCol("mid", SubQuote), _mid(nan()) {};
+
+	void onQuote(const tp::BookDepot& book, bool isBid, int level) {
+		getMid(book, _mid);
+	}
+
+	double onBar(int64_t bar_micro) {
+		return _mid;
+	}
+
+private:
+	double _mid;
+};
+
+// time weighted EWMA of the mid with the half life in seconds,
+// the mid being constant between the quotes
+class FeatEwmaMid : public FeatCol {
+public:
+	explicit FeatEwmaMid(double half_life_sec) :
+		FeatCol("ewma:" + std::to_string((int)half_life_sec), SubQuote),
+		_tau_micro(half_life_sec*1e6/std::log(2.0)),
+		_mid(nan()), _ewma(nan()), _last_micro(0) {};
+
+	void onQuote(const tp::BookDepot& book, bool isBid, int level) {
+		double mid;
+		if (!getMid(book, mid)) {
+			return;
+		}
+		advance(book.update_ts_micro);
+		if (std::isnan(_ewma)) {
+			_ewma = mid;
+		}
+		_mid = mid;
+	}
+
+	double onBar(int64_t bar_micro) {
+		advance(bar_micro);
+		return _ewma;
+	}
+
+private:
+	const double _tau_micro;
+	double _mid;
+	double _ewma;
+	int64_t _last_micro;
+
+	void advance(int64_t cur_micro) {
+		if (!std::isnan(_mid) && cur_micro > _last_micro) {
+			const double a = std::exp(-(double)(cur_micro - _last_micro)/_tau_micro);
+			_ewma = _ewma*a + _mid*(1.0 - a);
+		}
+		if (cur_micro > _last_micro) {
+			_last_micro = cur_micro;
+		}
+	}
+};
+
+// standard deviation of the bar to bar log returns of the mid over
+// the last n bars.  The running sums are recomputed from the window
+// every n bars, not to drift by the rounding of the evictions
+class FeatRollingVol : public FeatCol {
+public:
+	explicit FeatRollingVol(int n) :
+		FeatCol("rvol:" + std::to_string(n), SubQuote),
+		_win(n), _mid(nan()), _prev_mid(nan()), _sum(0), _sumsq(0), _pushed(0) {};
+
+	void onQuote(const tp::BookDepot& book, bool isBid, int level) {
+		getMid(book, _mid);
+	}
+
+	double onBar(int64_t bar_micro) {
+		if (std::isnan(_mid)) {
+			return nan();
+		}
+		if (!std::isnan(_prev_mid)) {
+			const double r = std::log(_mid/_prev_mid);
+			double r0;
+			if (_win.push(r, &r0)) {
+				_sum -= r0;
+				_sumsq -= r0*r0;
+			}
+			_sum += r;
+			_sumsq += r*r;
+			if (++_pushed == _win.capacity()) {
+				resum();
+			}
+		}
+		_prev_mid = _mid;
+		const int n = _win.size();
+		if (n < _win.capacity()) {
+			return nan();
+		}
+		const double mean = _sum/n;
+		const double var = _sumsq/n - mean*mean;
+		return var > 0? std::sqrt(var) : 0;
+	}
+
+private:
+	RingWindow<double> _win;
+	double _mid;
+	double _prev_mid;
+	double _sum;
+	double _sumsq;
+	int _pushed;
+
+	void resum() {
+		_sum = 0;
+		_sumsq = 0;
+		for (int i = 0; i < _win.size(); ++i) {
+			const double r = _win.at(i);
+			_sum += r;
+			_sumsq += r*r;
+		}
+		_pushed = 0;
+	}
+};
+
+// trade flow imbalance (buy-sell)/(buy+sell) of the last n bars
+class FeatTradeImbalance : public FeatCol {
+public:
+	explicit FeatTradeImbalance(int n) :
+		FeatCol("tfi:" + std::to_string(n), SubTrade),
+		_win(n), _bv(0), _sv(0), _bv_sum(0), _sv_sum(0) {};
+
+	void onTrade(const tp::BookDepot& book, bool isBuy, int size) {
+		if (isBuy) {
+			_bv += size;
+		} else {
+			_sv += size;
+		}
+	}
+
+	double onBar(int64_t bar_micro) {
+		std::pair<long long, long long> v0;
+		if (_win.push(std::make_pair(_bv, _sv), &v0)) {
+			_bv_sum -= v0.first;
+			_sv_sum -= v0.second;
+		}
+		_bv_sum += _bv;
+		_sv_sum += _sv;
+		_bv = 0;
+		_sv = 0;
+		const long long tot = _bv_sum + _sv_sum;
+		return tot? (double)(_bv_sum - _sv_sum)/(double)tot : 0;
+	}
+
+private:
+	RingWindow<std::pair<long long, long long> > _win;
+	long long _bv, _sv;
+	long long _bv_sum, _sv_sum;
+};
+
+// time weighted ISM within the bar, as the ismTwap of BarLineWriter
+class FeatIsmTwap : public FeatCol {
+public:
+	FeatIsmTwap() : FeatCol("ism_twap", SubQuote),
+		_ism(nan()), _ism_cum(0), _ism_micro(0), _last_micro(0) {};
+
+	void onQuote(const tp::BookDepot& book, bool isBid, int level) {
+		advance(book.update_ts_micro);
+		tp::Quantity bsz = 0, asz = 0;
+		const tp::Price bp = book.getBid(&bsz);
+		const tp::Price ap = book.getAsk(&asz);
+		if (bp*ap*bsz*asz != 0) {
+			_ism = (bp*asz + ap*bsz)/(bsz + asz);
+		}
+	}
+
+	double onBar(int64_t bar_micro) {
+		advance(bar_micro);
+		const double v = _ism_micro > 0? _ism_cum/_ism_micro : _ism;
+		_ism_cum = 0;
+		_ism_micro = 0;
+		return v;
+	}
+
+private:
+	double _ism;
+	double _ism_cum;
+	int64_t _ism_micro;
+	int64_t _last_micro;
+
+	void advance(int64_t cur_micro) {
+		if (!std::isnan(_ism) && cur_micro > _last_micro) {
+			_ism_cum += _ism*(double)(cur_micro - _last_micro);
+			_ism_micro += cur_micro - _last_micro;
+		}
+		if (cur_micro > _last_micro) {
+			_last_micro = cur_micro;
+		}
+	}
+};
+
+/*
+ * Binary feature file, a FeatFileHeader and ncol column names of
+ * FeatNameLen, followed by records of int64 bar_sec and ncol doubles.
+ */
+struct FeatFileHeader {
+	static const uint32_t Version = 1;
+	static const int FeatNameLen = 32;
+	char magic[8];        // "KRFEAT"
+	uint32_t version;
+	uint32_t ncol;
+	int32_t barsec;
+	int32_t reserved;
+	char name[40];        // name of the collector
+
+	FeatFileHeader() {
+		memset(this, 0, sizeof(FeatFileHeader));
+	}
+};
+
+class FeatWriter {
+public:
+	FeatWriter(const std::string& fname, const std::string& name, int barsec,
+			   const std::vector<std::string>& cols) :
+		_fname(fname), _fp(NULL), _ncol((int)cols.size()), _rec(1+cols.size()) {
+		FeatFileHeader hdr;
+		strncpy(hdr.magic, "KRFEAT", sizeof(hdr.magic));
+		hdr.version = FeatFileHeader::Version;
+		hdr.ncol = (uint32_t)cols.size();
+		hdr.barsec = barsec;
+		strncpy(hdr.name, name.c_str(), sizeof(hdr.name)-1);
+		std::vector<char> names(cols.size()*FeatFileHeader::FeatNameLen, 0);
+		for (size_t i = 0; i < cols.size(); ++i) {
+			strncpy(&names[i*FeatFileHeader::FeatNameLen], cols[i].c_str(), FeatFileHeader::FeatNameLen-1);
+		}
+		const long hdr_len = (long)(sizeof(FeatFileHeader) + names.size());
+		const long rec_len = (long)(_rec.size()*sizeof(double));
+
+		_fp = fopen(_fname.c_str(), "r+b");
+		if (_fp) {
+			// check and truncate a partial record at the end
+			std::vector<char> buf(hdr_len);
+			if ((fread(&buf[0], 1, hdr_len, _fp) != (size_t)hdr_len) ||
+				(memcmp(&buf[0], &hdr, sizeof(FeatFileHeader)) != 0) ||
+				(memcmp(&buf[sizeof(FeatFileHeader)], &names[0], names.size()) != 0)) {
+				fclose(_fp);
+				_fp = NULL;
+				logError("feature file %s has different header", _fname.c_str());
+				throw std::runtime_error(std::string("feature file has different header ") + _fname);
+			}
+			fseek(_fp, 0, SEEK_END);
+			const long sz = ftell(_fp);
+			const long good = hdr_len + (sz - hdr_len)/rec_len*rec_len;
+			if (good != sz) {
+				logError("feature file %s truncated from %ld to %ld", _fname.c_str(), sz, good);
+				if (ftruncate(fileno(_fp), good) != 0) {
+					logError("feature file %s truncate failed", _fname.c_str());
+				}
+			}
+			fseek(_fp, good, SEEK_SET);
+		} else {
+			_fp = fopen(_fname.c_str(), "w+b");
+			if (!_fp) {
+				logError("cannot open feature file %s", _fname.c_str());
+				throw std::runtime_error(std::string("cannot open feature file ") + _fname);
+			}
+			fwrite(&hdr, sizeof(FeatFileHeader), 1, _fp);
+			fwrite(&names[0], 1, names.size(), _fp);
+		}
+	}
+
+	~FeatWriter() {
+		if (_fp) {
+			fclose(_fp);
+		}
+	}
+
+	// values of the ncol features
+	void write(int64_t bar_sec, const double* values) {
+		memcpy(&_rec[0], &bar_sec, sizeof(int64_t));
+		memcpy(&_rec[1], values, _ncol*sizeof(double));
+		fwrite(&_rec[0], sizeof(double), _rec.size(), _fp);
+	}
+
+	void flush() {
+		fflush(_fp);
+	}
+
+private:
+	const std::string _fname;
+	FILE* _fp;
+	const int _ncol;
+	std::vector<double> _rec;
+};
 
 class Collector {
 public:
-	Collector(const char* name, const char* cfg_file);
-	void addFeatCol(FeatCol* feat);
+	// features of FeatList in cfg_file, or the main config if NULL,
+	// more could be added by addFeatCol() before the first book
+	Collector(const char* name, const char* cfg_file = NULL) :
+		_name(name),
+		_cfg_file(cfg_file? new utils::ConfigureReader(cfg_file) : NULL),
+		_cfg(_cfg_file? *_cfg_file : utils::PLCC::instance()),
+		_barsec(_cfg.getInt("FeatBarSec", NULL, _cfg.getInt("BarSec", NULL, 1))),
+		_bar_micro(_barsec*1000000LL),
+		_late_micro(_cfg.getInt("FeatLateMicro", NULL, 100000)),
+		_next_bar(0), _last_bar(0), _bars(0), _late(0),
+		_writer(NULL)
+	{
+		if (_barsec <= 0) {
+			throw std::runtime_error("FeatBarSec should be positive");
+		}
+		for (const auto& spec : _cfg.getStringArr("FeatList")) {
+			addFeatCol(newFeatCol(spec));
+		}
+	}
+
+	~Collector() {
+		delete _writer;
+		for (auto f : _feat_arr) {
+			delete f;
+		}
+		delete _cfg_file;
+	}
+
+	// takes the ownership
+	void addFeatCol(FeatCol* feat) {
+		if (_writer) {
+			throw std::runtime_error("feature added after the collector started");
+		}
+		_feat_arr.push_back(feat);
+		if (feat->getSubscription() & FeatCol::SubQuote) {
+			_quote_arr.push_back(feat);
+		}
+		if (feat->getSubscription() & FeatCol::SubTrade) {
+			_trade_arr.push_back(feat);
+		}
+		_values.resize(_feat_arr.size());
+	}
+
+	// i.e. "ewma:30", see the configurations
+	static FeatCol* newFeatCol(const std::string& spec) {
+		const size_t pos = spec.find(':');
+		const std::string type = spec.substr(0, pos);
+		const int param = (pos == std::string::npos)? 0 : atoi(spec.c_str()+pos+1);
+		if (type == "mid") {
+			return new FeatMid();
+		} else if (type == "ewma" && param > 0) {
+			return new FeatEwmaMid(param);
+		} else if (type == "rvol" && param > 1) {
+			return new FeatRollingVol(param);
+		} else if (type == "tfi") {
+			return new FeatTradeImbalance(param > 0? param : 1);
+		} else if (type == "ism_twap") {
+			return new FeatIsmTwap();
+		}
+		logError("unknown feature %s", spec.c_str());
+		throw std::runtime_error(std::string("unknown feature ") + spec);
+	}
+
+	void onBook(const tp::BookDepot& book) {
+		const int64_t ts = (int64_t)book.update_ts_micro;
+		if (__builtin_expect(_next_bar == 0, 0)) {
+			start(ts);
+		} else if (ts >= _next_bar) {
+			closeBars(ts);
+		}
+		const tp::BookDepot* bp = &book;
+		if (__builtin_expect(ts < _last_bar, 0)) {
+			// later than FeatLateMicro, counted into the current bar
+			_late_book = book;
+			_late_book.update_ts_micro = _last_bar;
+			bp = &_late_book;
+			++_late;
+		}
+		if (bp->update_type == 2) {
+			for (auto f : _trade_arr) {
+				f->onTrade(*bp, bp->trade_attr == 0, bp->trade_size);
+			}
+		} else {
+			for (auto f : _quote_arr) {
+				f->onQuote(*bp, bp->update_type == 0, bp->update_level);
+			}
+		}
+	}
+
+	// live only, closes the bars FeatLateMicro after the boundary
+	void onTime(int64_t cur_micro) {
+		if (_next_bar && (cur_micro - _late_micro >= _next_bar)) {
+			closeBars(cur_micro - _late_micro);
+		}
+	}
+
+	// replay only, closes the bar of the last books at the end of the
+	// input, as onTime() would in live
+	void closePending() {
+		if (_next_bar) {
+			closeBars(_next_bar);
+		}
+	}
+
+	// the boundary of the bar to be closed next, 0 before the first book
+	int64_t getNextBarMicro() const {
+		return _next_bar;
+	}
+
+	int64_t getLateMicro() const {
+		return _late_micro;
+	}
+
+	int getBarSec() const {
+		return _barsec;
+	}
+
+	long long getBars() const {
+		return _bars;
+	}
+
+	long long getLate() const {
+		return _late;
+	}
+
+	const std::vector<FeatCol*>& getFeatCols() const {
+		return _feat_arr;
+	}
+
+	void flush() {
+		if (_writer) {
+			_writer->flush();
+		}
+	}
+
+	std::string fname() const {
+		bool found = false;
+		std::string path = _cfg.getString("FeatPath", &found);
+		if (!found) {
+			path = _cfg.getString("BarPath") + "/feat";
+		}
+		return path + "/" + _name + "_F" + std::to_string(_barsec) + "S.feat";
+	}
+
 private:
+	const std::string _name;
+	utils::ConfigureReader* const _cfg_file;
+	const utils::ConfigureReader& _cfg;
+	const int _barsec;
+	const int64_t _bar_micro;
+	const int64_t _late_micro;
+	int64_t _next_bar;
+	int64_t _last_bar;
+	long long _bars;
+	long long _late;
 	std::vector<FeatCol*> _feat_arr;
+	std::vector<FeatCol*> _quote_arr;
+	std::vector<FeatCol*> _trade_arr;
+	std::vector<double> _values;
+	tp::BookDepot _late_book;
+	FeatWriter* _writer;
 
+	void start(int64_t ts) {
+		_next_bar = (ts/_bar_micro + 1)*_bar_micro;
+		_last_bar = _next_bar - _bar_micro;
+		std::vector<std::string> cols;
+		for (auto f : _feat_arr) {
+			cols.push_back(f->getName());
+		}
+		const std::string fn = fname();
+		const size_t pos = fn.rfind('/');
+		if ((pos != std::string::npos) && (pos > 0)) {
+			// FeatPath, the BarPath is supposed to exist
+			mkdir(fn.substr(0, pos).c_str(), 0755);
+		}
+		_writer = new FeatWriter(fn, _name, _barsec, cols);
+		logInfo("feature collector %s started %d features at %lld",
+				_name.c_str(), (int)_feat_arr.size(), (long long)_next_bar);
+	}
 
+	// closes all the bars at or before upto_micro
+	void closeBars(int64_t upto_micro) {
+		while (_next_bar <= upto_micro) {
+			for (size_t i = 0; i < _feat_arr.size(); ++i) {
+				_values[i] = _feat_arr[i]->onBar(_next_bar);
+			}
+			_writer->write(_next_bar/1000000LL, _values.size()? &_values[0] : NULL);
+			_last_bar = _next_bar;
+			_next_bar += _bar_micro;
+			++_bars;
+		}
+	}
 };
@@ -13,7 +13,7 @@ namespace trader {
  * Floor
  */
 
-Floor::Floor() :  _order(0), _server(0) {
+Floor::Floor() :  _order(0), _server(0), _ib_fd(-1) {
 	bool found1, found2;
 	_ipAddr = plcc_getString("IBClientIP", &found1, "127.0.0.1");
 	_port = plcc_getInt("IBClientPort", &found2, 0);
@@ -24,6 +24,7 @@ Floor::Floor() :  _order(0), _server(0) {
 		throw std::runtime_error("Floor failed to run - required config setting not found.");
 	}
 	_client_id = plcc_getInt("OrdIBClientId");
+	_ep.add(_timer.fd(), EPOLLIN, EvTimer);
 	logInfo("Floor starting FloorServer");
 	_server = new FloorServer<Floor>(*this); // this should never die, otherwise kill floor
 	if (!_server) {
@@ -52,19 +53,26 @@ bool Floor::start(int max_try, bool cancel_all_open) {
 	logInfo("Floor starting order");
 	if (_order) {
 		logInfo("deleting existing order instance");
+		unwatchIB();
 		delete _order;
 		sleep(2);
 		_order = NULL;
 	}
 	_order=new OrderType(_client_id, _ipAddr.c_str(), _port);
+	// read on the events of run()
+	_order->setDirectDispatch(true);
+	// the acks and fills of the binary clients
+	_order->setEvents(_server);
 	if (!_order->tryConnect(max_try, cancel_all_open)) {
 		logError("Floor Order connection failed!");
 		return false;
 	}
+	watchIB();
 	return true;
 }
 void Floor::stop() {
 	// calling stop will delete all open orders
+	unwatchIB();
 	delete _order;
 	_order = NULL;
 	logInfo("Floor stopped");
@@ -74,6 +82,9 @@ bool Floor::bounce(bool bounceServer, int max_try) {
 	// bounce does not delete open orders
 	if(bounceServer) {
 		logInfo("Deleting server");
+		if (_order) {
+			_order->setEvents(NULL);
+		}
 		delete _server;
 	}
 	_order->disconnect();
@@ -93,9 +104,31 @@ bool Floor::bounce(bool bounceServer, int max_try) {
 	return start(max_try, false);
 }
 
+// the socket changes with each connection of the order client
+void Floor::watchIB() {
+	unwatchIB();
+	_ib_fd = _order->fd();
+	if (_ib_fd >= 0) {
+		_ep.add(_ib_fd, EPOLLIN | EPOLLRDHUP, EvIB);
+	}
+}
+
+// a closed socket has left _ep already, and its fd may be taken
+// by a client since
+void Floor::unwatchIB() {
+	if ((_ib_fd >= 0) && _order && (_order->fd() == _ib_fd)) {
+		_ep.del(_ib_fd);
+	}
+	_ib_fd = -1;
+}
+
 void Floor::run() {
 	_should_run = true;
 	start(300, false);
+	// the connection check, also sends what IB couldn't take at once
+	bool found;
+	const int64_t timer_micro = plcc_getInt("FloorTimerMilli", &found, 1000) * 1000LL;
+	_timer.setAbsMicro(utils::TimeUtil::cur_time_micro() + timer_micro, timer_micro);
 	while(_should_run) {
 		if (__builtin_expect(!_order->isConnected(),0)) {
 			if (!start(30, false)) {
@@ -104,12 +137,19 @@ void Floor::run() {
 				continue;
 			}
 		}
-		if (__builtin_expect(!_server->poll(), 0)) {
-			bounce(true);
-		} else {
-            usleep(100);
-        }
-
+		const int n = _ep.wait(-1);
+		for (int i = 0; (i < n) && _should_run; ++i) {
+			const uint64_t data = _ep.getData(i);
+			if (data == EvIB) {
+				while (_order->processMessages() > 0) {};
+			} else if (data == EvTimer) {
+				_timer.read();
+				while (_order->processMessages() > 0) {};
+			} else if (__builtin_expect(!_server->onEvent((int)data), 0)) {
+				bounce(true);
+				break;
+			}
+		}
 	}
 	stop();
 }
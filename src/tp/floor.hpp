@@ -9,7 +9,10 @@
 #include <bookL2.hpp>
 #include <OrderIB.hpp>
 #include <trader.hpp>
+#include "floorproto.hpp"
 #include "sys_utils.h"
+#include "epoll_util.h"
+#include "time_util.h"
 #include <sstream>
 #include <iostream>
 
@@ -22,6 +25,14 @@ namespace trader {
  * and run trader's callback, checking control input to provide
  * a client interface for start/stop/reload/trade/position.
  *
+ * The loop is an epoll on the IB socket, read by the direct
+ * dispatch of the order client, the listening socket and the
+ * clients of the FloorServer and a timer (FloorTimerMilli) for
+ * the connection check, so an order update or a command is
+ * run as it comes.
+ *
+ * A client of the FloorServer sends either the text commands of
+ * help() or the binary records of floorproto.hpp.
  */
 
 class Floor;
@@ -29,20 +40,53 @@ typedef Trader<Floor> TraderType;
 typedef OrderIB<TraderType> OrderType;
 
 template<typename FLOOR>
-class FloorServer {
+class FloorServer : public OrderEvents {
 public:
 	explicit FloorServer(FLOOR& flr);
 	// a TCP Server as a client interface
     ~FloorServer();
-	bool poll();
+	// an event of the floor's epoll on the listening socket or a
+	// client, false if the server is to be bounced
+	bool onEvent(int fd);
 	int run_cmd(const char* cmd);
 	std::string help() const;
 
+	// of the orders of the binary clients, as the acks and fills
+	void onOrderStatus(const OrderInfo& oif, const std::string& status,
+			double filled, double remaining, double avg_px);
+	void onOrderFill(const OrderInfo& oif, double px, double qty, const std::string& exec_id);
+	void onOrderError(const OrderInfo& oif, int code, const std::string& msg);
+
 private:
+	// a client of the text commands, or of the records of floorproto.hpp
+	// if its first byte is FloorMagic
+	struct Conn {
+		struct sockaddr addr;
+		uint32_t id;      // the upper half of the tags of its orders
+		bool binary;
+		bool closing;     // a record failed to send, closed at the next read
+		int rx_len;       // of the partial record in rx
+		char rx[4096];
+	};
+	typedef std::map<int, Conn> FdMap;
 	int _fd;
-	std::map<int, struct sockaddr> _fdmap;
+	FdMap _fdmap;
+	std::map<uint32_t, int> _conn_fd;  // the fd of Conn::id
+	uint32_t _next_conn_id;
 	FLOOR& _flr;
 
+	bool acceptAll();
+	void readClient(typename FdMap::iterator iter);
+	void readBinary(typename FdMap::iterator iter);
+	void closeClient(typename FdMap::iterator iter);
+	void runMsg(const Conn& conn, int fd, FloorMsg& m);
+	void sendAck(int fd, uint32_t req_id, int oid, int status,
+			double filled, double remaining, double avg_px);
+	void sendReject(int fd, uint32_t req_id, int oid, int code, const char* msg);
+	template<typename Msg>
+	void sendMsg(int fd, const Msg& m);
+	int fdOf(uint64_t tag) const;
+
 	// parsing a px represented by
 	// PX([a|b][+|-][s spdcnt|price])
 	tp::Price parsePx(const std::string& sym, const char* px);
@@ -57,6 +101,10 @@ public:
 	bool bounce(bool bounceServer = false, int max_try = 30);
 	void run();
 
+	// the data of the events of _ep other than the fds of the server
+	static const uint64_t EvIB = 1ULL << 32;
+	static const uint64_t EvTimer = 2ULL << 32;
+
 	/*
 	void reload() {};  // reload the config
 
@@ -67,15 +115,21 @@ public:
 	OrderType* _order;
 	FloorServer<Floor>* _server;
 	volatile bool _should_run;
+	utils::Epoll _ep;
 
 private:
 	int _client_id;
 	std::string _ipAddr;
 	int _port;
+	utils::TimerFd _timer;
+	int _ib_fd;  // the socket of _order in _ep, -1 if none
+
+	void watchIB();
+	void unwatchIB();
 };
 
 template<typename FLOOR>
-FloorServer<FLOOR>::FloorServer(FLOOR& flr) : _fd(0), _flr(flr) {
+FloorServer<FLOOR>::FloorServer(FLOOR& flr) : _fd(0), _next_conn_id(1), _flr(flr) {
 	// create a floor server
 	int port = plcc_getInt("FloorPort");
 	const char* ip = "127.0.0.1";
@@ -88,68 +142,335 @@ FloorServer<FLOOR>::FloorServer(FLOOR& flr) : _fd(0), _flr(flr) {
 	if (listen(_fd, 5)!=0) {
 		perror("listen failed");
 	}
+	_flr._ep.add(_fd, EPOLLIN, _fd);
 	logInfo("Server listening on %s:%d", ip, port);
 }
 template<typename FLOOR>
 inline
 FloorServer<FLOOR>::~FloorServer() {
+	_flr._ep.del(_fd);
 	close(_fd);
 	for (auto iter=_fdmap.begin(); iter!=_fdmap.end(); ++iter) {
+		_flr._ep.del(iter->first);
 		close(iter->first);
 	}
 }
 // a TCP Server as a client interface
 template<typename FLOOR>
 inline
-bool FloorServer<FLOOR>::poll() {
-	while (_flr._order->processMessages()) {};
-	// check subscriptions
-
-	// check new connection
-	struct sockaddr addr;
-	socklen_t addrlen;
-	int new_fd = accept(_fd, &addr, &addrlen);
-	if (__builtin_expect(new_fd < 0, 1)) {
-		if (__builtin_expect(errno != EWOULDBLOCK,0)) {
-			return false;
+bool FloorServer<FLOOR>::onEvent(int fd) {
+	if (fd == _fd) {
+		return acceptAll();
+	}
+	auto iter = _fdmap.find(fd);
+	if (__builtin_expect(iter == _fdmap.end(), 0)) {
+		// closed by an earlier event of the same wait
+		return true;
+	}
+	readClient(iter);
+	return true;
+}
+
+template<typename FLOOR>
+bool FloorServer<FLOOR>::acceptAll() {
+	while (true) {
+		struct sockaddr addr;
+		socklen_t addrlen = sizeof(addr);
+		int new_fd = accept(_fd, &addr, &addrlen);
+		if (new_fd < 0) {
+			return (errno == EWOULDBLOCK);
 		}
-	} else {
 		// got a new connection,
 		// set nonblocking/nodelay
 		logInfo("Got a new connection: fd(%d) %s",
 				new_fd, utils::print_sockaddr(addr).c_str());
 		utils::set_socket_non_blocking(new_fd);
 		utils::set_socket_nodelay(new_fd);
-		_fdmap[new_fd] = addr;
+		Conn& conn(_fdmap[new_fd]);
+		conn.addr = addr;
+		conn.id = _next_conn_id++;
+		conn.binary = false;
+		conn.closing = false;
+		conn.rx_len = 0;
+		_conn_fd[conn.id] = new_fd;
+		_flr._ep.add(new_fd, EPOLLIN | EPOLLRDHUP, new_fd);
 	}
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::closeClient(typename FdMap::iterator iter) {
+	const int fd = iter->first;
+	_flr._ep.del(fd);
+	close(fd);
+	_conn_fd.erase(iter->second.id);
+	_fdmap.erase(iter);
+}
 
-	// check all current connections
+template<typename FLOOR>
+void FloorServer<FLOOR>::readClient(typename FdMap::iterator iter) {
+	const int fd = iter->first;
+	Conn& conn(iter->second);
+	if (!conn.binary) {
+		unsigned char c;
+		if ((recv(fd, &c, 1, MSG_PEEK) == 1) && (c == FloorMagic)) {
+			logInfo("fd(%d) binary order entry", fd);
+			conn.binary = true;
+		}
+	}
+	if (conn.binary) {
+		readBinary(iter);
+		return;
+	}
 	char buf[2048];
-	for (auto iter=_fdmap.begin(); iter!=_fdmap.end();++iter) {
-		int fd = iter->first;
-		ssize_t blen=read(fd, buf, sizeof(buf)-1);
-		if (__builtin_expect(blen > 0, 0)) {
-			ssize_t n;
-			// blocking read all
-			while ((n=read(fd, buf+blen, sizeof(buf)-blen-1))>0) {
-				blen+=n;
+	ssize_t blen=read(fd, buf, sizeof(buf)-1);
+	if (__builtin_expect(blen > 0, 1)) {
+		ssize_t n;
+		// blocking read all
+		while ((n=read(fd, buf+blen, sizeof(buf)-blen-1))>0) {
+			blen+=n;
+		}
+		buf[blen]=0;
+		int ret = run_cmd(buf);
+		std::string rstr=std::to_string(ret);
+		write(fd, rstr.c_str(), rstr.length()+1);
+		logInfo("fd(%d) Got command: %s, return (%d)", fd, buf, ret);
+		return;
+	}
+	if ((blen < 0) && (errno == EAGAIN)) {
+		return;
+	}
+	// closed by the client, or an error
+	logInfo("fd(%d) %s disconnected! errno(%d), erased fd", fd,
+			utils::print_sockaddr(conn.addr).c_str(), blen<0? errno : 0);
+	closeClient(iter);
+}
+
+// all the complete records, until EAGAIN
+template<typename FLOOR>
+void FloorServer<FLOOR>::readBinary(typename FdMap::iterator iter) {
+	const int fd = iter->first;
+	Conn& conn(iter->second);
+	while (true) {
+		const ssize_t n = read(fd, conn.rx + conn.rx_len, sizeof(conn.rx) - conn.rx_len);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EAGAIN)) {
+				return;
 			}
-			buf[blen]=0;
-			int ret = run_cmd(buf);
-			std::string rstr=std::to_string(ret);
-			write(fd, rstr.c_str(), rstr.length()+1);
-			logInfo("fd(%d) Got command: %s, return (%d)", fd, buf, ret);
-		} else {
-			if (__builtin_expect( ((blen<0) && (errno != EAGAIN)),0)) {
-				// disconnected?
-				logInfo("fd(%d) %s disconnected! errno(%d), erased fd", fd,
-						utils::print_sockaddr(iter->second), errno);
-				_fdmap.erase(iter);
+			logInfo("fd(%d) %s disconnected! errno(%d), erased fd", fd,
+					utils::print_sockaddr(conn.addr).c_str(), n<0? errno : 0);
+			closeClient(iter);
+			return;
+		}
+		conn.rx_len += n;
+		int off = 0;
+		FloorMsg m;
+		while (conn.rx_len - off >= (int)sizeof(FloorHdr)) {
+			memcpy(&m.hdr, conn.rx + off, sizeof(FloorHdr));
+			const int len = floorMsgLen(m.hdr.type);
+			if (__builtin_expect((m.hdr.magic != FloorMagic) || (len == 0) || (m.hdr.len != len), 0)) {
+				// out of sync
+				logError("fd(%d) bad record type(%d) len(%d), closing", fd, (int)m.hdr.type, (int)m.hdr.len);
+				sendReject(fd, m.hdr.req_id, 0, FR_BadMsg, "bad record");
+				closeClient(iter);
+				return;
+			}
+			if (conn.rx_len - off < len) {
 				break;
 			}
+			memcpy(&m, conn.rx + off, len);
+			off += len;
+			runMsg(conn, fd, m);
+			if (__builtin_expect(conn.closing, 0)) {
+				closeClient(iter);
+				return;
+			}
 		}
+		conn.rx_len -= off;
+		memmove(conn.rx, conn.rx + off, conn.rx_len);
 	}
-	return true;
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::runMsg(const Conn& conn, int fd, FloorMsg& m) {
+	const uint32_t req_id = m.hdr.req_id;
+	const uint64_t tag = ((uint64_t)conn.id << 32) | req_id;
+	OrderType* _order = _flr._order;
+	if (__builtin_expect(!_order || !_order->isConnected(), 0)) {
+		sendReject(fd, req_id, 0, FR_NotConnected, "not connected to IB");
+		return;
+	}
+	switch (m.hdr.type) {
+	case FM_New:
+	{
+		FloorNew& o(m.neworder);
+		o.sym[sizeof(o.sym)-1] = 0;
+		if (o.qty <= 0) {
+			sendReject(fd, req_id, 0, FR_BadQty, "bad qty");
+			return;
+		}
+		if (!o.is_mkt && !(o.px > 0)) {
+			sendReject(fd, req_id, 0, FR_BadPrice, "bad price");
+			return;
+		}
+		int oid = 0;
+		try {
+			oid = _order->placeOrder(NULL, o.sym, o.qty, o.px,
+					o.is_buy != 0, o.is_ioc != 0, !o.is_mkt, 0, tag);
+		} catch (const std::exception& e) {
+			logError("fd(%d) req_id(%u) %s not placed: %s", fd, (unsigned)req_id, o.sym, e.what());
+			sendReject(fd, req_id, 0, FR_Failed, e.what());
+			return;
+		}
+		sendAck(fd, req_id, oid, FS_Sent, 0, o.qty, 0);
+		return;
+	}
+	case FM_Replace:
+	{
+		const FloorReplace& r(m.replace);
+		const OrderInfo* oif = _order->getOrdInfo(r.oid);
+		if (__builtin_expect(!oif || !oif->isOpen, 0)) {
+			sendReject(fd, req_id, r.oid, FR_NoOrder, "order not found or not open");
+			return;
+		}
+		if (r.qty <= 0) {
+			sendReject(fd, req_id, r.oid, FR_BadQty, "bad qty");
+			return;
+		}
+		if (!(r.px > 0)) {
+			sendReject(fd, req_id, r.oid, FR_BadPrice, "bad price");
+			return;
+		}
+		int oid = 0;
+		try {
+			oid = _order->Replace(r.oid, r.qty, r.px, tag);
+		} catch (const std::exception& e) {
+			logError("fd(%d) req_id(%u) oid(%d) not replaced: %s", fd, (unsigned)req_id, (int)r.oid, e.what());
+			sendReject(fd, req_id, r.oid, FR_Failed, e.what());
+			return;
+		}
+		if (__builtin_expect(oid == 0, 0)) {
+			sendReject(fd, req_id, r.oid, FR_NoOrder, "order not found or not open");
+			return;
+		}
+		sendAck(fd, req_id, oid, FS_Sent, 0, r.qty, 0);
+		return;
+	}
+	case FM_Cancel:
+	{
+		const FloorCancel& c(m.cancel);
+		const OrderInfo* oif = _order->getOrdInfo(c.oid);
+		if (__builtin_expect(!oif || !oif->isOpen, 0)) {
+			sendReject(fd, req_id, c.oid, FR_NoOrder, "order not found or not open");
+			return;
+		}
+		_order->cancelOrder(c.oid);
+		sendAck(fd, req_id, c.oid, FS_PendingCancel, 0, 0, 0);
+		return;
+	}
+	default:
+		sendReject(fd, req_id, 0, FR_BadMsg, "not a request");
+		return;
+	}
+}
+
+static inline
+FloorOrdStatus floorStatus(const std::string& status) {
+	if ((status == "Submitted") || (status == "PreSubmitted") || (status == "PendingSubmit")) {
+		return FS_Submitted;
+	}
+	if (status == "Filled") {
+		return FS_Filled;
+	}
+	if ((status == "Cancelled") || (status == "ApiCancelled")) {
+		return FS_Cancelled;
+	}
+	if (status == "PendingCancel") {
+		return FS_PendingCancel;
+	}
+	if (status == "Inactive") {
+		return FS_Inactive;
+	}
+	return FS_Unknown;
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::onOrderStatus(const OrderInfo& oif, const std::string& status,
+		double filled, double remaining, double avg_px) {
+	const int fd = fdOf(oif.tag);
+	if (fd >= 0) {
+		sendAck(fd, (uint32_t)oif.tag, oif.oid, floorStatus(status), filled, remaining, avg_px);
+	}
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::onOrderFill(const OrderInfo& oif, double px, double qty, const std::string& exec_id) {
+	const int fd = fdOf(oif.tag);
+	if (fd >= 0) {
+		FloorFill f;
+		floorInit(f, FM_Fill, (uint32_t)oif.tag);
+		f.oid = oif.oid;
+		f.px = px;
+		f.qty = qty;
+		floorCopy(f.exec_id, sizeof(f.exec_id), exec_id.c_str());
+		sendMsg(fd, f);
+	}
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::onOrderError(const OrderInfo& oif, int code, const std::string& msg) {
+	const int fd = fdOf(oif.tag);
+	if (fd >= 0) {
+		sendReject(fd, (uint32_t)oif.tag, oif.oid, code, msg.c_str());
+	}
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::sendAck(int fd, uint32_t req_id, int oid, int status,
+		double filled, double remaining, double avg_px) {
+	FloorAck a;
+	floorInit(a, FM_Ack, req_id);
+	a.oid = oid;
+	a.status = (uint8_t)status;
+	a.filled = filled;
+	a.remaining = remaining;
+	a.avg_px = avg_px;
+	sendMsg(fd, a);
+}
+
+template<typename FLOOR>
+void FloorServer<FLOOR>::sendReject(int fd, uint32_t req_id, int oid, int code, const char* msg) {
+	FloorReject r;
+	floorInit(r, FM_Reject, req_id);
+	r.oid = oid;
+	r.code = code;
+	floorCopy(r.msg, sizeof(r.msg), msg);
+	sendMsg(fd, r);
+}
+
+// a record in one send.  A client not reading, or a partial send,
+// loses its records from then on, so the connection is shut down and
+// closed by its next read, not to close a Conn that is being read
+template<typename FLOOR>
+template<typename Msg>
+void FloorServer<FLOOR>::sendMsg(int fd, const Msg& m) {
+	auto iter = _fdmap.find(fd);
+	if (__builtin_expect((iter == _fdmap.end()) || iter->second.closing, 0)) {
+		return;
+	}
+	const ssize_t n = send(fd, &m, sizeof(Msg), MSG_NOSIGNAL);
+	if (__builtin_expect(n != (ssize_t)sizeof(Msg), 0)) {
+		logError("fd(%d) failed to send record type(%d) req_id(%u), sent %d errno(%d), closing",
+				fd, (int)m.hdr.type, (unsigned)m.hdr.req_id, (int)n, errno);
+		iter->second.closing = true;
+		shutdown(fd, SHUT_RDWR);
+	}
+}
+
+// the fd of the client of the tag, -1 if gone
+template<typename FLOOR>
+int FloorServer<FLOOR>::fdOf(uint64_t tag) const {
+	auto iter = _conn_fd.find((uint32_t)(tag >> 32));
+	return (iter == _conn_fd.end())? -1 : iter->second;
 }
 
 template<typename FLOOR>
@@ -342,6 +663,7 @@ std::string FloorServer<FLOOR>::help() const {
 	n+=snprintf(buf+n, sizeof(buf)-n,"BounceOrderConnection: [T]\n");
 	n+=snprintf(buf+n, sizeof(buf)-n,"Exit: [X]\n");
 	n+=snprintf(buf+n, sizeof(buf)-n,"Help: H\n");
+	n+=snprintf(buf+n, sizeof(buf)-n,"Binary order entry: see floorproto.hpp\n");
 	return std::string(buf);
 }
 }
@@ -0,0 +1,172 @@
+/*
+ * floorproto.hpp
+ *
+ * The binary order entry of the FloorServer, alongside its text
+ * commands on the same port.  A connection whose first byte is
+ * FloorMagic sends and gets fixed layout records, each led by a
+ * FloorHdr, in the byte order of the host as the floor listens on
+ * 127.0.0.1 only.
+ *
+ *     client to floor:  FloorNew, FloorReplace, FloorCancel
+ *     floor to client:  FloorAck, FloorFill, FloorReject
+ *
+ * The req_id is the client's, given back in the replies to the
+ * request and in the later acks and fills of the order it placed.
+ * A request is acked with the order id of the floor right away,
+ * FS_Sent, then again on each status from IB.  See FloorClient of
+ * floorclient.hpp for the client side.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace trader {
+
+static const uint8_t FloorMagic = 0xFB;  // not a text command
+
+enum FloorMsgType {
+	FM_New = 1,
+	FM_Replace = 2,
+	FM_Cancel = 3,
+	FM_Ack = 11,
+	FM_Fill = 12,
+	FM_Reject = 13
+};
+
+// the status of an order in FloorAck
+enum FloorOrdStatus {
+	FS_Sent = 0,          // sent to IB by the floor
+	FS_Submitted = 1,     // PendingSubmit, PreSubmitted and Submitted of IB
+	FS_PendingCancel = 2,
+	FS_Cancelled = 3,     // Cancelled and ApiCancelled
+	FS_Filled = 4,
+	FS_Inactive = 5,
+	FS_Unknown = 6
+};
+
+// FloorReject::code, an IB error code if positive
+enum FloorRejectCode {
+	FR_BadMsg = -1,       // the connection is closed after it
+	FR_BadPrice = -2,
+	FR_NoOrder = -3,      // not found or not open to replace or cancel
+	FR_NotConnected = -4, // to IB
+	FR_BadQty = -5,
+	FR_Failed = -6        // not placed by the floor, i.e. an unknown symbol
+};
+
+#pragma pack(push, 1)
+
+struct FloorHdr {
+	uint8_t magic;
+	uint8_t type;         // FloorMsgType
+	uint16_t len;         // of the whole record
+	uint32_t req_id;
+};
+
+struct FloorNew {
+	FloorHdr hdr;
+	char sym[32];         // i.e. NYM/CLZ9, 0 terminated
+	int32_t qty;
+	uint8_t is_buy;
+	uint8_t is_ioc;
+	uint8_t is_mkt;
+	uint8_t pad;
+	double px;
+};
+
+// cancels oid and places its order again at qty and px, with a new oid
+struct FloorReplace {
+	FloorHdr hdr;
+	int32_t oid;
+	int32_t qty;
+	double px;
+};
+
+struct FloorCancel {
+	FloorHdr hdr;
+	int32_t oid;
+	int32_t pad;
+};
+
+struct FloorAck {
+	FloorHdr hdr;
+	int32_t oid;
+	uint8_t status;       // FloorOrdStatus
+	uint8_t pad[3];
+	double filled;
+	double remaining;
+	double avg_px;
+};
+
+struct FloorFill {
+	FloorHdr hdr;
+	int32_t oid;
+	int32_t pad;
+	double px;
+	double qty;
+	char exec_id[32];
+};
+
+struct FloorReject {
+	FloorHdr hdr;
+	int32_t oid;          // 0 if it wasn't placed
+	int32_t code;         // FloorRejectCode or of IB
+	char msg[64];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(FloorHdr) == 8, "FloorHdr layout");
+static_assert(sizeof(FloorNew) == 56, "FloorNew layout");
+static_assert(sizeof(FloorReplace) == 24, "FloorReplace layout");
+static_assert(sizeof(FloorCancel) == 16, "FloorCancel layout");
+static_assert(sizeof(FloorAck) == 40, "FloorAck layout");
+static_assert(sizeof(FloorFill) == 64, "FloorFill layout");
+static_assert(sizeof(FloorReject) == 80, "FloorReject layout");
+
+// any record, as copied out of a receive buffer
+union FloorMsg {
+	FloorHdr hdr;
+	FloorNew neworder;
+	FloorReplace replace;
+	FloorCancel cancel;
+	FloorAck ack;
+	FloorFill fill;
+	FloorReject reject;
+};
+
+// the size of a record of type, 0 if unknown
+static inline
+int floorMsgLen(int type) {
+	switch (type) {
+	case FM_New:     return sizeof(FloorNew);
+	case FM_Replace: return sizeof(FloorReplace);
+	case FM_Cancel:  return sizeof(FloorCancel);
+	case FM_Ack:     return sizeof(FloorAck);
+	case FM_Fill:    return sizeof(FloorFill);
+	case FM_Reject:  return sizeof(FloorReject);
+	}
+	return 0;
+}
+
+// src into the char field dst of size, truncated and 0 terminated
+static inline
+void floorCopy(char* dst, size_t size, const char* src) {
+	const size_t n = strnlen(src, size - 1);
+	memcpy(dst, src, n);
+	dst[n] = 0;
+}
+
+template<typename Msg>
+static inline
+void floorInit(Msg& m, int type, uint32_t req_id) {
+	memset(&m, 0, sizeof(Msg));
+	m.hdr.magic = FloorMagic;
+	m.hdr.type = (uint8_t)type;
+	m.hdr.len = (uint16_t)sizeof(Msg);
+	m.hdr.req_id = req_id;
+}
+
+}
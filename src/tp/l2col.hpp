@@ -0,0 +1,176 @@
+/*
+ * l2col.hpp
+ *
+ * Columnar files of the L2 delta books for research, one row per
+ * delta record, split by trading day:
+ *
+ *     ColPath/yyyymmdd/venue_sym_type[_bc]/ts.u8
+ *                                          type.i1
+ *                                          ...
+ *
+ * Each column is a fixed width little endian array with the numpy type
+ * code as the file extension, so a day loads as np.memmap(fname,
+ * dtype=ext), see python/l2col.py.  The columns are the record's
+ * L2Delta (type, side, level, px, qty) and the top of the book after
+ * the record is applied (bp, bsz, ap, asz).
+ *
+ * ColPath defaults to BarPath/col, a trading day starts at
+ * TradeDayStartHour (default 18) local time of the previous day.
+ */
+
+#pragma once
+
+#include "bookL2.hpp"
+#include <sys/stat.h>
+#include <errno.h>
+
+namespace tp {
+
+class L2ColumnWriter {
+public:
+	enum {
+		ColTs = 0,
+		ColType,
+		ColSide,
+		ColLevel,
+		ColPx,
+		ColQty,
+		ColBidPx,
+		ColBidSz,
+		ColAskPx,
+		ColAskSz,
+		ColCount
+	};
+
+	static const char* colName(int col) {
+		static const char* names[ColCount] = {
+				"ts.u8", "type.i1", "side.i1", "level.i2", "px.f8", "qty.i4",
+				"bp.f8", "bsz.i4", "ap.f8", "asz.i4" };
+		return names[col];
+	}
+
+	static std::string colPath() {
+		bool found = false;
+		const std::string path = plcc_getString("ColPath", &found);
+		if (found) {
+			return path;
+		}
+		return plcc_getString("BarPath") + "/col";
+	}
+
+	// append=false truncates a day's columns when first written,
+	// to convert a day in one go
+	explicit L2ColumnWriter(const BookConfig& bcfg, bool append = true) :
+		_stem(bcfg.L2stem()),
+		_path(colPath()),
+		_start_hour(tradeDayStartHour()),
+		_append(append),
+		_day(0),
+		_day_start_micro(0),
+		_day_end_micro(0),
+		_count(0)
+	{
+		for (int i = 0; i < ColCount; ++i) {
+			_fp[i] = NULL;
+		}
+	}
+
+	~L2ColumnWriter() {
+		closeDay();
+	}
+
+	void write(const BookDepot& book) {
+		const uint64_t ts = book.update_ts_micro;
+		if (__builtin_expect((ts >= _day_end_micro) || (ts < _day_start_micro), 0)) {
+			openDay(ts);
+		}
+		const L2Delta& d(book.l2_delta);
+		Quantity bsz = 0, asz = 0;
+		const Price bp = book.getBid(&bsz);
+		const Price ap = book.getAsk(&asz);
+		fwrite(&ts, sizeof(uint64_t), 1, _fp[ColTs]);
+		fwrite(&d.type, sizeof(char), 1, _fp[ColType]);
+		fwrite(&d.side, sizeof(char), 1, _fp[ColSide]);
+		fwrite(&d.level, sizeof(short), 1, _fp[ColLevel]);
+		fwrite(&d.px, sizeof(Price), 1, _fp[ColPx]);
+		fwrite(&d.qty, sizeof(Quantity), 1, _fp[ColQty]);
+		fwrite(&bp, sizeof(Price), 1, _fp[ColBidPx]);
+		fwrite(&bsz, sizeof(Quantity), 1, _fp[ColBidSz]);
+		fwrite(&ap, sizeof(Price), 1, _fp[ColAskPx]);
+		fwrite(&asz, sizeof(Quantity), 1, _fp[ColAskSz]);
+		++_count;
+	}
+
+	// used as a replay handler
+	void onBook(const BookDepot& book) {
+		write(book);
+	}
+
+	void flush() {
+		for (int i = 0; i < ColCount; ++i) {
+			if (_fp[i]) {
+				fflush(_fp[i]);
+			}
+		}
+	}
+
+	int getDay() const {
+		return _day;
+	}
+
+	long long getCount() const {
+		return _count;
+	}
+
+private:
+	static const int BufferSize = 1024*1024;
+	const std::string _stem;
+	const std::string _path;
+	const int _start_hour;
+	const bool _append;
+	int _day;
+	uint64_t _day_start_micro;
+	uint64_t _day_end_micro;
+	long long _count;
+	FILE* _fp[ColCount];
+
+	void openDay(uint64_t ts) {
+		closeDay();
+		_day = utils::TimeUtil::utc_to_trade_day(ts/1000000ULL, _start_hour);
+		_day_start_micro = (uint64_t)utils::TimeUtil::trade_day_start_utc(_day, _start_hour)*1000000ULL;
+		_day_end_micro = (uint64_t)utils::TimeUtil::trade_day_start_utc(_day, _start_hour, 1)*1000000ULL;
+
+		const std::string dir = _path + "/" + std::to_string(_day) + "/" + _stem;
+		makeDir(_path);
+		makeDir(_path + "/" + std::to_string(_day));
+		makeDir(dir);
+		for (int i = 0; i < ColCount; ++i) {
+			const std::string fname = dir + "/" + colName(i);
+			_fp[i] = fopen(fname.c_str(), _append? "ab" : "wb");
+			if (!_fp[i]) {
+				logError("cannot open column file %s", fname.c_str());
+				throw std::runtime_error(std::string("cannot open column file ") + fname);
+			}
+			setvbuf(_fp[i], NULL, _IOFBF, BufferSize);
+		}
+		logInfo("L2 column %s day %d started", _stem.c_str(), _day);
+	}
+
+	void closeDay() {
+		for (int i = 0; i < ColCount; ++i) {
+			if (_fp[i]) {
+				fclose(_fp[i]);
+				_fp[i] = NULL;
+			}
+		}
+	}
+
+	static void makeDir(const std::string& dir) {
+		if ((mkdir(dir.c_str(), 0755) != 0) && (errno != EEXIST)) {
+			logError("cannot create directory %s", dir.c_str());
+			throw std::runtime_error(std::string("cannot create directory ") + dir);
+		}
+	}
+};
+
+}  // namespace tp
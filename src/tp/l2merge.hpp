@@ -0,0 +1,241 @@
+/*
+ * l2merge.hpp
+ *
+ * Time-merged replay of many L2 delta files (*_L2.bin, *_L1.bin, *_L1_bc.bin)
+ * into a single stream ordered by update_ts_micro.
+ *
+ * Each file is decoded by its own worker thread with an L2DeltaReader,
+ * the decoded BookDepot are put to a bounded SpscQueue per file.
+ * The caller's thread does a k-way merge on the queue heads using a
+ * binary heap and delivers (BookConfig, BookDepot) to a handler:
+ *
+ *     struct Handler {
+ *         void onBook(const tp::BookConfig& bcfg, const tp::BookDepot& book);
+ *     };
+ *
+ * Ties on update_ts_micro are resolved by the order of the files as
+ * added, so a replay of the same files is always the same sequence.
+ */
+
+#pragma once
+
+#include "bookL2.hpp"
+#include "queue.h"
+#include "thread_utils.h"
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+
+namespace tp {
+
+class L2ReplayStream {
+public:
+	static const int QItems = 1024;
+	// a full queue is of a paced reader, i.e. L2Replay, the decoder
+	// sleeps after FullYields yields not to burn a cpu
+	static const int FullYields = 100;
+	static const int FullSleepMicro = 200;
+	typedef utils::SpscQueue<QItems, BookDepot> QType;
+
+	L2ReplayStream(const BookConfig& bcfg, uint64_t start_micro, uint64_t end_micro) :
+		_bcfg(bcfg), _start_micro(start_micro), _end_micro(end_micro),
+		_q(), _done(false), _should_run(true), _count(0) {};
+
+	// worker thread, decode the file into the queue until
+	// end of file or end_micro, whichever first.  _should_run
+	// is set by the ctor, a stop() before the thread starts holds
+	void run(void*) {
+		try {
+			L2DeltaReader reader(_bcfg, false);
+			const BookDepot* book;
+			while (_should_run && (book = reader.readNext())) {
+				if (__builtin_expect(book->update_ts_micro < _start_micro, 0)) {
+					continue;
+				}
+				if (__builtin_expect(book->update_ts_micro > _end_micro, 0)) {
+					break;
+				}
+				BookDepot* ptr;
+				int yields = 0;
+				while (!(ptr = _q.getNextWritePtr())) {
+					if (!_should_run) {
+						break;
+					}
+					if (++yields < FullYields) {
+						sched_yield();
+					} else {
+						usleep(FullSleepMicro);
+					}
+				}
+				if (!ptr) {
+					break;
+				}
+				*ptr = *book;
+				_q.advanceWritePtr();
+				_count.fetch_add(1, std::memory_order_relaxed);
+			}
+		} catch (const std::exception& e) {
+			logError("L2 replay of %s failed: %s", _bcfg.L2fname().c_str(), e.what());
+		}
+		asm volatile("" ::: "memory");
+		_done = true;
+	}
+
+	void stop() {
+		_should_run = false;
+	}
+
+	// reader side, blocks until the next book is decoded.
+	// returns NULL at the end of the stream
+	const BookDepot* front() {
+		const BookDepot* book;
+		while (!(book = _q.front())) {
+			if (_done) {
+				// the last put could land after the empty check
+				return _q.front();
+			}
+			sched_yield();
+		}
+		return book;
+	}
+
+	void pop() {
+		_q.pop();
+	}
+
+	const BookConfig& getBookConfig() const {
+		return _bcfg;
+	}
+
+	long long getCount() const {
+		return _count.load(std::memory_order_relaxed);
+	}
+
+private:
+	const BookConfig _bcfg;
+	const uint64_t _start_micro;
+	const uint64_t _end_micro;
+	QType _q;
+	volatile bool _done;
+	volatile bool _should_run;
+	std::atomic<long long> _count;
+};
+
+class L2MergeReplay {
+public:
+	typedef utils::ThreadWrapper<L2ReplayStream> ThreadType;
+
+	explicit L2MergeReplay(uint64_t start_micro = 0, uint64_t end_micro = (uint64_t)-1) :
+		_start_micro(start_micro), _end_micro(end_micro), _should_run(true) {};
+
+	~L2MergeReplay() {
+		stop();
+		join();
+		for (auto t : _threads) {
+			delete t;
+		}
+		for (auto s : _streams) {
+			delete s;
+		}
+	}
+
+	// the L2fname() of the config is replayed
+	void addFile(const BookConfig& bcfg) {
+		_streams.push_back(new L2ReplayStream(bcfg, _start_micro, _end_micro));
+	}
+
+	// tickrecL2 recording set: SubL2 as L2, SubL1 and SubL1n as L1
+	// unless the symbol is already in SubL2
+	void addSubscriptions() {
+		const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+		for (const auto& sym : symL2) {
+			addFile(BookConfig(sym, "L2"));
+		}
+		const std::vector<std::string> symL1(plcc_getStringArr("SubL1"));
+		for (const auto& sym : symL1) {
+			if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+				addFile(BookConfig(sym, "L1"));
+			}
+		}
+		const std::vector<std::string> symL1n(plcc_getStringArr("SubL1n"));
+		for (const auto& sym : symL1n) {
+			if (std::find(symL2.begin(), symL2.end(), sym) == symL2.end()) {
+				addFile(BookConfig(sym, "L1", true));
+			}
+		}
+	}
+
+	// starts the decoders and merges in the caller's thread
+	// until all files are done or stop() is called.
+	// returns number of books delivered to the handler
+	template<typename Handler>
+	long long run(Handler& handler) {
+		for (auto s : _streams) {
+			ThreadType* t = new ThreadType(*s);
+			t->run(NULL);
+			_threads.push_back(t);
+		}
+
+		// min heap on (update_ts_micro, stream index)
+		std::vector<HeapEntry> heap;
+		for (size_t i = 0; i < _streams.size(); ++i) {
+			const BookDepot* book = _streams[i]->front();
+			if (book) {
+				heap.push_back(HeapEntry(book->update_ts_micro, (int)i));
+			}
+		}
+		std::make_heap(heap.begin(), heap.end());
+
+		long long cnt = 0;
+		while (_should_run && heap.size() > 0) {
+			std::pop_heap(heap.begin(), heap.end());
+			L2ReplayStream* s = _streams[heap.back().idx];
+			handler.onBook(s->getBookConfig(), *s->front());
+			++cnt;
+			s->pop();
+			const BookDepot* book = s->front();
+			if (__builtin_expect(book != NULL, 1)) {
+				heap.back().ts = book->update_ts_micro;
+				std::push_heap(heap.begin(), heap.end());
+			} else {
+				heap.pop_back();
+			}
+		}
+		stop();
+		join();
+		return cnt;
+	}
+
+	void stop() {
+		_should_run = false;
+		for (auto s : _streams) {
+			s->stop();
+		}
+	}
+
+private:
+	struct HeapEntry {
+		uint64_t ts;
+		int idx;
+		HeapEntry(uint64_t ts_, int idx_) : ts(ts_), idx(idx_) {};
+		// std heap is a max heap, reverse it
+		bool operator < (const HeapEntry& e) const {
+			return (ts > e.ts) || ((ts == e.ts) && (idx > e.idx));
+		}
+	};
+
+	const uint64_t _start_micro;
+	const uint64_t _end_micro;
+	volatile bool _should_run;
+	std::vector<L2ReplayStream*> _streams;
+	std::vector<ThreadType*> _threads;
+
+	void join() {
+		for (auto t : _threads) {
+			t->join();
+		}
+	}
+};
+
+}  // namespace tp
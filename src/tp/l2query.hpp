@@ -0,0 +1,369 @@
+/*
+ * l2query.hpp
+ *
+ * Book at a given time from the L2 delta files (see L2DeltaWriter
+ * for the file format).
+ *
+ * L2SnapIndex locates the snapshots of a delta file, {update_ts_micro, pos},
+ * from the index file written by L2DeltaWriter and scanning the records
+ * after the last entry of it.
+ * L2BookQuery maps the file, jumps to the nearest snapshot prior to the
+ * query time and applies the deltas forward.  The book at T is the book
+ * after all records with ts <= T are applied.
+ *
+ * Reconstructed books are kept in a LRU cache keyed by the query time.
+ * A query resumes from the latest cached book before it if it is not
+ * older than the nearest snapshot, so queries sorted by time, as in
+ * query(), sweep the file forward in one pass.
+ *
+ * replay() delivers every book of a time range, warmed up from the
+ * snapshot before the range start.
+ */
+
+#pragma once
+
+#include "bookL2.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <map>
+
+namespace tp {
+
+class L2SnapIndex {
+public:
+	L2SnapIndex() : _end(0), _last_ts(0) {};
+
+	// load the index file of the mapped file, before any scan.
+	// entries are taken up to the first one not agreeing with the
+	// file, the index is ignored if it doesn't start from the
+	// beginning of the file, i.e. written to a file that was
+	// recorded without an index
+	void load(const std::string& idx_fname, const char* ptr, uint64_t size) {
+		if (_end != 0) {
+			return;
+		}
+		FILE* fp = fopen(idx_fname.c_str(), "rb");
+		if (!fp) {
+			return;
+		}
+		L2SnapEntry entry;
+		uint64_t header, ts;
+		while (fread(&entry, sizeof(L2SnapEntry), 1, fp) == 1) {
+			if ((_snaps.size() == 0)? (entry.pos != 0) : (entry.pos < _end)) {
+				break;
+			}
+			if (entry.pos + sizeof(uint64_t) + sizeof(BookDepot) > size) {
+				break;
+			}
+			memcpy(&header, ptr + entry.pos, sizeof(uint64_t));
+			memcpy(&ts, ptr + entry.pos + sizeof(uint64_t) + offsetof(BookDepot, update_ts_micro), sizeof(uint64_t));
+			if ((header != SnapshotPreamble) || (ts != entry.ts_micro)) {
+				break;
+			}
+			_snaps.push_back(entry);
+			_end = entry.pos + sizeof(uint64_t) + sizeof(BookDepot);
+			_last_ts = entry.ts_micro;
+		}
+		fclose(fp);
+	}
+
+	// scan the records from the last scan up to size bytes of
+	// the mapped file, stops at an incomplete record
+	void scan(const char* ptr, uint64_t size) {
+		uint64_t header;
+		while (_end + sizeof(uint64_t) <= size) {
+			memcpy(&header, ptr + _end, sizeof(uint64_t));
+			if (header == SnapshotPreamble) {
+				if (_end + sizeof(uint64_t) + sizeof(BookDepot) > size) {
+					break;
+				}
+				uint64_t ts;
+				memcpy(&ts, ptr + _end + sizeof(uint64_t) + offsetof(BookDepot, update_ts_micro), sizeof(uint64_t));
+				_snaps.push_back(L2SnapEntry(ts, _end));
+				_end += (sizeof(uint64_t) + sizeof(BookDepot));
+				_last_ts = ts;
+			} else {
+				if (_end + sizeof(uint64_t) + sizeof(L2Delta) > size) {
+					break;
+				}
+				_end += (sizeof(uint64_t) + sizeof(L2Delta));
+				_last_ts = header;
+			}
+		}
+	}
+
+	// the latest snapshot with ts_micro <= ts, NULL if none
+	const L2SnapEntry* findPrior(uint64_t ts) const {
+		auto iter = std::upper_bound(_snaps.begin(), _snaps.end(), ts,
+				[](uint64_t t, const L2SnapEntry& e) { return t < e.ts_micro; });
+		if (iter == _snaps.begin()) {
+			return NULL;
+		}
+		return &(*(iter-1));
+	}
+
+	// end of the last complete record scanned
+	uint64_t getEnd() const {
+		return _end;
+	}
+
+	// ts of the last complete record scanned
+	uint64_t getLastTs() const {
+		return _last_ts;
+	}
+
+	const std::vector<L2SnapEntry>& getEntries() const {
+		return _snaps;
+	}
+
+private:
+	std::vector<L2SnapEntry> _snaps;
+	uint64_t _end;
+	uint64_t _last_ts;
+};
+
+class L2BookQuery {
+public:
+	static const int DefaultCacheBooks = 256;
+
+	// index, if given, is an index already scanned from the same file,
+	// i.e. by another query on another thread, only the records after
+	// it are scanned
+	explicit L2BookQuery(const BookConfig& bcfg, int cache_books = DefaultCacheBooks,
+			const L2SnapIndex* index = NULL) :
+		_bcfg(bcfg),
+		_fname(bcfg.L2fname()),
+		_fd(open(_fname.c_str(), O_RDONLY)),
+		_ptr(NULL),
+		_size(0),
+		_index(index? *index : L2SnapIndex()),
+		_book(_bcfg),
+		_cache_books(cache_books),
+		_hits(0), _records(0)
+	{
+		if (_fd < 0) {
+			logError("cannot open file for L2 book query: %s", _fname.c_str());
+			throw std::runtime_error(
+					std::string("cannot open file for L2 book query: ")
+			        + _bcfg.toString());
+		}
+		refresh();
+	}
+
+	~L2BookQuery() {
+		if (_ptr) {
+			munmap((void*)_ptr, _size);
+			_ptr = NULL;
+		}
+		if (_fd >= 0) {
+			close(_fd);
+			_fd = -1;
+		}
+	}
+
+	// picks up records appended since the last refresh, i.e.
+	// for a file being written by tickrecL2
+	void refresh() {
+		struct stat fs;
+		if (fstat(_fd, &fs) != 0) {
+			logError("error getting file size %s", _fname.c_str());
+			return;
+		}
+		const uint64_t size = fs.st_size;
+		if (size == _size) {
+			return;
+		}
+		if (_ptr) {
+			munmap((void*)_ptr, _size);
+			_ptr = NULL;
+			_size = 0;
+		}
+		// a cached book at the old end could miss the new records
+		_cache.clear();
+		_cache_map.clear();
+		if (size > 0) {
+			void* ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, _fd, 0);
+			if (ptr == MAP_FAILED) {
+				logError("cannot map file for L2 book query: %s", _fname.c_str());
+				throw std::runtime_error(
+						std::string("cannot map file for L2 book query: ")
+				        + _bcfg.toString());
+			}
+			_ptr = (const char*) ptr;
+			_size = size;
+		}
+		_index.load(_bcfg.L2idxname(), _ptr, _size);
+		_index.scan(_ptr, _size);
+	}
+
+	// book at ts_micro, NULL if ts_micro is before the first snapshot.
+	// the returned book is valid until the next query
+	const BookDepot* at(uint64_t ts_micro) {
+		const L2SnapEntry* snap = _index.findPrior(ts_micro);
+		if (!snap) {
+			return NULL;
+		}
+
+		// resume from the latest cached book before ts_micro unless
+		// the snapshot is nearer
+		uint64_t pos = snap->pos;
+		auto iter = _cache_map.upper_bound(ts_micro);
+		if (iter != _cache_map.begin()) {
+			--iter;
+			const CacheEntry& ce(*(iter->second));
+			if (ce.pos >= pos) {
+				if (iter->first == ts_micro) {
+					++_hits;
+					touch(iter->second);
+					return &(ce.book);
+				}
+				_book._book = ce.book;
+				pos = ce.pos;
+			}
+		}
+		pos = apply(pos, ts_micro);
+		cachePut(ts_micro, pos);
+		return &(_book._book);
+	}
+
+	// batched query, the handler is called in time order as
+	//     void onBook(size_t idx, uint64_t ts_micro, const BookDepot* book);
+	// where idx is the position of ts_micro in ts_list and book is
+	// NULL for a time before the first snapshot
+	template<typename Handler>
+	void query(const std::vector<uint64_t>& ts_list, Handler& handler) {
+		std::vector<size_t> idx(ts_list.size());
+		for (size_t i = 0; i < idx.size(); ++i) {
+			idx[i] = i;
+		}
+		std::stable_sort(idx.begin(), idx.end(),
+				[&ts_list](size_t i, size_t j) { return ts_list[i] < ts_list[j]; });
+		for (auto i : idx) {
+			handler.onBook(i, ts_list[i], at(ts_list[i]));
+		}
+	}
+
+	// books updated in [start_micro, end_micro), the handler is called as
+	//     void onBook(const BookDepot& book);
+	// returns number of books delivered
+	template<typename Handler>
+	long long replay(uint64_t start_micro, uint64_t end_micro, Handler& handler) {
+		const L2SnapEntry* snap = _index.findPrior(start_micro);
+		// a file always starts with a snapshot
+		uint64_t pos = snap? snap->pos : 0;
+		if (start_micro > 0) {
+			pos = apply(pos, start_micro - 1);
+		}
+		const uint64_t end = _index.getEnd();
+		long long cnt = 0;
+		while ((pos < end) && (recordTs(pos) < end_micro)) {
+			pos = applyRecord(pos);
+			handler.onBook(_book._book);
+			++cnt;
+		}
+		return cnt;
+	}
+
+	const L2SnapIndex& getIndex() const {
+		return _index;
+	}
+
+	const BookConfig& getBookConfig() const {
+		return _bcfg;
+	}
+
+	// number of exact cache hits and delta records applied so far
+	long long getHits() const {
+		return _hits;
+	}
+
+	long long getRecords() const {
+		return _records;
+	}
+
+private:
+	struct CacheEntry {
+		uint64_t ts_micro;
+		uint64_t pos;  // the next record to apply
+		BookDepot book;
+	};
+	typedef std::list<CacheEntry> CacheList;
+
+	const BookConfig _bcfg;
+	const std::string _fname;
+	int _fd;
+	const char* _ptr;
+	uint64_t _size;
+	L2SnapIndex _index;
+	BookL2 _book;
+	const int _cache_books;
+	CacheList _cache;  // most recently used at front
+	std::map<uint64_t, CacheList::iterator> _cache_map;
+	long long _hits;
+	long long _records;
+
+	// apply records from pos to _book until ts_micro,
+	// returns the position of the first record not applied
+	uint64_t apply(uint64_t pos, uint64_t ts_micro) {
+		const uint64_t end = _index.getEnd();
+		while ((pos < end) && (recordTs(pos) <= ts_micro)) {
+			pos = applyRecord(pos);
+		}
+		return pos;
+	}
+
+	// ts of the record at pos, a snapshot or a delta
+	uint64_t recordTs(uint64_t pos) const {
+		uint64_t header;
+		memcpy(&header, _ptr + pos, sizeof(uint64_t));
+		if (header == SnapshotPreamble) {
+			memcpy(&header, _ptr + pos + sizeof(uint64_t) + offsetof(BookDepot, update_ts_micro), sizeof(uint64_t));
+		}
+		return header;
+	}
+
+	// apply the record at pos, returns position of the next record
+	uint64_t applyRecord(uint64_t pos) {
+		uint64_t header;
+		memcpy(&header, _ptr + pos, sizeof(uint64_t));
+		++_records;
+		if (header == SnapshotPreamble) {
+			// the packed BookDepot as recorded, as its operator=
+			memcpy((void*)&(_book._book), _ptr + pos + sizeof(uint64_t), sizeof(BookDepot));
+			return pos + sizeof(uint64_t) + sizeof(BookDepot);
+		}
+		L2Delta* delta = &(_book._book.l2_delta);
+		memcpy(delta, _ptr + pos + sizeof(uint64_t), sizeof(L2Delta));
+		_book.updFromDelta(delta, header);
+		return pos + sizeof(uint64_t) + sizeof(L2Delta);
+	}
+
+	void touch(CacheList::iterator iter) {
+		_cache.splice(_cache.begin(), _cache, iter);
+	}
+
+	void cachePut(uint64_t ts_micro, uint64_t pos) {
+		if (_cache_books <= 0) {
+			return;
+		}
+		if ((int)_cache.size() >= _cache_books) {
+			// reuse the least recently used
+			auto last = std::prev(_cache.end());
+			_cache_map.erase(last->ts_micro);
+			touch(last);
+		} else {
+			_cache.push_front(CacheEntry());
+		}
+		CacheEntry& ce(_cache.front());
+		ce.ts_micro = ts_micro;
+		ce.pos = pos;
+		ce.book = _book._book;
+		_cache_map[ts_micro] = _cache.begin();
+	}
+};
+
+}  // namespace tp
@@ -0,0 +1,106 @@
+#include "latency.hpp"
+#include "time_util.h"
+#include "plcc/PLCC.hpp"
+
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace tp;
+using namespace utils;
+
+// lattap, the wire to queue latency of a running tpib, per symbol and
+// stage.  Without -i, the counts since the start of tpib, otherwise the
+// counts of each interval of sec seconds.
+
+volatile bool user_stopped = false;
+
+void sig_handler(int signo)
+{
+  if (signo == SIGINT) {
+    printf("Received SIGINT, exiting...\n");
+  }
+  user_stopped = true;
+}
+
+static void printNanos(uint64_t ns) {
+	if (ns < 10000ULL) {
+		printf(" %7lluns", (unsigned long long) ns);
+	} else if (ns < 10000000ULL) {
+		printf(" %7.1lfus", ns/1000.0);
+	} else {
+		printf(" %7.1lfms", ns/1000000.0);
+	}
+}
+
+static void printStats(const LatencyData& d, const char* title) {
+	char buf[32];
+	buf[0] = 0;
+	if (d.update_micro) {
+		TimeUtil::int_to_string_second_UTC((time_t)(d.update_micro/1000000), buf, sizeof(buf));
+	}
+	printf("%s, %d symbols, tpib alive at %s\n", title, (int) d.nsym, d.update_micro? buf : "(not yet)");
+	printf("%-24s %-5s %10s %9s %9s %9s %9s %9s %9s\n", "symbol", "stage", "count",
+			"mean", "p50", "p90", "p99", "p99.9", "max");
+	for (int i = 0; i < d.nsym; ++i) {
+		for (int s = 0; s < LatStages; ++s) {
+			const LatHist& h(d.sym[i].hist[s]);
+			printf("%-24s %-5s %10llu", s? "" : d.sym[i].name, latStageName(s), (unsigned long long) h.count);
+			printNanos(h.mean());
+			printNanos(h.quantile(0.5));
+			printNanos(h.quantile(0.9));
+			printNanos(h.quantile(0.99));
+			printNanos(h.quantile(0.999));
+			printNanos(h.max_ns);
+			printf("\n");
+		}
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	int interval = 0;
+	if (argc > 1) {
+		if ((argc != 3) || (strcmp(argv[1], "-i") != 0) || ((interval = atoi(argv[2])) <= 0)) {
+			printf("Usage: %s [-i sec]\n", argv[0]);
+			printf("  the wire to queue latency of tpib in %s, since its start or of each sec seconds\n",
+					latencyShmName().c_str());
+			return 0;
+		}
+	}
+	if (signal(SIGINT, sig_handler) == SIG_ERR)
+	{
+		printf("\ncan't catch SIGINT\n");
+		return -1;
+	}
+	utils::PLCC::instance("lattap");
+	LatencyReader reader;
+
+	// too large for the stack
+	LatencyData* prev = new LatencyData();
+	LatencyData* cur = new LatencyData();
+	LatencyData* diff = new LatencyData();
+	reader.snapshot(*cur);
+	if (interval == 0) {
+		printStats(*cur, "since start");
+	}
+	while ((interval > 0) && !user_stopped) {
+		std::swap(prev, cur);
+		sleep(interval);
+		reader.snapshot(*cur);
+		*diff = *cur;
+		for (int i = 0; (i < diff->nsym) && (i < prev->nsym); ++i) {
+			for (int s = 0; s < LatStages; ++s) {
+				diff->sym[i].hist[s].since(prev->sym[i].hist[s]);
+			}
+		}
+		printStats(*diff, "interval");
+	}
+	delete prev;
+	delete cur;
+	delete diff;
+	return 0;
+}
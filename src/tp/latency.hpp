@@ -0,0 +1,232 @@
+/*
+ * latency.hpp
+ *
+ * Wire to queue latency of tpib per symbol, in log-linear histograms
+ * in a shared memory segment (TPIBLatencyShm) printed live by lattap.
+ *
+ * A market data update is stamped at three points, CLOCK_MONOTONIC ns:
+ *     recv     the EReader::onReceive that completed its message
+ *     decoded  entering the TPIB callback
+ *     queued   after the book queue writer's update, i.e. the put
+ * and counted in the stages wire (recv to decoded, including the hand
+ * off of the reader thread), book (decoded to queued) and total.
+ *
+ * The histograms are HDR like, 2^LatSubBits linear buckets per power of
+ * 2, that is within 6%, up to about 9 minutes.  The writer adds without
+ * a lock, all counters are aligned 64 bit, a reader copies the segment
+ * and diffs the copies for an interval.  A copy taken during an add is
+ * off by the one update.  The shards of tpib share the stats, a symbol
+ * is added to by its shard only.
+ *
+ * Configurations:
+ *     TPIBLatency      = 1          (0 to not stamp)
+ *     TPIBLatencyShm   = TPIB_LAT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#include "shm_util.h"
+#include "time_util.h"
+#include "plcc/PLCC.hpp"
+
+namespace tp {
+
+static const int LatSubBits = 4;
+static const int LatBuckets = 37 << LatSubBits;  // up to 2^39 ns
+static const int LatMaxSymbols = 64;
+static const uint32_t LatVersion = 1;
+
+enum LatStage {
+	LatWire = 0,
+	LatBook,
+	LatTotal,
+	LatStages
+};
+
+static inline
+const char* latStageName(int stage) {
+	static const char* names[LatStages] = { "wire", "book", "total" };
+	return names[stage];
+}
+
+struct LatHist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t bucket[LatBuckets];
+
+	static int bucketOf(uint64_t ns) {
+		if (ns < (1ULL << LatSubBits)) {
+			return (int) ns;
+		}
+		const int e = 63 - __builtin_clzll(ns);
+		const int b = ((e - LatSubBits + 1) << LatSubBits) +
+				(int) ((ns >> (e - LatSubBits)) & ((1 << LatSubBits) - 1));
+		return b < LatBuckets? b : LatBuckets - 1;
+	}
+
+	// the lowest ns of bucket b
+	static uint64_t bucketLow(int b) {
+		if (b < (1 << LatSubBits)) {
+			return (uint64_t) b;
+		}
+		const int e = (b >> LatSubBits) + LatSubBits - 1;
+		return ((uint64_t) ((1 << LatSubBits) + (b & ((1 << LatSubBits) - 1)))) << (e - LatSubBits);
+	}
+
+	void add(uint64_t ns) {
+		++bucket[bucketOf(ns)];
+		sum_ns += ns;
+		if (ns > max_ns) {
+			max_ns = ns;
+		}
+		++count;
+	}
+
+	// the counts since prev, a copy of the same histogram.  max_ns is
+	// then the top of the highest bucket counted
+	void since(const LatHist& prev) {
+		count -= prev.count;
+		sum_ns -= prev.sum_ns;
+		max_ns = 0;
+		for (int b = 0; b < LatBuckets; ++b) {
+			bucket[b] -= prev.bucket[b];
+			if (bucket[b]) {
+				max_ns = bucketLow(b + 1) - 1;
+			}
+		}
+	}
+
+	// the upper end of the bucket of quantile q, 0 if empty
+	uint64_t quantile(double q) const {
+		if (count == 0) {
+			return 0;
+		}
+		const uint64_t rank = (uint64_t) (q * count);
+		uint64_t cnt = 0;
+		for (int b = 0; b < LatBuckets; ++b) {
+			cnt += bucket[b];
+			if (cnt > rank) {
+				const uint64_t hi = bucketLow(b + 1) - 1;
+				return hi < max_ns? hi : max_ns;
+			}
+		}
+		return max_ns;
+	}
+
+	uint64_t mean() const {
+		return count? sum_ns/count : 0;
+	}
+};
+
+struct LatSymbol {
+	char name[48];            // the book queue, i.e. IB_CLZ9_L2
+	LatHist hist[LatStages];
+};
+
+struct LatencyData {
+	char magic[8];            // "KRLATEN"
+	uint32_t version;
+	int32_t nsym;
+	int64_t start_micro;      // gmt, of the writer
+	volatile int64_t update_micro;
+	LatSymbol sym[LatMaxSymbols];
+};
+
+static inline
+std::string latencyShmName() {
+	bool found;
+	return plcc_getString("TPIBLatencyShm", &found, "TPIB_LAT");
+}
+
+class LatencyStats {
+public:
+	explicit LatencyStats(const std::string& shm_name = latencyShmName()) :
+		_shm(shm_name, sizeof(LatencyData), false),
+		_d((LatencyData*)_shm.ptr())
+	{
+		memset((char*)_d, 0, sizeof(LatencyData));
+		strcpy(_d->magic, "KRLATEN");
+		_d->version = LatVersion;
+		_d->start_micro = utils::TimeUtil::cur_time_gmt_micro();
+		logInfo("latency stats in %s", shm_name.c_str());
+	}
+
+	static int64_t nowNanos() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	}
+
+	// the index of the symbol, kept over the re-subscriptions, -1 if full
+	int addSymbol(const std::string& name) {
+		std::lock_guard<std::mutex> lock(_sym_mutex);
+		for (int i = 0; i < _d->nsym; ++i) {
+			if (name == _d->sym[i].name) {
+				return i;
+			}
+		}
+		if (_d->nsym >= LatMaxSymbols) {
+			logError("latency stats full, %s not counted", name.c_str());
+			return -1;
+		}
+		LatSymbol& s(_d->sym[_d->nsym]);
+		strncpy(s.name, name.c_str(), sizeof(s.name) - 1);
+		asm volatile("" ::: "memory");
+		return _d->nsym++;
+	}
+
+	void add(int sym, int64_t recv_ns, int64_t decoded_ns, int64_t queued_ns) {
+		if (__builtin_expect((sym < 0) || (recv_ns == 0), 0)) {
+			return;
+		}
+		LatHist* h = _d->sym[sym].hist;
+		h[LatWire].add(nonNeg(decoded_ns - recv_ns));
+		h[LatBook].add(nonNeg(queued_ns - decoded_ns));
+		h[LatTotal].add(nonNeg(queued_ns - recv_ns));
+	}
+
+	// once in a while, for the reader to tell a live writer
+	void touch() {
+		_d->update_micro = utils::TimeUtil::cur_time_gmt_micro();
+	}
+
+private:
+	utils::ShmSegment _shm;
+	LatencyData* const _d;
+	std::mutex _sym_mutex;   // of the shards subscribing
+
+	static uint64_t nonNeg(int64_t ns) {
+		return ns > 0? (uint64_t) ns : 0;
+	}
+};
+
+class LatencyReader {
+public:
+	explicit LatencyReader(const std::string& shm_name = latencyShmName()) :
+		_shm(shm_name, sizeof(LatencyData), true),
+		_d((const LatencyData*)_shm.ptr())
+	{
+		if ((strcmp(_d->magic, "KRLATEN") != 0) || (_d->version != LatVersion)) {
+			logError("%s is not a latency stats segment of version %d", shm_name.c_str(), (int)LatVersion);
+			throw std::runtime_error(shm_name + " is not a latency stats segment");
+		}
+	}
+
+	void snapshot(LatencyData& d) const {
+		memcpy(&d, _d, sizeof(LatencyData));
+	}
+
+private:
+	utils::ShmSegment _shm;
+	const LatencyData* const _d;
+};
+
+}
@@ -0,0 +1,82 @@
+#include "bookL2.hpp"
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+// The warm restart of a book queue, as of tpib with TPIBWarmRestart:
+// a writer seeded from the queue of the previous run keeps its book
+// until the first depth update, which starts the levels over but
+// keeps the cumulative volumes.  Run from a directory with
+// config/main.cfg, returns the number of failed checks.
+
+typedef BookQ<ShmCircularBuffer> BookQType;
+
+static int failed = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        logError("FAILED: %s", what);
+        printf("FAILED: %s\n", what);
+        ++failed;
+    }
+}
+
+int main() {
+    utils::PLCC::instance("book_restart_test");
+    const BookConfig cfg("NYM/CLZ9", "L2");
+    Quantity bvol = 0, svol = 0;
+    {
+        // the previous run
+        BookQType bq(cfg, false, true);
+        BookQType::Writer& w(bq.theWriter());
+        w.newPrice(55.00, 10, 0, true, 100);
+        w.newPrice(54.99, 20, 1, true, 101);
+        w.newPrice(55.01, 30, 0, false, 102);
+        w.newPrice(55.02, 40, 1, false, 103);
+        w.updTrade(55.01, 5);
+        w.updTrade(55.00, 7);
+        const BookDepot& book(w.getBook()->_book);
+        bvol = book.bvol_cum;
+        svol = book.svol_cum;
+        logInfo("previous run book %s", book.toString().c_str());
+        check(bvol + svol == 12, "the volumes of the previous run");
+    }
+
+    // the restart on the same queue
+    BookQType bq(cfg, false);
+    BookQType::Writer& w(bq.theWriter());
+    const BookDepot& book(w.getBook()->_book);
+    check(w.seedFromQ(), "seedFromQ of a valid book");
+    logInfo("seeded book %s", book.toString().c_str());
+    check((book.avail_level[0] == 2) && (book.avail_level[1] == 2), "the seeded levels");
+    check((book.bvol_cum == bvol) && (book.svol_cum == svol), "the seeded volumes");
+
+    // a trade on the stale book goes on with the volumes
+    w.updTrade(55.01, 3);
+    check(book.bvol_cum + book.svol_cum == bvol + svol + 3, "a trade on the stale book");
+    check((book.avail_level[0] == 2) && (book.avail_level[1] == 2), "the levels kept by a trade");
+    bvol = book.bvol_cum;
+    svol = book.svol_cum;
+
+    // the first depth update starts the levels over
+    w.newPrice(55.10, 50, 0, true, 200);
+    logInfo("book after the first depth update %s", book.toString().c_str());
+    check((book.avail_level[0] == 1) && (book.avail_level[1] == 0), "the levels cleared by a depth update");
+    check(book.pe[0].price == 55.10, "the new bid level");
+    check((book.pe[1].price == 0) && (book.pe[BookLevel].price == 0), "no level of the stale book");
+    check((book.bvol_cum == bvol) && (book.svol_cum == svol), "the volumes kept by a depth update");
+
+    // not stale any more, the next depth update is on the new levels
+    w.newPrice(55.11, 60, 0, false, 201);
+    check((book.avail_level[0] == 1) && (book.avail_level[1] == 1), "a depth update after the restart");
+
+    // markStale() again, as of a reconnect
+    w.markStale();
+    w.newPrice(55.20, 70, 0, false, 300);
+    check((book.avail_level[0] == 0) && (book.avail_level[1] == 1), "the levels cleared after markStale");
+    check((book.bvol_cum == bvol) && (book.svol_cum == svol), "the volumes kept after markStale");
+
+    printf("%s\n", failed? "FAILED" : "OK");
+    return failed;
+}
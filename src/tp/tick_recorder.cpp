@@ -1,4 +1,5 @@
 #include <bookL2.hpp>
+#include <epoll_util.h>
 
 #include <sstream>
 #include <string>
@@ -23,15 +24,6 @@ void sig_handler(int signo)
   user_stopped = true;
 }
 
-void sleepApproxBefore(long long next_bar_micro, long long spin_micro=5*1000LL) {
-	long long cur= (long long) utils::TimeUtil::cur_time_micro();
-	long long diff = next_bar_micro-cur;
-	if (diff > spin_micro) {
-		usleep(diff-spin_micro);
-	}
-}
-
-
 int main() {
 	// read all the l1 symbols and write to bar files
     if ((signal(SIGINT, sig_handler) == SIG_ERR) ||
@@ -48,41 +40,82 @@ int main() {
     std::vector<std::string> symL1n(plcc_getStringArr("SubL1n"));
     // create BookConfig, Book Reader and Bar Writers
     std::vector<BARType*> bws;
-    int bsec = plcc_getInt("BarSec");
+    // bar periods in seconds, i.e. BarSecList = [1, 5, 60, 300],
+    // each written to its own bar file from one read of the queue.
+    // BarSec if no list is given
+    bool found = false;
+    const bool by_upd_time = plcc_getInt("BarByUpdateTime", &found) && found;
+    std::vector<int> bsecs;
+    for (const auto& s : plcc_getStringArr("BarSecList")) {
+    	bsecs.push_back(atoi(s.c_str()));
+    }
+    if (bsecs.size() == 0) {
+    	bsecs.push_back(plcc_getInt("BarSec"));
+    }
 
     for (const auto& sym : symL1 ) {
         BookConfig bcfg(sym,"L1");
-        BARType*bw(new BARType(bcfg,bsec));
+        BARType*bw(new BARType(bcfg,bsecs,by_upd_time));
         bws.push_back(bw);
     }
     // the future back contracts, if any
     for (const auto& sym : symL1n ) {
         BookConfig bcfg(sym,"L1", true);
-        BARType*bw(new BARType(bcfg,bsec));
+        BARType*bw(new BARType(bcfg,bsecs,by_upd_time));
         bws.push_back(bw);
     }
+    int bsec = bws[0]->getBarSec();
 
-    BookDepot myBook;
     //uint64_t start_tm = utils::TimeUtil::cur_time_micro();
     user_stopped = false;
     long long fcnt=0;
     const int64_t bar_micro = bsec * 1000000LL;
-    const int64_t MAX_SLEEP_MICRO = 50000LL;
 
+    // The bar boundaries are an absolute periodic timerfd on the
+    // realtime clock, the same clock as cur_time_micro().  The shm
+    // queues have no fd to wait on, so an idle loop waits on the timer
+    // for at most QueuePollMilli before polling the queues again.
+    //
+    // The updates go to the bar of the time they are read.  With
+    // BarByUpdateTime they go to the bars by their update time, as
+    // barrebuild of the recorded books, and a bar is closed BarLateMicro
+    // after its boundary to take the updates stamped before the
+    // boundary but read after it.  An update later than that goes to
+    // the next bar.
+    int poll_milli = plcc_getInt("QueuePollMilli", &found);
+    if (!found) {
+    	poll_milli = 1;
+    }
+    const int64_t late_micro = by_upd_time? plcc_getInt("BarLateMicro", &found) : 0;
     int64_t cur_micro = utils::TimeUtil::cur_time_micro();
     int64_t next_bar = (cur_micro / bar_micro  + 1) * bar_micro;
+    TimerFd bar_timer;
+    bar_timer.setAbsMicro(next_bar + late_micro, bar_micro);
+    Epoll ep;
+    ep.add(bar_timer.fd(), EPOLLIN, 0);
+
     int flush_need = 0; // zero bar files need to be flushed
     while (!user_stopped) {
     	bool has_update = false;
     	for (auto bw : bws) {
+    		if (by_upd_time) {
+    			has_update |= bw->update_until(next_bar);
+    			continue;
+    		}
             cur_micro = utils::TimeUtil::cur_time_micro();
             if (cur_micro >= next_bar) {
-                has_update = true;
                 break;
             }
     		has_update |= bw->update_continous(cur_micro);
     	}
-        if (cur_micro >= next_bar) {
+    	if (cur_micro < next_bar + late_micro) {
+    		// wait only when idle, a pending flush goes first
+    		if (ep.wait((has_update || flush_need > 0)? 0 : poll_milli) > 0) {
+    			bar_timer.read();
+    		}
+    		cur_micro = utils::TimeUtil::cur_time_micro();
+    	}
+        while (cur_micro >= next_bar + late_micro) {
             for (auto bw2 : bws) {
                 bw2->onBar(next_bar);
             }
@@ -90,24 +123,11 @@ int main() {
             flush_need = (int)bws.size();
         }
 
-    	if (!has_update) {
-            int64_t sleep_micro = (next_bar - cur_micro) - MAX_SLEEP_MICRO;
-            if (sleep_micro > MAX_SLEEP_MICRO) {
-                if (flush_need > 0) {
-                    long long i = fcnt;
-                    for (; flush_need>0 ; ++i, --flush_need) {
-                        if (cur_micro >= next_bar) {
-                            break;
-                        }
-                        bws[(i%(long long)bws.size())]->flush();
-                        cur_micro = utils::TimeUtil::cur_time_micro();
-                    }
-                    fcnt=i;
-                } else {
-                    usleep(MAX_SLEEP_MICRO);
-                }
-            }
-        }
+    	if (!has_update && flush_need > 0) {
+    		// one file per idle pass, not to delay the queues
+    		bws[(fcnt++)%(long long)bws.size()]->flush();
+    		--flush_need;
+    	}
     }
     for (auto bw : bws) {
     	delete bw;
@@ -16,6 +16,7 @@
 #include <memory.h>
 #include <iostream>
 #include <plcc/plcc.hpp>
+#include <fmt_util.h>
 
 class HistoryDataClient : public ClientBaseImp {
 public:
@@ -77,8 +78,12 @@ public:
 		//FunctionPrint("%ld, %s, %lf, %lf, %lf, %lf, %d, %d, %lf, %d", reqId, date.c_str(), open, high, low,
 		//		close, volume, barCount, WAP, hasGaps);
 		if (strncmp(date.c_str(), "finished", 8)!=0) {
-			fprintf(fp,"%s, %lf, %lf, %lf, %lf, %d, %d, %lf\n", date.c_str(), open, high, low,
-					close, volume, barCount, WAP);
+			// "%s, %lf, %lf, %lf, %lf, %d, %d, %lf\n"
+			utils::FmtBuf<512> line;
+			line.str(date.c_str()).str(", ").fixed(open, 6).str(", ").fixed(high, 6).str(", ")
+				.fixed(low, 6).str(", ").fixed(close, 6).str(", ").i64(volume).str(", ")
+				.i64(barCount).str(", ").fixed(WAP, 6).ch('\n');
+			fwrite(line.data(), 1, line.size(), fp);
 			fflush(fp);
 			received++;
 		}
@@ -99,7 +104,10 @@ public:
 	        //    ", size: " << tick.size << ", exchange: " << tick.exchange << ", special conditions: " << tick.specialConditions << std::endl;
 	        //logInfo("Historical tick last, ReqId: %d, time %s, mask %d, price %f, size %lld, exchange %s special conditions %s",
 	        //		reqId, ctime(&t),tick.mask, tick.price,tick.size,tick.exchange.c_str(),tick.specialConditions.c_str());
-	    	fprintf(fp,"%lld, %lf, %lld, %d\n", tick.time, tick.price, tick.size, tick.mask);
+	    	// "%lld, %lf, %lld, %d\n"
+	    	utils::FmtBuf<256> line;
+	    	line.i64(tick.time).str(", ").fixed(tick.price, 6).str(", ").i64(tick.size).str(", ").i64(tick.mask).ch('\n');
+	    	fwrite(line.data(), 1, line.size(), fp);
 	    	received++;
 	    }
 	    fflush(fp);
@@ -107,7 +115,10 @@ public:
 	//! [historicalticks]
 	void historicalTicks(int reqId, const std::vector<HistoricalTick>& ticks, bool done) {
 	    for (const HistoricalTick& tick : ticks) {
-	    	fprintf(fp,"%lld, %lf\n", tick.time, tick.price);
+	    	// "%lld, %lf\n"
+	    	utils::FmtBuf<256> line;
+	    	line.i64(tick.time).str(", ").fixed(tick.price, 6).ch('\n');
+	    	fwrite(line.data(), 1, line.size(), fp);
 		    //	std::time_t t = tick.time;
 		    //	localtime(&t);
 		    //	std::cout << "Historical tick. ReqId: " << reqId << ", time: " << ctime(&t) << ", price: "<< tick.price << ", size: " << tick.size << std::endl;
@@ -127,7 +138,11 @@ public:
 	        //logInfo("Historical tick bid/ask. ReqId: %d, time: %s, mask %d, price bid: %f, price ask %f, size bid %lld, size ask %lld",
 	        //		reqId, ctime(&t), tick.mask, tick.priceBid, tick.priceAsk,tick.sizeBid,tick.sizeAsk);
 
-	    	fprintf(fp,"%lld,%lf,%lld,%lf,%lld\n",tick.time,tick.priceBid,tick.sizeBid,tick.priceAsk,tick.sizeAsk);
+	    	// "%lld,%lf,%lld,%lf,%lld\n"
+	    	utils::FmtBuf<256> line;
+	    	line.i64(tick.time).ch(',').fixed(tick.priceBid, 6).ch(',').i64(tick.sizeBid).ch(',')
+	    		.fixed(tick.priceAsk, 6).ch(',').i64(tick.sizeAsk).ch('\n');
+	    	fwrite(line.data(), 1, line.size(), fp);
 	        received++;
 	    }
 	    fflush(fp);
@@ -25,6 +25,7 @@
 
 #include "plcc/PLCC.hpp"
 #include <iostream>
+#include <time.h>
 
 // The connectivity implementations
 
@@ -34,6 +35,9 @@ ClientBaseImp::ClientBaseImp(int to_milli) :
     , m_pReader(0)
     , m_extraAuth(false)
     , m_errorCode(0)
+    , m_toMilli(to_milli)
+    , m_direct(false)
+    , m_busyPoll(false)
 {
 }
 
@@ -52,7 +56,18 @@ bool ClientBaseImp::connect(const char *host, unsigned int port, int clientId)
 	if (bRes) {
 		logInfo( "Connected to %s:%d clientId:%d", m_pClient->host().c_str(), m_pClient->port(), clientId);
         m_pReader = new EReader(m_pClient, &m_osSignal);
-		m_pReader->start();
+        if (!m_capturePath.empty()) {
+        	char ts[32];
+        	const time_t now = time(NULL);
+        	strftime(ts, sizeof(ts), ".%Y%m%d-%H%M%S", localtime(&now));
+        	const std::string path = m_capturePath + ts;
+        	if (m_pReader->startCapture(path.c_str()))
+        		logInfo("Capturing to %s", path.c_str());
+        	else
+        		logError("Cannot capture to %s", path.c_str());
+        }
+        if (!m_direct)
+        	m_pReader->start();
 	}
 	else
 		logInfo( "Cannot connect to %s:%d clientId:%d", m_pClient->host().c_str(), m_pClient->port(), clientId);
@@ -70,21 +85,52 @@ bool ClientBaseImp::isConnected() const
 	return m_pClient->isConnected();
 }
 
+int ClientBaseImp::fd() const
+{
+	return m_pClient->fd();
+}
+
+void ClientBaseImp::setDirectDispatch(bool direct, bool busy_poll)
+{
+	m_direct = direct;
+	m_busyPoll = direct && busy_poll;
+	logInfo("IB client %s%s", direct ? "direct dispatch" : "reader thread", m_busyPoll ? " busy poll" : "");
+	if (direct && !m_busyPoll && (m_toMilli <= 0)) {
+		logError("IB client direct dispatch with a wait of %d milliseconds spins on the socket", m_toMilli);
+	}
+}
+
+void ClientBaseImp::setCapture(const std::string& path)
+{
+	m_capturePath = path;
+}
+
 int ClientBaseImp::processMessages()
 {
-	int processed_count = 0;
+	if (m_direct) {
+		errno = 0;
+		return m_pReader->processMsgsDirect(directWaitMicro());
+	}
+	const int res = waitForMessages();
+	if (res <= 0)
+		return res;
+	return m_pReader->processMsgs();
+}
+
+// 1 to process the messages, 0 on timeout, -1 on error
+int ClientBaseImp::waitForMessages()
+{
 	int errcode = m_osSignal.waitForSignal();
 	if (errcode== 0) {
 		// this can fall through if timeout
 		errno = 0;
-		processed_count = m_pReader->processMsgs();
-	} else {
-		if (errcode != ETIMEDOUT) {
-			logError("error encounterd at waitForSignal, %d", errcode);
-			return -1;
-		}
+		return 1;
+	}
+	if (errcode != ETIMEDOUT) {
+		logError("error encounterd at waitForSignal, %d", errcode);
+		return -1;
 	}
-	return processed_count;
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////
@@ -9,6 +9,7 @@
 #include "EReader.h"
 #include "EClientSocket.h"
 #include "EPosixClientSocketPlatform.h"
+#include <string>
 #define TWS_PORT 7496
 #define IBG_PORT 4001
 
@@ -20,7 +21,27 @@ public:
 	bool connect(const char * host, unsigned int port, int clientId);
 	void disconnect() const;
 	bool isConnected() const;
+	// the socket, -1 if not connected, for an event loop to read it
+	// with setDirectDispatch()
+	int fd() const;
 	virtual int processMessages();
+
+	// single thread mode, set before connect(): processMessages reads the
+	// socket and decodes on the calling thread without the EReader thread.
+	// It waits up to to_milli of the ctor for the socket, which should be
+	// positive as 0 spins on select(), or with busy_poll polls the socket
+	// without blocking
+	void setDirectDispatch(bool direct, bool busy_poll = false);
+
+	// captures the messages of each connection to path.yyyymmdd-hhmmss,
+	// see EReader::startCapture(), to be replayed by faketws.  Empty to
+	// not capture
+	void setCapture(const std::string& path);
+
+	// processMessages with a decoder of EReader::processMsgs(Decoder&),
+	// i.e. MdDecoder
+	template<class Decoder>
+	int processMessages(Decoder &decoder);
 public:
 	// events, replace all
 	// the pure virtual functions
@@ -33,8 +54,28 @@ protected:
 	EReader *m_pReader;
     bool m_extraAuth;
     int m_errorCode;
+    const int m_toMilli;
+    bool m_direct;
+    bool m_busyPoll;
+    std::string m_capturePath;
+
+    int waitForMessages();
+    long directWaitMicro() const { return m_busyPoll ? -1 : m_toMilli*1000L; }
 };
 
+template<class Decoder>
+int ClientBaseImp::processMessages(Decoder &decoder)
+{
+	if (m_direct) {
+		errno = 0;
+		return m_pReader->processMsgsDirect(directWaitMicro(), decoder);
+	}
+	const int res = waitForMessages();
+	if (res <= 0)
+		return res;
+	return m_pReader->processMsgs(decoder);
+}
+
 static inline int IBPortSwitch(int port) {
 	switch(port) {
 		case TWS_PORT: return IBG_PORT;
@@ -49,16 +49,17 @@ struct OrderInfo {
 	std::string tif;
 	double px;
 	void* trader;
+	uint64_t tag;  // of the placer for OrderEvents, 0 if none
 	bool isOpen;
-	OrderInfo() : oid(0), prev_oid(0), qty(0), px(0), trader(0), isOpen(true){
+	OrderInfo() : oid(0), prev_oid(0), qty(0), px(0), trader(0), tag(0), isOpen(true){
 	}
 
-	OrderInfo(int this_oid, const char* symbol, const Order& ord, void* callback_trader):
+	OrderInfo(int this_oid, const char* symbol, const Order& ord, void* callback_trader, uint64_t placer_tag = 0):
 		oid(this_oid),prev_oid(ord.orderId),
 		sym(symbol), action(ord.action),
 		qty(ord.totalQuantity), type(ord.orderType),
 		tif(ord.tif), px(ord.lmtPrice),trader(callback_trader),
-	    isOpen(true) {
+		tag(placer_tag), isOpen(true) {
 	}
 
 	void fill(Order& ord) const {
@@ -77,6 +78,16 @@ struct OrderInfo {
 	}
 };
 
+// the updates from IB of the orders placed with a tag, i.e. by the
+// binary clients of the FloorServer
+struct OrderEvents {
+	virtual ~OrderEvents() {};
+	virtual void onOrderStatus(const OrderInfo& oif, const std::string& status,
+			double filled, double remaining, double avg_px) = 0;
+	virtual void onOrderFill(const OrderInfo& oif, double px, double qty, const std::string& exec_id) = 0;
+	virtual void onOrderError(const OrderInfo& oif, int code, const std::string& msg) = 0;
+};
+
 template<typename Trader>
 class OrderIB : public ClientBaseImp {
 public :
@@ -88,9 +99,15 @@ public :
 	_port(port),
 	_next_ord_id(1),
 	_got_next_id(false),
-	_should_cancel(false)  {
+	_should_cancel(false),
+	_events(NULL)  {
 	};
 
+	// NULL not to be called
+	void setEvents(OrderEvents* events) {
+		_events = events;
+	}
+
 	~OrderIB() {
 		logInfo("OrderIB destructor disconnecting");
 		// try cancel all open orders
@@ -106,7 +123,8 @@ public :
 				   bool isBuy,
 				   bool isIOC,
 				   bool isLMT,
-				   int org_ordid=0 // for replacing existing
+				   int org_ordid=0, // for replacing existing
+				   uint64_t tag=0   // for OrderEvents
 				  ) {
 	    Contract con;
 	    RicContract::get().makeContract(con,symbol);
@@ -136,7 +154,7 @@ public :
 				symbol,
 				order.lmtPrice,
 				ordid);
-		_oid_map[ordid] = new OrderInfo(ordid, symbol, order, (void*) trader);
+		_oid_map[ordid] = new OrderInfo(ordid, symbol, order, (void*) trader, tag);
 		return ordid;
 	}
 
@@ -145,7 +163,8 @@ public :
 	// TODO - fix replace
 	int Replace(int org_ordid,
 			    tp::Quantity size,
-				tp::Price price) {
+				tp::Price price,
+				uint64_t tag=0) {  // the one of org_ordid if 0
 	    Contract con;  // using the default contract
 	    Order order;
 	    OrderInfo* oif = getByOid(org_ordid);
@@ -163,7 +182,7 @@ public :
 		order.lmtPrice = price;
 		const int ordid = _next_ord_id++;
 		m_pClient->placeOrder(ordid, con, order);
-		_oid_map[ordid] = new OrderInfo(ordid, oif->sym.c_str(), order, (void*) oif->trader);
+		_oid_map[ordid] = new OrderInfo(ordid, oif->sym.c_str(), order, (void*) oif->trader, tag? tag : oif->tag);
 
 		logInfo("Replacing Order(%d): %s %d %.7f oid(%d)",
 				org_ordid,
@@ -254,6 +273,14 @@ public :
 				avgFillPrice, permId,
 				lastFillPrice, clientId,
 				whyHeld.c_str(), mktCapPrice);
+		OrderInfo* oif = getTagged(orderId);
+		if (oif) {
+			if ((status == "Filled") || (status == "Cancelled") ||
+				(status == "ApiCancelled") || (status == "Inactive")) {
+				oif->isOpen = false;
+			}
+			_events->onOrderStatus(*oif, status, filled, remaining, avgFillPrice);
+		}
 	}
 	//! [orderstatus]
 
@@ -351,6 +378,10 @@ public :
 				execution.orderId,
 				execution.lastLiquidity,
 				execution.time.c_str());
+		const OrderInfo* oif = getTagged(execution.orderId);
+		if (oif) {
+			_events->onOrderFill(*oif, execution.price, execution.shares, execution.execId);
+		}
 	}
 	//! [execdetails]
 
@@ -362,6 +393,12 @@ public :
     void error(int id, int errorCode, const std::string& errorString)
     {
         logError( "Error id=%d, errorCode=%d, msg=%s", id, errorCode, errorString.c_str());
+        // of an order, other than the cancel confirmed (202) and
+        // the warnings (21xx)
+        const OrderInfo* oif = ((id > 0) && (errorCode != 202) && (errorCode < 2100))? getTagged(id) : NULL;
+        if (oif) {
+        	_events->onOrderError(*oif, errorCode, errorString);
+        }
         switch (errorCode) {
         case 1100:
             if( id == -1) // if "Connectivity between IB and TWS has been lost"
@@ -410,6 +447,7 @@ private:
 	std::unordered_map<int, OrderInfo*> _oid_map;
 	bool _got_next_id;
 	bool _should_cancel;
+	OrderEvents* _events;
 
     OrderInfo* getByOid(int oid) {
     	auto iter = _oid_map.find(oid);
@@ -420,7 +458,18 @@ private:
     	return NULL;
     }
 
-
+    // an order for OrderEvents, NULL if not, i.e. placed by another
+    // client or session
+    OrderInfo* getTagged(int oid) {
+    	if (!_events) {
+    		return NULL;
+    	}
+    	auto iter = _oid_map.find(oid);
+    	if ((iter == _oid_map.end()) || (iter->second->tag == 0)) {
+    		return NULL;
+    	}
+    	return iter->second;
+    }
 
 };
 
@@ -0,0 +1,351 @@
+/*
+ * faketws.cpp
+ *
+ * A stand in of TWS/IB Gateway replaying a capture of
+ * EReader::startCapture(), i.e. TPIBCapture of tpib, to each client
+ * connecting: the v100+ handshake with the server version of the
+ * capture, then after the client's startApi the captured messages at
+ * their pace divided by speed, or as fast as the client reads them with
+ * speed 0.  The requests of the client are read and dropped, so it must
+ * ask for the ticker ids of the capture, i.e. tpib with the same SubL1
+ * and SubL2.
+ *
+ * The connections are served at once, a client of id c gets capture
+ * c % (number of captures), i.e. the captures of the shards of tpib in
+ * the shard order when TPIBClientId is a multiple of TPIBShards.
+ *
+ *     faketws capture_file... [-p port] [-s speed] [-n loops] [-c conns] [-k]
+ *
+ *     -p  port to listen, 7496
+ *     -s  1 as captured, 2 twice as fast, 0 as fast as possible, 1
+ *     -n  replay the capture n times on each connection, 1
+ *     -c  exit after conns connections, 0 to serve forever
+ *     -k  keep a connection open after the replay until the client
+ *         closes it, otherwise closed as TWS would on a restart
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+static const int StartApi = 71;
+static const size_t MaxBatch = 64*1024;
+
+struct Capture {
+	int server_version;
+	std::vector<char> wire;         // the messages framed as on the wire
+	std::vector<size_t> offset;     // of each message in wire, and the end
+	std::vector<int64_t> recv_ns;   // of each message
+};
+
+static int64_t nowNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool loadCapture(const char* fname, Capture& cap) {
+	FILE* fp = fopen(fname, "rb");
+	if (!fp) {
+		printf("cannot open %s\n", fname);
+		return false;
+	}
+	char magic[8];
+	uint32_t sv;
+	if ((fread(magic, 1, 8, fp) != 8) || (memcmp(magic, "IBCAP01", 8) != 0) ||
+		(fread(&sv, sizeof(sv), 1, fp) != 1)) {
+		printf("%s is not a capture of EReader\n", fname);
+		fclose(fp);
+		return false;
+	}
+	cap.server_version = ntohl(sv);
+	uint32_t hdr[3];
+	while (fread(hdr, sizeof(hdr), 1, fp) == 1) {
+		const uint32_t len = ntohl(hdr[2]);
+		const size_t off = cap.wire.size();
+		cap.wire.resize(off + 4 + len);
+		memcpy(&cap.wire[off], &hdr[2], 4);
+		if (fread(&cap.wire[off + 4], 1, len, fp) != len) {
+			printf("%s truncated after %d messages\n", fname, (int) cap.offset.size());
+			cap.wire.resize(off);
+			break;
+		}
+		cap.offset.push_back(off);
+		cap.recv_ns.push_back((int64_t) (((uint64_t) ntohl(hdr[0]) << 32) | ntohl(hdr[1])));
+	}
+	cap.offset.push_back(cap.wire.size());
+	fclose(fp);
+	return true;
+}
+
+static bool readFull(int fd, char* buf, size_t len) {
+	while (len > 0) {
+		const ssize_t n = recv(fd, buf, len, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) {
+				continue;
+			}
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool sendFull(int fd, const char* buf, size_t len) {
+	while (len > 0) {
+		const ssize_t n = send(fd, buf, len, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) {
+				continue;
+			}
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool readMsg(int fd, std::string& msg) {
+	uint32_t len;
+	if (!readFull(fd, (char*) &len, 4)) {
+		return false;
+	}
+	len = ntohl(len);
+	if (len > 16*1024*1024) {
+		return false;
+	}
+	msg.resize(len);
+	return (len == 0) || readFull(fd, &msg[0], len);
+}
+
+static bool sendMsg(int fd, const std::string& msg) {
+	const uint32_t len = htonl((uint32_t) msg.size());
+	std::string frame((const char*) &len, 4);
+	frame += msg;
+	return sendFull(fd, frame.data(), frame.size());
+}
+
+// the requests of the client, dropped
+static void drain(int fd) {
+	char buf[4096];
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+}
+
+// "API\0", the version range, the server version and time back, and the
+// startApi of the client with its id
+static bool handshake(int fd, int server_version, int& client_id) {
+	char api[4];
+	std::string msg;
+	if (!readFull(fd, api, 4) || (memcmp(api, "API", 4) != 0) || !readMsg(fd, msg)) {
+		printf("not a v100+ client\n");
+		return false;
+	}
+	int min_ver = 0, max_ver = 0;
+	if ((sscanf(msg.c_str(), "v%d..%d", &min_ver, &max_ver) != 2) ||
+		(server_version < min_ver) || (server_version > max_ver)) {
+		printf("client versions %s don't have the server version %d of the capture\n",
+				msg.c_str(), server_version);
+		return false;
+	}
+	char tm[64];
+	const time_t now = time(NULL);
+	strftime(tm, sizeof(tm), "%Y%m%d %H:%M:%S %Z", localtime(&now));
+	msg = std::to_string(server_version);
+	msg += '\0';
+	msg += tm;
+	msg += '\0';
+	if (!sendMsg(fd, msg)) {
+		return false;
+	}
+	while (readMsg(fd, msg)) {
+		if (atoi(msg.c_str()) == StartApi) {
+			// 71, version, client id
+			const size_t p = msg.find('\0', msg.find('\0') + 1);
+			client_id = (p == std::string::npos)? 0 : atoi(msg.c_str() + p + 1);
+			return true;
+		}
+	}
+	printf("closed before startApi\n");
+	return false;
+}
+
+// the messages due, in batches of up to MaxBatch, false if the client is
+// gone
+static bool replay(int fd, const Capture& cap, double speed, int64_t& msgs, int64_t& bytes) {
+	const size_t n = cap.recv_ns.size();
+	const int64_t t0 = cap.recv_ns[0];
+	const int64_t start = nowNanos();
+	size_t i = 0;
+	while (i < n) {
+		size_t j = i;
+		if (speed <= 0) {
+			while ((j < n) && (cap.offset[j] - cap.offset[i] < MaxBatch)) {
+				++j;
+			}
+		} else {
+			const int64_t elapsed = nowNanos() - start;
+			while ((j < n) && ((cap.recv_ns[j] - t0)/speed <= elapsed) &&
+				   (cap.offset[j] - cap.offset[i] < MaxBatch)) {
+				++j;
+			}
+			if (j == i) {
+				// sleeps until about the next one is due, spins the rest
+				const int64_t wait_ns = (int64_t) ((cap.recv_ns[i] - t0)/speed) - elapsed;
+				if (wait_ns > 100*1000) {
+					struct timespec ts = { 0, (long) (wait_ns - 50*1000) };
+					if (wait_ns >= 1000000000LL) {
+						ts.tv_sec = wait_ns/1000000000LL;
+						ts.tv_nsec = 0;
+					}
+					nanosleep(&ts, NULL);
+				}
+				drain(fd);
+				continue;
+			}
+		}
+		if (!sendFull(fd, &cap.wire[cap.offset[i]], cap.offset[j] - cap.offset[i])) {
+			return false;
+		}
+		drain(fd);
+		bytes += cap.offset[j] - cap.offset[i];
+		msgs += j - i;
+		i = j;
+	}
+	return true;
+}
+
+static void serve(int fd, const std::vector<Capture>* caps, double speed, int loops, bool keep) {
+	const int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	int client_id = 0;
+	if (!handshake(fd, (*caps)[0].server_version, client_id)) {
+		close(fd);
+		return;
+	}
+	const int k = ((client_id % (int)caps->size()) + caps->size()) % caps->size();
+	const Capture& cap((*caps)[k]);
+	printf("client %d gets capture %d\n", client_id, k);
+	int64_t msgs = 0, bytes = 0;
+	const int64_t start = nowNanos();
+	bool ok = true;
+	for (int r = 0; ok && (r < loops); ++r) {
+		ok = replay(fd, cap, speed, msgs, bytes);
+	}
+	const double sec = (nowNanos() - start)/1e9;
+	printf("client %d %s %lld messages %.1lf MB in %.3lf sec, %.0lf messages/sec\n", client_id,
+			ok? "replayed" : "gone after", (long long) msgs, bytes/1e6, sec, sec > 0? msgs/sec : 0);
+	fflush(stdout);
+
+	// the requests in flight read before closing, or the close resets
+	// the connection and the client could lose the last messages
+	if (!keep) {
+		shutdown(fd, SHUT_WR);
+		struct timeval tv = { 1, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	}
+	char buf[4096];
+	while (recv(fd, buf, sizeof(buf), 0) > 0);
+	close(fd);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("Usage: %s capture_file... [-p port] [-s speed] [-n loops] [-c conns] [-k]\n", argv[0]);
+		return 0;
+	}
+	int port = 7496, loops = 1, conns = 0;
+	double speed = 1;
+	bool keep = false;
+	std::vector<const char*> fnames;
+	for (int i = 1; i < argc; ++i) {
+		if ((strcmp(argv[i], "-p") == 0) && (i + 1 < argc)) {
+			port = atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc)) {
+			speed = atof(argv[++i]);
+		} else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+			loops = atoi(argv[++i]);
+		} else if ((strcmp(argv[i], "-c") == 0) && (i + 1 < argc)) {
+			conns = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-k") == 0) {
+			keep = true;
+		} else if (argv[i][0] != '-') {
+			fnames.push_back(argv[i]);
+		} else {
+			printf("unknown option %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	std::vector<Capture> caps(fnames.size());
+	for (size_t k = 0; k < fnames.size(); ++k) {
+		Capture& cap(caps[k]);
+		if (!loadCapture(fnames[k], cap)) {
+			return -1;
+		}
+		if (cap.recv_ns.empty()) {
+			printf("no message in %s\n", fnames[k]);
+			return -1;
+		}
+		if (cap.server_version != caps[0].server_version) {
+			printf("server version %d of %s is not %d of the first\n", cap.server_version, fnames[k], caps[0].server_version);
+			return -1;
+		}
+		printf("%d %s: server version %d, %d messages over %.3lf sec\n", (int) k, fnames[k], cap.server_version,
+				(int) cap.recv_ns.size(), (cap.recv_ns.back() - cap.recv_ns.front())/1e9);
+	}
+	if (caps.empty()) {
+		printf("no capture\n");
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	const int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	const int one = 1;
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if ((lfd < 0) || (bind(lfd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(lfd, 4) != 0)) {
+		printf("cannot listen on port %d: %s\n", port, strerror(errno));
+		return -1;
+	}
+	printf("listening on port %d\n", port);
+	fflush(stdout);
+	std::vector<std::thread> served;
+	for (int c = 0; (conns == 0) || (c < conns); ++c) {
+		const int fd = accept(lfd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				--c;
+				continue;
+			}
+			printf("accept failed: %s\n", strerror(errno));
+			break;
+		}
+		served.push_back(std::thread(serve, fd, &caps, speed, loops, keep));
+	}
+	for (auto& t : served) {
+		t.join();
+	}
+	close(lfd);
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * mddecoder.hpp
+ *
+ * The market data messages, TICK_PRICE, TICK_SIZE, TICK_STRING,
+ * MARKET_DEPTH and MARKET_DEPTH_L2, decoded as EDecoder does but into
+ * the callbacks of Handler called directly, so a final Handler, i.e.
+ * TPIB, gets its book update inlined into the decode loop instead of
+ * a virtual call through EWrapper.  Any other message goes to the
+ * EDecoder of the EReader, the virtual EWrapper as before.
+ *
+ *     MdDecoder<TPIB> md(*this, m_pReader->decoder());
+ *     m_pReader->processMsgs(md);
+ */
+
+#pragma once
+
+#include "StdAfx.h"
+#include "EDecoder.h"
+#include "EWrapper.h"
+#include "TwsSocketClientErrors.h"
+#include <bitset>
+#include <string>
+
+namespace tp {
+
+template<typename Handler>
+class MdDecoder {
+public:
+	MdDecoder(Handler& handler, EDecoder& decoder) :
+		_handler(handler), _decoder(decoder), _server_version(decoder.serverVersion()) {};
+
+	// as EDecoder::parseAndProcessMsg, the bytes consumed, 0 if incomplete
+	int parseAndProcessMsg(const char*& beginPtr, const char* endPtr) {
+		if (_server_version == 0) {
+			return _decoder.parseAndProcessMsg(beginPtr, endPtr);
+		}
+		try {
+			const char* ptr = beginPtr;
+			int msgId;
+			DECODE_FIELD_FAST(msgId);
+			switch (msgId) {
+			case TICK_PRICE:
+				ptr = tickPrice(ptr, endPtr);
+				break;
+			case TICK_SIZE:
+				ptr = tickSize(ptr, endPtr);
+				break;
+			case TICK_STRING:
+				ptr = tickString(ptr, endPtr);
+				break;
+			case MARKET_DEPTH:
+				ptr = marketDepth(ptr, endPtr);
+				break;
+			case MARKET_DEPTH_L2:
+				ptr = marketDepthL2(ptr, endPtr);
+				break;
+			default:
+				return _decoder.parseAndProcessMsg(beginPtr, endPtr);
+			}
+			if (!ptr) {
+				return 0;
+			}
+			const int processed = ptr - beginPtr;
+			beginPtr = ptr;
+			return processed;
+		} catch (const std::exception& e) {
+			_handler.error(NO_VALID_ID, SOCKET_EXCEPTION.code(), SOCKET_EXCEPTION.msg() + e.what());
+		}
+		return 0;
+	}
+
+private:
+	Handler& _handler;
+	EDecoder& _decoder;
+	const int _server_version;
+	std::string _tick_string;  // reused
+
+	const char* tickPrice(const char* ptr, const char* endPtr) {
+		int version, tickerId, tickTypeInt, size, attrMask;
+		double price;
+		DECODE_FIELD_FAST(version);
+		DECODE_FIELD_FAST(tickerId);
+		DECODE_FIELD_FAST(tickTypeInt);
+		DECODE_FIELD_FAST(price);
+		DECODE_FIELD_FAST(size);
+		DECODE_FIELD_FAST(attrMask);
+
+		TickAttrib attrib = {};
+		attrib.canAutoExecute = attrMask == 1;
+		if (_server_version >= MIN_SERVER_VER_PAST_LIMIT) {
+			std::bitset<32> mask(attrMask);
+			attrib.canAutoExecute = mask[0];
+			attrib.pastLimit = mask[1];
+			if (_server_version >= MIN_SERVER_VER_PRE_OPEN_BID_ASK) {
+				attrib.preOpen = mask[2];
+			}
+		}
+		_handler.tickPrice(tickerId, (TickType)tickTypeInt, price, attrib);
+
+		TickType sizeTickType = NOT_SET;
+		switch ((TickType)tickTypeInt) {
+		case BID: sizeTickType = BID_SIZE; break;
+		case ASK: sizeTickType = ASK_SIZE; break;
+		case LAST: sizeTickType = LAST_SIZE; break;
+		case DELAYED_BID: sizeTickType = DELAYED_BID_SIZE; break;
+		case DELAYED_ASK: sizeTickType = DELAYED_ASK_SIZE; break;
+		case DELAYED_LAST: sizeTickType = DELAYED_LAST_SIZE; break;
+		default: break;
+		}
+		if (sizeTickType != NOT_SET) {
+			_handler.tickSize(tickerId, sizeTickType, size);
+		}
+		return ptr;
+	}
+
+	const char* tickSize(const char* ptr, const char* endPtr) {
+		int version, tickerId, tickTypeInt, size;
+		DECODE_FIELD_FAST(version);
+		DECODE_FIELD_FAST(tickerId);
+		DECODE_FIELD_FAST(tickTypeInt);
+		DECODE_FIELD_FAST(size);
+		_handler.tickSize(tickerId, (TickType)tickTypeInt, size);
+		return ptr;
+	}
+
+	const char* tickString(const char* ptr, const char* endPtr) {
+		int version, tickerId, tickTypeInt;
+		DECODE_FIELD_FAST(version);
+		DECODE_FIELD_FAST(tickerId);
+		DECODE_FIELD_FAST(tickTypeInt);
+		const char* fieldEnd = EDecoder::CheckOffset(ptr, endPtr) ? EDecoder::FindFieldEnd(ptr, endPtr) : NULL;
+		if (!fieldEnd) {
+			return NULL;
+		}
+		_tick_string.assign(ptr, fieldEnd);
+		_handler.tickString(tickerId, (TickType)tickTypeInt, _tick_string);
+		return fieldEnd + 1;
+	}
+
+	const char* marketDepth(const char* ptr, const char* endPtr) {
+		int version, id, position, operation, side, size;
+		double price;
+		DECODE_FIELD_FAST(version);
+		DECODE_FIELD_FAST(id);
+		DECODE_FIELD_FAST(position);
+		DECODE_FIELD_FAST(operation);
+		DECODE_FIELD_FAST(side);
+		DECODE_FIELD_FAST(price);
+		DECODE_FIELD_FAST(size);
+		_handler.updateMktDepth(id, position, operation, side, price, size);
+		return ptr;
+	}
+
+	const char* marketDepthL2(const char* ptr, const char* endPtr) {
+		int version, id, position, operation, side, size;
+		std::string marketMaker;
+		double price;
+		DECODE_FIELD_FAST(version);
+		DECODE_FIELD_FAST(id);
+		DECODE_FIELD_FAST(position);
+		DECODE_FIELD(marketMaker);
+		DECODE_FIELD_FAST(operation);
+		DECODE_FIELD_FAST(side);
+		DECODE_FIELD_FAST(price);
+		DECODE_FIELD_FAST(size);
+		_handler.updateMktDepthL2(id, position, marketMaker, operation, side, price, size);
+		return ptr;
+	}
+};
+
+}
@@ -0,0 +1,83 @@
+/*
+ * rtvolume.hpp
+ *
+ * The RT_VOLUME (tick type 48) string of a trade,
+ *
+ *     price;size;time_ms;total_volume;vwap;single_trade
+ *     701.28;1;1348075471534;67854;701.46918464;true
+ *
+ * parsed without allocation.  The price is empty on a volume only
+ * update, i.e. of a correction, and total_volume could have a fraction
+ * for the fractional sizes.
+ */
+
+#pragma once
+
+#include "parse_util.h"
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+
+namespace tp {
+
+struct RtVolume {
+	double price;          // 0 if empty
+	int size;
+	int64_t time_ms;       // trade time, utc milliseconds
+	double total_volume;   // of the day
+	double vwap;           // of the day
+	bool single_trade;     // filled by a single market maker
+	bool has_price;
+
+	RtVolume() : price(0), size(0), time_ms(0), total_volume(0), vwap(0),
+			single_trade(false), has_price(false) {};
+
+	// false if any field is malformed, the fields are then undefined
+	bool parse(const char* s, size_t len) {
+		const char* p = s;
+		const char* const end = s + len;
+		const char* e = utils::ParseUtil::fieldEnd(p, end, ';');
+		has_price = (e != p);
+		price = 0;
+		if (has_price && (utils::ParseUtil::parseDouble(p, e, price) != e)) {
+			return false;
+		}
+		if ((e == end) || !(p = utils::ParseUtil::parseInt(e+1, end, size)) ||
+			(p == end) || (*p != ';')) {
+			return false;
+		}
+		if (!(p = utils::ParseUtil::parseInt64(p+1, end, time_ms)) || (p == end) || (*p != ';')) {
+			return false;
+		}
+		if (!(p = utils::ParseUtil::parseDouble(p+1, end, total_volume)) || (p == end) || (*p != ';')) {
+			return false;
+		}
+		if (!(p = utils::ParseUtil::parseDouble(p+1, end, vwap)) || (p == end) || (*p != ';')) {
+			return false;
+		}
+		++p;
+		if ((end - p == 4) && (memcmp(p, "true", 4) == 0)) {
+			single_trade = true;
+		} else if ((end - p == 5) && (memcmp(p, "false", 5) == 0)) {
+			single_trade = false;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	bool parse(const std::string& s) {
+		return parse(s.data(), s.size());
+	}
+
+	std::string toString() const {
+		char buf[256];
+		snprintf(buf, sizeof(buf), "%s%.7lf;%d;%lld;%.2lf;%.8lf;%s",
+				has_price? "" : "(no price)", price, size, (long long) time_ms,
+				total_volume, vwap, single_trade? "true" : "false");
+		return std::string(buf);
+	}
+};
+
+}
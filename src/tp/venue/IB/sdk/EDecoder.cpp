@@ -19,6 +19,7 @@
 #include <string.h>
 #include <cstdlib>
 #include <sstream>
+#include "../../../../util/parse_util.h"
 
 EDecoder::EDecoder(int serverVersion, EWrapper *callback, EClientMsgSink *clientMsgSink) {
 	m_pEWrapper = callback;
@@ -35,12 +36,12 @@ const char* EDecoder::processTickPriceMsg(const char* ptr, const char* endPtr) {
 	int size;
 	int attrMask;
 
-	DECODE_FIELD( version);
-	DECODE_FIELD( tickerId);
-	DECODE_FIELD( tickTypeInt);
-	DECODE_FIELD( price);
-	DECODE_FIELD( size); // ver 2 field
-	DECODE_FIELD( attrMask); // ver 3 field
+	DECODE_FIELD_FAST( version);
+	DECODE_FIELD_FAST( tickerId);
+	DECODE_FIELD_FAST( tickTypeInt);
+	DECODE_FIELD_FAST( price);
+	DECODE_FIELD_FAST( size); // ver 2 field
+	DECODE_FIELD_FAST( attrMask); // ver 3 field
 
 	TickAttrib attrib = {};
 
@@ -99,10 +100,10 @@ const char* EDecoder::processTickSizeMsg(const char* ptr, const char* endPtr) {
 	int tickTypeInt;
 	int size;
 
-	DECODE_FIELD( version);
-	DECODE_FIELD( tickerId);
-	DECODE_FIELD( tickTypeInt);
-	DECODE_FIELD( size);
+	DECODE_FIELD_FAST( version);
+	DECODE_FIELD_FAST( tickerId);
+	DECODE_FIELD_FAST( tickTypeInt);
+	DECODE_FIELD_FAST( size);
 
 	m_pEWrapper->tickSize( tickerId, (TickType)tickTypeInt, size);
 
@@ -196,14 +197,19 @@ const char* EDecoder::processTickStringMsg(const char* ptr, const char* endPtr)
 	int version;
 	int tickerId;
 	int tickTypeInt;
-	std::string value;
 
-	DECODE_FIELD( version);
-	DECODE_FIELD( tickerId);
-	DECODE_FIELD( tickTypeInt);
-	DECODE_FIELD( value);
+	DECODE_FIELD_FAST( version);
+	DECODE_FIELD_FAST( tickerId);
+	DECODE_FIELD_FAST( tickTypeInt);
+
+	// into the reused string, i.e. RT_VOLUME is over the small string size
+	const char* fieldEnd = CheckOffset(ptr, endPtr) ? FindFieldEnd(ptr, endPtr) : 0;
+	if( !fieldEnd)
+		return 0;
+	m_tickString.assign(ptr, fieldEnd);
+	ptr = ++fieldEnd;
 
-	m_pEWrapper->tickString( tickerId, (TickType)tickTypeInt, value);
+	m_pEWrapper->tickString( tickerId, (TickType)tickTypeInt, m_tickString);
 
 	return ptr;
 }
@@ -1068,13 +1074,13 @@ const char* EDecoder::processMarketDepthMsg(const char* ptr, const char* endPtr)
 	double price;
 	int size;
 
-	DECODE_FIELD( version);
-	DECODE_FIELD( id);
-	DECODE_FIELD( position);
-	DECODE_FIELD( operation);
-	DECODE_FIELD( side);
-	DECODE_FIELD( price);
-	DECODE_FIELD( size);
+	DECODE_FIELD_FAST( version);
+	DECODE_FIELD_FAST( id);
+	DECODE_FIELD_FAST( position);
+	DECODE_FIELD_FAST( operation);
+	DECODE_FIELD_FAST( side);
+	DECODE_FIELD_FAST( price);
+	DECODE_FIELD_FAST( size);
 
 	m_pEWrapper->updateMktDepth( id, position, operation, side, price, size);
 
@@ -1091,14 +1097,14 @@ const char* EDecoder::processMarketDepthL2Msg(const char* ptr, const char* endPt
 	double price;
 	int size;
 
-	DECODE_FIELD( version);
-	DECODE_FIELD( id);
-	DECODE_FIELD( position);
+	DECODE_FIELD_FAST( version);
+	DECODE_FIELD_FAST( id);
+	DECODE_FIELD_FAST( position);
 	DECODE_FIELD( marketMaker);
-	DECODE_FIELD( operation);
-	DECODE_FIELD( side);
-	DECODE_FIELD( price);
-	DECODE_FIELD( size);
+	DECODE_FIELD_FAST( operation);
+	DECODE_FIELD_FAST( side);
+	DECODE_FIELD_FAST( price);
+	DECODE_FIELD_FAST( size);
 
 	m_pEWrapper->updateMktDepthL2( id, position, marketMaker, operation, side,
 		price, size);
@@ -2362,7 +2368,7 @@ int EDecoder::parseAndProcessMsg(const char*& beginPtr, const char* endPtr) {
 		const char* ptr = beginPtr;
 
 		int msgId;
-		DECODE_FIELD( msgId);
+		DECODE_FIELD_FAST( msgId);
 
 		switch( msgId) {
 		case TICK_PRICE:
@@ -2823,6 +2829,34 @@ bool EDecoder::DecodeFieldMax(double& doubleValue, const char*& ptr, const char*
 	return true;
 }
 
+// the market data fields are the plain decimals of the TWS, parsed up
+// to the terminating 0 without a scan for it first.  Anything else the
+// fast parsers don't take in whole, i.e. an empty field or trailing
+// text, goes to DecodeField as before.
+bool EDecoder::DecodeFieldFast(int& intValue, const char*& ptr, const char* endPtr)
+{
+	if( !CheckOffset(ptr, endPtr))
+		return false;
+	const char* fieldEnd = utils::ParseUtil::parseInt(ptr, endPtr, intValue);
+	if( fieldEnd && fieldEnd < endPtr && *fieldEnd == 0) {
+		ptr = ++fieldEnd;
+		return true;
+	}
+	return DecodeField(intValue, ptr, endPtr);
+}
+
+bool EDecoder::DecodeFieldFast(double& doubleValue, const char*& ptr, const char* endPtr)
+{
+	if( !CheckOffset(ptr, endPtr))
+		return false;
+	const char* fieldEnd = utils::ParseUtil::parseDouble(ptr, endPtr, doubleValue);
+	if( fieldEnd && fieldEnd < endPtr && *fieldEnd == 0) {
+		ptr = ++fieldEnd;
+		return true;
+	}
+	return DecodeField(doubleValue, ptr, endPtr);
+}
+
 const char* EDecoder::decodeLastTradeDate(const char* ptr, const char* endPtr, ContractDetails& contract, bool isBond) {
 	std::string lastTradeDateOrContractMonth;
 	DECODE_FIELD( lastTradeDateOrContractMonth);
@@ -219,6 +219,7 @@ class TWSAPIDLLEXP EDecoder
     EWrapper *m_pEWrapper;
     int m_serverVersion;
     EClientMsgSink *m_pClientMsgSink;
+    std::string m_tickString;   // the TICK_STRING value, reused
 
     const char* processTickPriceMsg(const char* ptr, const char* endPtr);
     const char* processTickSizeMsg(const char* ptr, const char* endPtr);
@@ -326,11 +327,17 @@ public:
     static bool DecodeFieldMax(long&, const char*& ptr, const char* endPtr);
     static bool DecodeFieldMax(double&, const char*& ptr, const char* endPtr);
 
+    // as DecodeField, without the locale and the C string scan of atoi/atof
+    static bool DecodeFieldFast(int&, const char*& ptr, const char* endPtr);
+    static bool DecodeFieldFast(double&, const char*& ptr, const char* endPtr);
+
     EDecoder(int serverVersion, EWrapper *callback, EClientMsgSink *clientMsgSink = 0);
 
     int parseAndProcessMsg(const char*& beginPtr, const char* endPtr);
+    int serverVersion() const { return m_serverVersion; }
 };
 
 #define DECODE_FIELD(x) if (!EDecoder::DecodeField(x, ptr, endPtr)) return 0;
 #define DECODE_FIELD_TIME(x) if (!EDecoder::DecodeFieldTime(x, ptr, endPtr)) return 0;
 #define DECODE_FIELD_MAX(x) if (!EDecoder::DecodeFieldMax(x, ptr, endPtr)) return 0;
+#define DECODE_FIELD_FAST(x) if (!EDecoder::DecodeFieldFast(x, ptr, endPtr)) return 0;
@@ -4,11 +4,31 @@
 #include "StdAfx.h"
 #include "EMessage.h"
 
+// capacity kept by a pooled message over assign()
+#define MSG_KEEP_SIZE (64*1024)
 
-EMessage::EMessage(const std::vector<char> &data) {
+EMessage::EMessage() : m_recvTime(0) {
+}
+
+
+EMessage::EMessage(const std::vector<char> &data) : m_recvTime(0) {
     this->data = data;
 }
 
+EMessage::EMessage(const char *data, size_t size)
+    : data(data, data + size), m_recvTime(0)
+{
+}
+
+// reuses the storage of a pooled message, unless it grew over
+// MSG_KEEP_SIZE for a large one
+void EMessage::assign(const char *data, size_t size) {
+    if (this->data.capacity() > MSG_KEEP_SIZE && size <= MSG_KEEP_SIZE)
+        std::vector<char>().swap(this->data);
+
+    this->data.assign(data, data + size);
+}
+
 const char* EMessage::begin(void) const
 {
     return data.data();
@@ -5,8 +5,14 @@
 class TWSAPIDLLEXP EMessage
 {
     std::vector<char> data;
+    long long m_recvTime;   // CLOCK_MONOTONIC ns of the receive that completed it
 public:
+    EMessage();
     EMessage(const std::vector<char> &data);
+    EMessage(const char *data, size_t size);
+    void assign(const char *data, size_t size);
+    void setRecvTime(long long recvTime) { m_recvTime = recvTime; }
+    long long recvTime(void) const { return m_recvTime; }
     const char* begin(void) const;
     const char* end(void) const;
 };
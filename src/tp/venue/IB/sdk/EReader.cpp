@@ -12,7 +12,12 @@
 #include "EMessage.h"
 #include "DefaultEWrapper.h"
 
+#include <string.h>
+#include <time.h>
+#include <thread>
+
 #define IN_BUF_SIZE_DEFAULT 8192
+#define IN_MSG_POOL_SIZE 8192
 
 static DefaultEWrapper defaultWrapper;
 
@@ -28,7 +33,12 @@ EReader::EReader(EClientSocket *clientSocket, EReaderSignal *signal)
         m_pClientSocket = clientSocket;       
 		m_pEReaderSignal = signal;
 		m_nMaxBufSize = IN_BUF_SIZE_DEFAULT;
-		m_buf.reserve(IN_BUF_SIZE_DEFAULT);
+		m_buf.resize(IN_BUF_SIZE_DEFAULT);
+		m_nBufBegin = m_nBufEnd = 0;
+		m_recvTime = m_msgRecvTime = 0;
+		m_captureFile = 0;
+		m_msgPool.resize(IN_MSG_POOL_SIZE);
+		m_nMsgHead = m_nMsgTail = 0;
 }
 
 EReader::~EReader(void) {
@@ -45,6 +55,7 @@ EReader::~EReader(void) {
         WaitForSingleObject(m_hReadThread, INFINITE);
     }
 #endif
+    stopCapture();
 }
 
 void EReader::start() {
@@ -76,7 +87,7 @@ void EReader::readToQueue() {
 
 	// this is the main loop of the reader, spinning hot
 	while (m_isAlive) {
-		if (m_buf.size() == 0 && !processNonBlockingSelect() && m_pClientSocket->isSocketOK())
+		if (bufferedSize() == 0 && !processNonBlockingSelect() && m_pClientSocket->isSocketOK())
 			continue;
 
         if (!putMessageToQueue())
@@ -87,31 +98,41 @@ void EReader::readToQueue() {
 	m_pEReaderSignal->issueSignal(); //letting client know that socket was closed
 }
 
+// the signal is only issued when the ring was empty, processMsgs
+// decodes until it is empty again.  The seq_cst head store and tail load
+// here pair with the tail store and head load there, so one side always
+// sees the other.
 bool EReader::putMessageToQueue() {
-	EMessage *msg = 0;
+	if (!m_pClientSocket->isSocketOK())
+		return false;
 
-	if (m_pClientSocket->isSocketOK())
-		msg = readSingleMsg();
+	const unsigned int head = m_nMsgHead.load(std::memory_order_relaxed);
 
-	if (msg == 0)
-		return false;
+	// all slots in use, waits for processMsgs
+	while (head - m_nMsgTail.load(std::memory_order_acquire) >= m_msgPool.size()) {
+		if (!m_isAlive)
+			return false;
 
-	{
-		EMutexGuard lock(m_csMsgQueue);
-		m_msgQueue.push_back(std::shared_ptr<EMessage>(msg));
+		std::this_thread::yield();
 	}
 
-	m_pEReaderSignal->issueSignal();
+	if (!readSingleMsg(m_msgPool[head % m_msgPool.size()]))
+		return false;
+
+	m_nMsgHead.store(head + 1);
+
+	if (m_nMsgTail.load() == head)
+		m_pEReaderSignal->issueSignal();
 
 	return true;
 }
 
-bool EReader::processNonBlockingSelect() {
+bool EReader::processNonBlockingSelect(long waitMicro) {
 	fd_set readSet, writeSet, errorSet;
 	struct timeval tval;
 
-	tval.tv_usec = 100 * 1000; //100 ms
-	tval.tv_sec = 0;
+	tval.tv_usec = waitMicro % (1000 * 1000);
+	tval.tv_sec = waitMicro / (1000 * 1000);
 
 	if( m_pClientSocket->fd() >= 0 ) {
 
@@ -169,126 +190,262 @@ void EReader::onSend() {
 	m_pEReaderSignal->issueSignal();
 }
 
+// m_buf is read from m_nBufBegin and received into from m_nBufEnd, a
+// message is framed in place and the unread bytes are moved to the
+// front only when the tail runs out of room, usually a partial message
+// as the buffer is reset when all is read.
+
+// room for size more bytes after m_nBufEnd, growing m_buf if the unread
+// bytes and size don't fit
+void EReader::reserveBuf(unsigned int size) {
+	if (m_nBufEnd + size <= m_buf.size())
+		return;
+
+	const unsigned int nUnread = bufferedSize();
+
+	if (m_nBufBegin > 0) {
+		memmove(m_buf.data(), m_buf.data() + m_nBufBegin, nUnread);
+		m_nBufBegin = 0;
+		m_nBufEnd = nUnread;
+	}
+
+	if (nUnread + size > m_buf.size()) {
+		while (m_nMaxBufSize < nUnread + size)
+			m_nMaxBufSize *= 2;
+
+		m_buf.resize(m_nMaxBufSize);
+	}
+}
+
 void EReader::onReceive() {
-	int nOffset = m_buf.size();
+	if (m_nBufBegin == m_nBufEnd) {
+		m_nBufBegin = m_nBufEnd = 0;
 
-	m_buf.resize(m_nMaxBufSize);
-	
-	int nRes = m_pClientSocket->receive(m_buf.data() + nOffset, m_buf.size() - nOffset);
+		if (m_buf.size() > IN_BUF_SIZE_DEFAULT) {
+			std::vector<char>(m_nMaxBufSize = IN_BUF_SIZE_DEFAULT).swap(m_buf);
+		}
+	}
+
+	// at least a quarter of the buffer to receive into
+	reserveBuf(m_buf.size() / 4);
+
+	int nRes = m_pClientSocket->receive(m_buf.data() + m_nBufEnd, m_buf.size() - m_nBufEnd);
 
 	if (nRes <= 0)
 		return;
 
- 	m_buf.resize(nRes + nOffset);	
-}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	m_recvTime = ts.tv_sec * 1000000000LL + ts.tv_nsec;
 
-bool EReader::bufferedRead(char *buf, unsigned int size) {
-	while (size > 0) {
-		while (m_buf.size() < size && m_buf.size() < m_nMaxBufSize) {
-			if (!processNonBlockingSelect() && !m_pClientSocket->isSocketOK())
-				return false;
-		}
+	m_nBufEnd += nRes;
+}
 
-		int nBytes = (std::min<unsigned int>)(m_nMaxBufSize, size);
+// waits for size contiguous bytes at m_nBufBegin
+bool EReader::fillBuf(unsigned int size) {
+	if (bufferedSize() >= size)
+		return true;
 
-		std::copy(m_buf.begin(), m_buf.begin() + nBytes, buf);
-		std::copy(m_buf.begin() + nBytes, m_buf.end(), m_buf.begin());
-		m_buf.resize(m_buf.size() - nBytes);
+	reserveBuf(size - bufferedSize());
 
-		size -= nBytes;
-		buf += nBytes;
+	while (bufferedSize() < size) {
+		if (!processNonBlockingSelect() && !m_pClientSocket->isSocketOK())
+			return false;
 	}
 
 	return true;
 }
 
-EMessage * EReader::readSingleMsg() {
+// the size of the next v100+ message with its length field, 0 if the
+// length isn't in m_buf yet, -1 if it's invalid
+int EReader::bufferedFrameSize() const {
+	int msgSize;
+
+	if (bufferedSize() < sizeof(msgSize))
+		return 0;
+
+	memcpy(&msgSize, m_buf.data() + m_nBufBegin, sizeof(msgSize));
+	msgSize = ntohl(msgSize);
+
+	if (msgSize <= 0 || msgSize > MAX_MSG_LEN)
+		return -1;
+
+	return sizeof(msgSize) + msgSize;
+}
+
+// the next v100+ message as a view of m_buf, valid until the buffer is
+// read or received into again
+bool EReader::readFrame(const char *&pBegin, const char *&pEnd) {
+	if (!fillBuf(sizeof(int)))
+		return false;
+
+	const int frameSize = bufferedFrameSize();
+
+	if (frameSize <= 0 || !fillBuf(frameSize))
+		return false;
+
+	pBegin = m_buf.data() + m_nBufBegin + sizeof(int);
+	pEnd = m_buf.data() + m_nBufBegin + frameSize;
+	m_nBufBegin += frameSize;
+
+	return true;
+}
+
+// the next message already received, as readFrame but without reading
+// the socket: 1 with the view, 0 if it's not all received, -1 if invalid
+int EReader::nextBufferedMsg(const char *&pBegin, const char *&pEnd) {
 	if (m_pClientSocket->usingV100Plus()) {
-		int msgSize;
+		const int frameSize = bufferedFrameSize();
+
+		if (frameSize <= 0 || bufferedSize() < (unsigned int) frameSize)
+			return frameSize < 0 ? -1 : 0;
+
+		pBegin = m_buf.data() + m_nBufBegin + sizeof(int);
+		pEnd = m_buf.data() + m_nBufBegin + frameSize;
+		m_nBufBegin += frameSize;
+
+		return 1;
+	}
 
-		if (!bufferedRead((char *)&msgSize, sizeof(msgSize)))
-			return 0;
+	const char *p = m_buf.data() + m_nBufBegin;
+	const int msgSize = EDecoder(m_pClientSocket->EClient::serverVersion(), &defaultWrapper).parseAndProcessMsg(p, m_buf.data() + m_nBufEnd);
 
-		msgSize = ntohl(msgSize);
+	if (msgSize <= 0)
+		return 0;
 
-		if (msgSize <= 0 || msgSize > MAX_MSG_LEN)
-			return 0;
+	pBegin = m_buf.data() + m_nBufBegin;
+	pEnd = pBegin + msgSize;
+	m_nBufBegin += msgSize;
 
-		std::vector<char> buf = std::vector<char>(msgSize);
+	return 1;
+}
 
-		if (!bufferedRead(buf.data(), buf.size()))
-			return 0;
+bool EReader::readSingleMsg(EMessage &msg) {
+	if (m_pClientSocket->usingV100Plus()) {
+		const char *pBegin = 0;
+		const char *pEnd = 0;
 
-		return new EMessage(buf);
+		if (!readFrame(pBegin, pEnd))
+			return false;
+
+		msg.assign(pBegin, pEnd - pBegin);
+		msg.setRecvTime(m_recvTime);
+		captureMsg(pBegin, pEnd);
+
+		return true;
 	}
 	else {
 		const char *pBegin = 0;
 		const char *pEnd = 0;
 		int msgSize = 0;
 
+		// onReceive grows the buffer when it's over 3/4 full
 		while (msgSize == 0)
 		{
-			if (m_buf.size() >= m_nMaxBufSize * 3/4) 
-				m_nMaxBufSize *= 2;
-
 			if (!processNonBlockingSelect() && !m_pClientSocket->isSocketOK())
-				return 0;
+				return false;
 		
-			pBegin = m_buf.data();
-			pEnd = pBegin + m_buf.size();
+			pBegin = m_buf.data() + m_nBufBegin;
+			pEnd = m_buf.data() + m_nBufEnd;
 			msgSize = EDecoder(m_pClientSocket->EClient::serverVersion(), &defaultWrapper).parseAndProcessMsg(pBegin, pEnd);
 		}
 	
-		std::vector<char> msgData(msgSize);
+		msg.assign(m_buf.data() + m_nBufBegin, msgSize);
+		msg.setRecvTime(m_recvTime);
 
-		if (!bufferedRead(msgData.data(), msgSize))
-			return 0;
+		m_nBufBegin += msgSize;
 
-		if (m_buf.size() < IN_BUF_SIZE_DEFAULT && m_buf.capacity() > IN_BUF_SIZE_DEFAULT)
-		{
-			m_buf.resize(m_nMaxBufSize = IN_BUF_SIZE_DEFAULT);
-			m_buf.shrink_to_fit();
-		}
+		return true;
+	}
+}
 
-		EMessage * msg = new EMessage(msgData);
+void EReader::flushSend() {
+	m_pClientSocket->onSend();
+}
 
-		return msg;
-	}
+int EReader::processMsgs(void) {
+	return processMsgs(processMsgsDecoder_);
 }
 
-std::shared_ptr<EMessage> EReader::getMsg(void) {
-	EMutexGuard lock(m_csMsgQueue);
+// the single thread mode, for a reader that is not start()ed: reads the
+// socket once, waiting up to waitMicro for it, and decodes all the
+// messages received on the calling thread.  A negative waitMicro skips
+// the select for a non-blocking receive, to busy poll.  Returns the
+// number of messages decoded.
+int EReader::processMsgsDirect(long waitMicro) {
+	return processMsgsDirect(waitMicro, processMsgsDecoder_);
+}
 
-	if (m_msgQueue.size() == 0) {
-		return std::shared_ptr<EMessage>();
+// the next message of a processMsgsDirect pass, pass is 0 at its start
+bool EReader::nextMsgDirect(const char *&pBegin, const char *&pEnd, long waitMicro, int &pass) {
+	if (pass == 0) {
+		m_pClientSocket->onSend();
+		pass = 1;
 	}
 
-	std::shared_ptr<EMessage> msg = m_msgQueue.front();
-	m_msgQueue.pop_front();
+	while (m_pClientSocket->isSocketOK()) {
+		const int nRes = nextBufferedMsg(pBegin, pEnd);
 
-	return msg;
-}
+		if (nRes > 0) {
+			m_msgRecvTime = m_recvTime;
+			captureMsg(pBegin, pEnd);
+			return true;
+		}
 
+		if (nRes < 0) {
+			m_pClientSocket->eDisconnect();
+			return false;
+		}
 
-int EReader::processMsgs(void) {
-	m_pClientSocket->onSend();
+		// received once in the pass
+		if (pass == 2)
+			return false;
 
-	std::shared_ptr<EMessage> msg = getMsg();
+		pass = 2;
 
-	if (!msg.get())
-		return 0;
+		if (waitMicro < 0)
+			onReceive();
+		else if (!processNonBlockingSelect(waitMicro))
+			return false;
+	}
+	return false;
+}
+
+bool EReader::startCapture(const char *path) {
+	stopCapture();
 
-	const char *pBegin = msg->begin();
+	if (!m_pClientSocket->usingV100Plus())
+		return false;
 
-	int cnt=0;
-	while (processMsgsDecoder_.parseAndProcessMsg(pBegin, msg->end()) > 0) {
-		++cnt;
-		msg = getMsg();
+	if (!(m_captureFile = fopen(path, "wb")))
+		return false;
 
-		if (!msg.get())
-			break;
+	const int serverVersion = htonl(m_pClientSocket->EClient::serverVersion());
+
+	fwrite("IBCAP01", 1, 8, m_captureFile);
+	fwrite(&serverVersion, sizeof(serverVersion), 1, m_captureFile);
+
+	return true;
+}
 
-		pBegin = msg->begin();
+void EReader::stopCapture(void) {
+	if (m_captureFile) {
+		fclose(m_captureFile);
+		m_captureFile = 0;
 	}
-	return cnt;
+}
+
+// only buffered by stdio, a capture is for the tests and the benchmarks
+// rather than in production
+void EReader::captureMsg(const char *pBegin, const char *pEnd) {
+	if (!m_captureFile)
+		return;
+
+	const unsigned long long recvTime = m_recvTime;
+	const unsigned int hdr[3] = { htonl((unsigned int) (recvTime >> 32)), htonl((unsigned int) recvTime),
+		htonl((unsigned int) (pEnd - pBegin)) };
+
+	if (fwrite(hdr, sizeof(hdr), 1, m_captureFile) != 1 ||
+		fwrite(pBegin, 1, pEnd - pBegin, m_captureFile) != (size_t) (pEnd - pBegin))
+		stopCapture();
 }
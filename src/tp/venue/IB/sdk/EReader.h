@@ -4,23 +4,36 @@
 #pragma once
 
 #include <atomic>
+#include <stdio.h>
 #include "StdAfx.h"
 #include "EDecoder.h"
 #include "EMutex.h"
 #include "EReaderOSSignal.h"
+#include "EReaderSignal.h"
+#include "EMessage.h"
 
 class EClientSocket;
 struct EReaderSignal;
-class EMessage;
 
 class TWSAPIDLLEXP EReader
 {  
     EClientSocket *m_pClientSocket;
     EReaderSignal *m_pEReaderSignal;
     EDecoder processMsgsDecoder_;
-    std::deque<std::shared_ptr<EMessage>> m_msgQueue;
-    EMutex m_csMsgQueue;
-    std::vector<char> m_buf;
+    // a single producer single consumer ring of the messages read by
+    // the reader thread and decoded by processMsgs, the slots are reused
+    std::vector<EMessage> m_msgPool;
+    char m_padHead[64];
+    std::atomic<unsigned int> m_nMsgHead;   // next slot to put
+    char m_padTail[64];
+    std::atomic<unsigned int> m_nMsgTail;   // next slot to decode
+    char m_padEnd[64];
+    std::vector<char> m_buf;        // received bytes in [m_nBufBegin, m_nBufEnd)
+    unsigned int m_nBufBegin;
+    unsigned int m_nBufEnd;
+    long long m_recvTime;           // CLOCK_MONOTONIC ns of the latest receive
+    long long m_msgRecvTime;        // of the message being decoded
+    FILE *m_captureFile;            // the messages read, if capturing
     std::atomic<bool> m_isAlive;
 #if defined(IB_POSIX)
     pthread_t m_hReadThread;
@@ -31,15 +44,18 @@ class TWSAPIDLLEXP EReader
 
 	void onReceive();
 	void onSend();
-	bool bufferedRead(char *buf, unsigned int size);
+	unsigned int bufferedSize() const { return m_nBufEnd - m_nBufBegin; }
+	void reserveBuf(unsigned int size);
+	bool fillBuf(unsigned int size);
+	void flushSend();
+	void captureMsg(const char *pBegin, const char *pEnd);
 
 public:
     EReader(EClientSocket *clientSocket, EReaderSignal *signal);
     ~EReader(void);
 
 protected:
-	bool processNonBlockingSelect();
-    std::shared_ptr<EMessage> getMsg(void);
+	bool processNonBlockingSelect(long waitMicro = 100 * 1000);
     void readToQueue();
 #if defined(IB_POSIX)
     static void * readToQueueThread(void * lpParam);
@@ -49,11 +65,79 @@ protected:
 #   error "Not implemented on this platform"
 #endif
     
-    EMessage * readSingleMsg();
+    bool readSingleMsg(EMessage &msg);
+    bool readFrame(const char *&pBegin, const char *&pEnd);
+    int bufferedFrameSize() const;
+    int nextBufferedMsg(const char *&pBegin, const char *&pEnd);
+    bool nextMsgDirect(const char *&pBegin, const char *&pEnd, long waitMicro, int &pass);
 
 public:
     int processMsgs(void);
+    int processMsgsDirect(long waitMicro);
+
+    // as above, decoded by decoder.parseAndProcessMsg(pBegin, pEnd) of a
+    // decoder that binds its callbacks at compile time, falling back to
+    // the EDecoder of the reader for the messages it doesn't decode
+    template<class Decoder> int processMsgs(Decoder &decoder);
+    template<class Decoder> int processMsgsDirect(long waitMicro, Decoder &decoder);
+    EDecoder &decoder() { return processMsgsDecoder_; }
+
+    // CLOCK_MONOTONIC ns of the receive that completed the message being
+    // decoded, for the latency of the callbacks
+    long long msgRecvTime(void) const { return m_msgRecvTime; }
+
+    // writes every v100+ message read from now on to the file, set before
+    // start(), as
+    //     "IBCAP01" and a 0, the 4 byte server version
+    //     then for each message the 8 byte receive time in ns as of
+    //     msgRecvTime(), the 4 byte length and the message
+    // all in network order, i.e. the framing on the wire with the time
+    bool startCapture(const char *path);
+    void stopCapture(void);
+
 	bool putMessageToQueue();
 	void start();
 };
 
+template<class Decoder>
+int EReader::processMsgs(Decoder &decoder) {
+	flushSend();
+
+	unsigned int tail = m_nMsgTail.load(std::memory_order_relaxed);
+
+	int cnt=0;
+	// seq_cst, as the head load after the tail store, see putMessageToQueue
+	while (tail != m_nMsgHead.load()) {
+		const EMessage &msg = m_msgPool[tail % m_msgPool.size()];
+		const char *pBegin = msg.begin();
+		m_msgRecvTime = msg.recvTime();
+		const int nRes = decoder.parseAndProcessMsg(pBegin, msg.end());
+
+		m_nMsgTail.store(++tail);
+
+		if (nRes <= 0) {
+			// the reader doesn't signal while the ring is not empty
+			if (tail != m_nMsgHead.load())
+				m_pEReaderSignal->issueSignal();
+			break;
+		}
+		++cnt;
+	}
+	return cnt;
+}
+
+template<class Decoder>
+int EReader::processMsgsDirect(long waitMicro, Decoder &decoder) {
+	const char *pBegin = 0;
+	const char *pEnd = 0;
+	int pass = 0;
+
+	int cnt = 0;
+	while (nextMsgDirect(pBegin, pEnd, waitMicro, pass)) {
+		if (decoder.parseAndProcessMsg(pBegin, pEnd) <= 0)
+			break;
+
+		++cnt;
+	}
+	return cnt;
+}
@@ -0,0 +1,276 @@
+#include "StdAfx.h"
+#include "DefaultEWrapper.h"
+#include "EDecoder.h"
+#include "mddecoder.hpp"
+#include "time_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <string>
+
+using namespace utils;
+
+// EDecoder and MdDecoder on the market data messages against a decode
+// of the same fields with atoi/atof, the way of DecodeField, over a
+// corpus of v100+ frames, then the cost per message of each.  The corpus
+// is a capture of EReader::startCapture(), i.e. TPIBCapture of tpib, or
+// generated if not given.
+//     g++ -std=c++11 -O3 -DIB_USE_STD_STRING -o edecoder_bench edecoder_bench.cpp -I.. -I../sdk -I../../../../util libib.a -lpthread
+//     edecoder_bench [capture_file]
+
+static const int ServerVersion = 142;
+
+// the callbacks as a checksum, tickPrice also gives tickSize
+struct SumWrapper final : public DefaultEWrapper {
+	unsigned long long sum;
+	long long cnt[5];
+	SumWrapper() : sum(0) { memset(cnt, 0, sizeof(cnt)); }
+
+	void add(double v) {
+		unsigned long long u;
+		memcpy(&u, &v, sizeof(u));
+		sum = sum*31 + u;
+	}
+	void add(long long v) { sum = sum*31 + (unsigned long long)v; }
+	void add(const std::string& s) { for (char c : s) sum = sum*31 + (unsigned char)c; }
+
+	void tickPrice(TickerId id, TickType field, double price, const TickAttrib& attrib) {
+		add((long long)id); add((long long)field); add(price); add((long long)attrib.canAutoExecute);
+		++cnt[0];
+	}
+	void tickSize(TickerId id, TickType field, int size) {
+		add((long long)id); add((long long)field); add((long long)size);
+		++cnt[1];
+	}
+	void tickString(TickerId id, TickType field, const std::string& value) {
+		add((long long)id); add((long long)field); add(value);
+		++cnt[2];
+	}
+	void updateMktDepth(TickerId id, int position, int operation, int side, double price, int size) {
+		add((long long)id); add((long long)position); add((long long)operation); add((long long)side);
+		add(price); add((long long)size);
+		++cnt[3];
+	}
+	void updateMktDepthL2(TickerId id, int position, const std::string& marketMaker, int operation,
+			int side, double price, int size) {
+		add((long long)id); add((long long)position); add(marketMaker); add((long long)operation);
+		add((long long)side); add(price); add((long long)size);
+		++cnt[4];
+	}
+};
+
+// the reference, fields split with memchr and taken by atoi/atof
+static bool refDecode(const char* p, const char* end, SumWrapper& w) {
+	const char* f[16];
+	int n = 0;
+	while ((p < end) && (n < 16)) {
+		const char* e = (const char*)memchr(p, 0, end - p);
+		if (!e) {
+			return false;
+		}
+		f[n++] = p;
+		p = e + 1;
+	}
+	if (n == 0) {
+		return false;
+	}
+	switch (atoi(f[0])) {
+	case TICK_PRICE: {
+		if (n < 7) return false;
+		const int id = atoi(f[2]), tt = atoi(f[3]), size = atoi(f[5]), mask = atoi(f[6]);
+		TickAttrib attrib = {};
+		attrib.canAutoExecute = mask & 1;
+		w.tickPrice(id, (TickType)tt, atof(f[4]), attrib);
+		const int st = (tt == BID)? BID_SIZE : (tt == ASK)? ASK_SIZE : (tt == LAST)? LAST_SIZE :
+				(tt == DELAYED_BID)? DELAYED_BID_SIZE : (tt == DELAYED_ASK)? DELAYED_ASK_SIZE :
+				(tt == DELAYED_LAST)? DELAYED_LAST_SIZE : NOT_SET;
+		if (st != NOT_SET) {
+			w.tickSize(id, (TickType)st, size);
+		}
+		return true;
+	}
+	case TICK_SIZE:
+		if (n < 5) return false;
+		w.tickSize(atoi(f[2]), (TickType)atoi(f[3]), atoi(f[4]));
+		return true;
+	case TICK_STRING:
+		if (n < 5) return false;
+		w.tickString(atoi(f[2]), (TickType)atoi(f[3]), std::string(f[4]));
+		return true;
+	case MARKET_DEPTH:
+		if (n < 8) return false;
+		w.updateMktDepth(atoi(f[2]), atoi(f[3]), atoi(f[4]), atoi(f[5]), atof(f[6]), atoi(f[7]));
+		return true;
+	case MARKET_DEPTH_L2:
+		if (n < 9) return false;
+		w.updateMktDepthL2(atoi(f[2]), atoi(f[3]), std::string(f[4]), atoi(f[5]), atoi(f[6]),
+				atof(f[7]), atoi(f[8]));
+		return true;
+	}
+	return false;
+}
+
+static void addFrame(std::vector<std::string>& msgs, const std::vector<std::string>& fields) {
+	std::string m;
+	for (const auto& f : fields) {
+		m += f;
+		m += '\0';
+	}
+	msgs.push_back(m);
+}
+
+static std::string fmt(const char* f, double v) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), f, v);
+	return buf;
+}
+
+// as of a futures L2 subscription with trades, the prices at 0.25 and
+// the ones of a fx pair at 5 decimals
+static void genCorpus(std::vector<std::string>& msgs, int n) {
+	const char* mm[] = { "CME", "ISLAND", "ARCA", "BATS" };
+	for (int i = 0; i < n; ++i) {
+		const int id = 2 + rand()%8;
+		const std::string px = (id & 1)? fmt("%.2f", 2800 + (rand()%400)*0.25) : fmt("%.5f", 1.13 + (rand()%1000)*0.00001);
+		const std::string sz = std::to_string(1 + rand()%500);
+		switch (rand()%10) {
+		case 0: case 1: case 2:
+			addFrame(msgs, { "12", "1", std::to_string(id), std::to_string(rand()%10), std::to_string(rand()%3),
+					std::to_string(rand()%2), px, sz });
+			break;
+		case 3: case 4:
+			addFrame(msgs, { "13", "1", std::to_string(id), std::to_string(rand()%10), mm[rand()%4],
+					std::to_string(rand()%3), std::to_string(rand()%2), px, sz });
+			break;
+		case 5: case 6:
+			addFrame(msgs, { "1", "6", std::to_string(id), std::to_string(1 + rand()%4), px, sz, std::to_string(rand()%4) });
+			break;
+		case 7: case 8:
+			addFrame(msgs, { "2", "6", std::to_string(id), std::to_string(rand()%9), sz });
+			break;
+		default: {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "%s;%s;%lld;%d;%.8f;%s", px.c_str(), sz.c_str(),
+					1548950400000LL + rand(), rand(), 2800 + rand()/(double)RAND_MAX, rand()%2? "true" : "false");
+			addFrame(msgs, { "46", "6", std::to_string(id), "48", buf });
+			break;
+		}
+		}
+	}
+}
+
+static bool readCorpus(const char* fname, std::vector<std::string>& msgs) {
+	FILE* fp = fopen(fname, "rb");
+	if (!fp) {
+		printf("cannot open %s\n", fname);
+		return false;
+	}
+	char magic[8];
+	int sv;
+	if ((fread(magic, 1, 8, fp) != 8) || (memcmp(magic, "IBCAP01", 8) != 0) ||
+		(fread(&sv, sizeof(sv), 1, fp) != 1)) {
+		printf("%s is not a capture of EReader\n", fname);
+		fclose(fp);
+		return false;
+	}
+	if ((int)ntohl(sv) != ServerVersion) {
+		printf("server version %d of %s decoded as %d\n", (int)ntohl(sv), fname, ServerVersion);
+	}
+	int hdr[3];
+	while (fread(hdr, sizeof(hdr), 1, fp) == 1) {
+		const int len = ntohl(hdr[2]);
+		if ((len <= 0) || (len > MAX_MSG_LEN)) {
+			printf("bad frame length %d in %s\n", len, fname);
+			break;
+		}
+		std::string m(len, 0);
+		if (fread(&m[0], 1, len, fp) != (size_t)len) {
+			break;
+		}
+		// market data only
+		const int id = atoi(m.c_str());
+		if ((id == TICK_PRICE) || (id == TICK_SIZE) || (id == TICK_STRING) ||
+			(id == MARKET_DEPTH) || (id == MARKET_DEPTH_L2)) {
+			msgs.push_back(m);
+		}
+	}
+	fclose(fp);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> msgs;
+	if (argc > 1) {
+		if (!readCorpus(argv[1], msgs)) {
+			return -1;
+		}
+	} else {
+		srand(7);
+		genCorpus(msgs, 100000);
+	}
+	if (msgs.empty()) {
+		printf("no market data message\n");
+		return -1;
+	}
+
+	// the same callbacks message by message
+	int fails = 0;
+	SumWrapper w0, w1, w2;
+	EDecoder decoder(ServerVersion, &w0);
+	EDecoder decoder2(ServerVersion, &w2);
+	tp::MdDecoder<SumWrapper> md_decoder(w2, decoder2);
+	for (size_t i = 0; i < msgs.size(); ++i) {
+		const char* p = msgs[i].data();
+		const char* p2 = msgs[i].data();
+		const unsigned long long s0 = w0.sum;
+		const unsigned long long s1 = w1.sum;
+		const unsigned long long s2 = w2.sum;
+		w0.sum = w1.sum = w2.sum = 0;
+		const int n = decoder.parseAndProcessMsg(p, msgs[i].data() + msgs[i].size());
+		const int n2 = md_decoder.parseAndProcessMsg(p2, msgs[i].data() + msgs[i].size());
+		if ((n != (int)msgs[i].size()) || (n2 != n) ||
+			!refDecode(msgs[i].data(), msgs[i].data() + msgs[i].size(), w1) ||
+			(w0.sum != w1.sum) || (w2.sum != w1.sum)) {
+			if (++fails < 10) {
+				std::string s(msgs[i]);
+				std::replace(s.begin(), s.end(), '\0', ',');
+				printf("mismatch: %s\n", s.c_str());
+			}
+		}
+		w0.sum = s0*31 + w0.sum;
+		w1.sum = s1*31 + w1.sum;
+		w2.sum = s2*31 + w2.sum;
+	}
+	printf("%s: %d fails in %d messages (price %lld size %lld string %lld depth %lld depthL2 %lld)\n",
+			fails? "FAILED" : "PASSED", fails, (int)msgs.size(),
+			w0.cnt[0], w0.cnt[1], w0.cnt[2], w0.cnt[3], w0.cnt[4]);
+
+	// the best of a few passes over the corpus
+	uint64_t ref_micro = ~0ULL, dec_micro = ~0ULL, md_micro = ~0ULL;
+	for (int r = 0; r < 10; ++r) {
+		uint64_t t0 = TimeUtil::cur_time_micro();
+		for (const auto& m : msgs) {
+			refDecode(m.data(), m.data() + m.size(), w1);
+		}
+		uint64_t t1 = TimeUtil::cur_time_micro();
+		for (const auto& m : msgs) {
+			const char* p = m.data();
+			decoder.parseAndProcessMsg(p, m.data() + m.size());
+		}
+		uint64_t t2 = TimeUtil::cur_time_micro();
+		for (const auto& m : msgs) {
+			const char* p = m.data();
+			md_decoder.parseAndProcessMsg(p, m.data() + m.size());
+		}
+		uint64_t t3 = TimeUtil::cur_time_micro();
+		ref_micro = std::min(ref_micro, t1 - t0);
+		dec_micro = std::min(dec_micro, t2 - t1);
+		md_micro = std::min(md_micro, t3 - t2);
+	}
+	printf("atoi/atof %.1lf ns, EDecoder %.1lf ns, MdDecoder %.1lf ns per message (%llx)\n",
+			ref_micro*1000.0/msgs.size(), dec_micro*1000.0/msgs.size(), md_micro*1000.0/msgs.size(),
+			w0.sum ^ w1.sum ^ w2.sum);
+	return fails? 1 : 0;
+}
@@ -0,0 +1,188 @@
+#include "rtvolume.hpp"
+#include "time_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <string>
+
+using namespace tp;
+using namespace utils;
+
+// RtVolume::parse() against the sscanf of tpib and strtod over a corpus,
+// random round trips and random mutations, then times both.
+//     g++ -std=c++11 -O3 -o rtvolume_test rtvolume_test.cpp -I.. -I../../../../util
+
+static const char* corpus[] = {
+    "701.28;1;1348075471534;67854;701.46918464;true",
+    "701.28;1;1348075471534;67854;701.46918464;false",
+    ";0;1348075471534;67854;701.46918464;false",
+    "2800.25;12;1548950400123;1234567;2799.98765432;false",
+    "1.13065;1000000;1548950400123;987654321;1.13012345;true",
+    "0.00005;3;1548950400123;7;0.00005;true",
+    "50.01;-1;1548950400123;0;0;false",
+    "49.990000000000001;5;1548950400123;10.5;49.99;false",
+    "1e2;5;1548950400123;10;100;false",
+    "123456789012345678901234;5;1548950400123;10;1;true",
+};
+
+static const char* bad[] = {
+    "", "701.28", "701.28;1", "701.28;1;1348075471534;67854;701.46918464",
+    "701.28;1;1348075471534;67854;701.46918464;", "701.28;1;1348075471534;67854;701.46918464;True",
+    "701.28;x;1348075471534;67854;701.46918464;true", "701.28a;1;1348075471534;67854;701.46918464;true",
+    "701.28;1;1348075471534;67854;701.46918464;true ", ".;1;1;1;1;true",
+};
+
+// the old tpib path, price and size only
+static void oldParse(const std::string& s, double& price, int& size) {
+    price = 0;
+    size = 0;
+    char buf[16];
+    buf[0] = 0;
+    int num_read = 0;
+    sscanf(s.c_str(), "%lf;%d;%*d;%*d;%*f;%s%n", &price, &size, buf, &num_read);
+}
+
+// each field with strtod/strtoll
+static bool refParse(const std::string& s, RtVolume& rv) {
+    std::vector<std::string> f;
+    size_t p = 0, q;
+    while ((q = s.find(';', p)) != std::string::npos) {
+        f.push_back(s.substr(p, q-p));
+        p = q + 1;
+    }
+    f.push_back(s.substr(p));
+    if (f.size() != 6) {
+        return false;
+    }
+    rv.has_price = f[0].size() > 0;
+    rv.price = rv.has_price? strtod(f[0].c_str(), NULL) : 0;
+    rv.size = atoi(f[1].c_str());
+    rv.time_ms = strtoll(f[2].c_str(), NULL, 10);
+    rv.total_volume = strtod(f[3].c_str(), NULL);
+    rv.vwap = strtod(f[4].c_str(), NULL);
+    rv.single_trade = (f[5] == "true");
+    return true;
+}
+
+static bool same(const RtVolume& a, const RtVolume& b) {
+    return (a.has_price == b.has_price) && (memcmp(&a.price, &b.price, sizeof(double)) == 0) &&
+           (a.size == b.size) && (a.time_ms == b.time_ms) &&
+           (memcmp(&a.total_volume, &b.total_volume, sizeof(double)) == 0) &&
+           (memcmp(&a.vwap, &b.vwap, sizeof(double)) == 0) && (a.single_trade == b.single_trade);
+}
+
+static int check(const std::string& s) {
+    RtVolume rv, ref;
+    if (!rv.parse(s) || !refParse(s, ref) || !same(rv, ref)) {
+        printf("mismatch: %s\n  parse %s\n  ref   %s\n", s.c_str(), rv.toString().c_str(), ref.toString().c_str());
+        return 1;
+    }
+    double price;
+    int size;
+    oldParse(s, price, size);
+    if (rv.has_price && ((price != rv.price) || (size != rv.size))) {
+        printf("sscanf mismatch: %s %.17g %d\n", s.c_str(), price, size);
+        return 1;
+    }
+    return 0;
+}
+
+static std::string randNumber(int int_digits, int frac_digits) {
+    std::string s;
+    for (int i = 0; i < int_digits; ++i) {
+        s += (char)('0' + ((i == 0 && int_digits > 1)? 1 + rand()%9 : rand()%10));
+    }
+    if (frac_digits) {
+        s += '.';
+        for (int i = 0; i < frac_digits; ++i) {
+            s += (char)('0' + rand()%10);
+        }
+    }
+    return s;
+}
+
+static std::string randRtVolume() {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s;%d;%lld;%s;%s;%s",
+            (rand()%50 == 0)? "" : randNumber(1 + rand()%6, rand()%10).c_str(),
+            rand()%100000, 1548950400000LL + rand(),
+            randNumber(1 + rand()%12, (rand()%10 == 0)? 1 + rand()%4 : 0).c_str(),
+            randNumber(1 + rand()%6, rand()%14).c_str(),
+            rand()%2? "true" : "false");
+    return buf;
+}
+
+int main() {
+    int fails = 0;
+    for (auto s : corpus) {
+        fails += check(s);
+    }
+    for (auto s : bad) {
+        RtVolume rv;
+        if (rv.parse(s, strlen(s))) {
+            printf("bad string parsed: \"%s\" %s\n", s, rv.toString().c_str());
+            ++fails;
+        }
+    }
+    // round trips of the formatted doubles
+    for (int i = 0; i < 200000; ++i) {
+        const double px = (rand()%10000000)/pow(10.0, rand()%8);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%.*f;%d;1548950400123;%d;%.17g;true", rand()%10, px, rand()%1000, rand(), px);
+        fails += check(buf);
+    }
+    srand(7);
+    std::vector<std::string> strs;
+    for (int i = 0; i < 200000; ++i) {
+        strs.push_back(randRtVolume());
+        fails += check(strs.back());
+    }
+    // mutations, not to crash and to fail when not 6 fields
+    for (int i = 0; i < 200000; ++i) {
+        std::string s = strs[i];
+        const int n = 1 + rand()%3;
+        for (int k = 0; k < n; ++k) {
+            const size_t pos = rand() % (s.size() + 1);
+            switch (rand()%3) {
+            case 0: s.insert(pos, 1, "0123456789;.-e tf"[rand()%17]); break;
+            case 1: if (pos < s.size()) s.erase(pos, 1); break;
+            default: if (pos < s.size()) s[pos] = (char)(rand()%256); break;
+            }
+        }
+        RtVolume rv, ref;
+        if (rv.parse(s) && !refParse(s, ref)) {
+            printf("mutation parsed: %s\n", s.c_str());
+            ++fails;
+        }
+    }
+    printf("%s: %d fails\n", fails? "FAILED" : "PASSED", fails);
+
+    // as of IB, a price of a few decimals and a vwap of 8
+    strs.clear();
+    for (int i = 0; i < 1000; ++i) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%.2f;%d;%lld;%d;%.8f;%s", 2800 + (rand()%400)*0.25, 1 + rand()%20,
+                1548950400000LL + rand(), rand(), 2800 + rand()/(double)RAND_MAX, rand()%2? "true" : "false");
+        strs.push_back(buf);
+    }
+    const int N = 1000000;
+    double sum = 0;
+    uint64_t t0 = TimeUtil::cur_time_micro();
+    for (int i = 0; i < N; ++i) {
+        double price;
+        int size;
+        oldParse(strs[i % strs.size()], price, size);
+        sum += price + size;
+    }
+    uint64_t t1 = TimeUtil::cur_time_micro();
+    for (int i = 0; i < N; ++i) {
+        RtVolume rv;
+        rv.parse(strs[i % strs.size()]);
+        sum += rv.price + rv.size;
+    }
+    uint64_t t2 = TimeUtil::cur_time_micro();
+    printf("sscanf %.1lf ns, RtVolume::parse %.1lf ns per string (%g)\n",
+            (t1 - t0)*1000.0/N, (t2 - t1)*1000.0/N, sum);
+    return fails? 1 : 0;
+}
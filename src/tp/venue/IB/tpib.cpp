@@ -15,7 +15,7 @@
 
 #include "tpib.hpp"
 
-tp::TPIB* ibclient;
+tp::TPIBShards* ibclient;
 volatile bool user_stopped = false;
 
 void sig_handler(int signo)
@@ -39,9 +39,9 @@ int main(int argc, char**argv) {
     }
     utils::PLCC::instance("tpib");
     if (argc>1) {
-    	ibclient=new tp::TPIB(atoi(argv[1]));
+    	ibclient=new tp::TPIBShards(atoi(argv[1]));
     } else {
-    	ibclient=new tp::TPIB();
+    	ibclient=new tp::TPIBShards();
     }
     ibclient->run();
     delete ibclient;
@@ -19,7 +19,11 @@
 
 #include "IBClientBase.hpp"
 #include "IBContract.hpp"
+#include "rtvolume.hpp"
+#include "mddecoder.hpp"
+#include "latency.hpp"
 #include "circular_buffer.h"
+#include "thread_utils.h"
 #include "plcc/PLCC.hpp"
 
 namespace tp {
@@ -27,9 +31,12 @@ typedef BookQ<utils::ShmCircularBuffer> IBBookQType;
 typedef IBBookQType::Writer BookWriter;
 typedef IBBookQType::Reader BookReader;
 
-class TPIB : public ClientBaseImp {
+// final for MdDecoder<TPIB> to call the market data callbacks directly
+class TPIB final : public ClientBaseImp {
 private:
+    friend class MdDecoder<TPIB>;
     int _client_id;
+    const int _client_id_step;             // the number of shards
     const std::vector<std::string> _symL1; // the front contract l1 symbols
     const std::vector<std::string> _symL1n;// the back contract l1 symbols
     const std::vector<std::string> _symL2;
@@ -38,25 +45,54 @@ private:
     int _port;
     std::vector<IBBookQType*> _book_queue;
     std::vector<IBBookQType*> _book_queue_l1_to_l2;
+    std::vector<RtVolume> _rt_volume;  // the latest RT_VOLUME of each L1 ticker
+    LatencyStats* _latency;            // NULL if TPIBLatency is 0
+    const bool _own_latency;           // false if of TPIBShards
+    std::vector<int> _lat_sym;         // latency symbol of each ticker
+    const int _cpu;                    // to pin the thread of run(), -1 not to
+    const std::string _name;           // for logging, TPIB or TPIB shard n
+    bool _warm_restart;                // TPIBWarmRestart, see md_subscribe()
     BookReader* _book_reader;  // the first L2 (or L1 if no L2) symbol
                                // for health check.  IB have problem with
                                // L2 subscription after mid night restart.
                                // No error can be detected so far.
     std::string _book_reader_sym; // the symbol for logging purpose
     volatile bool _should_run;
+    volatile bool _stopped;     // run() returned
     int64_t _last_check_micro;  // this is used to guard against no any update
                                 // and therefore cannot get the upd_micro
                                 // initialized to start up micro
     void md_subscribe(const std::vector<std::string>&symL1,  // includes both l1 front and back contracts
 					  const std::vector<std::string>&symL2) {
-    	clearBookQueue();
+    	if (_warm_restart && (_book_queue.size() > 0)) {
+    		// reconnected, the queues and books go on, see markStale()
+    		for (auto q : _book_queue) {
+    			q->theWriter().markStale();
+    		}
+    	} else {
+    		newBookQueue(symL1, symL2);
+    	}
+    	// ticker ids of this connection, in the order of the queues
+    	_next_tickerid = TickerStart;
     	// want live data
     	m_pClient->reqMarketDataType(1);
     	// L1, including the front and back contracts
+        for (const auto& s : symL1) {
+            reqMDL1(s.c_str(), _next_tickerid++);
+        }
+        // L2
+        for (const auto& s : symL2) {
+            reqMDL2(s.c_str(), _next_tickerid++);
+        }
+    }
+
+    void newBookQueue(const std::vector<std::string>&symL1,
+    		          const std::vector<std::string>&symL2) {
+    	clearBookQueue();
+    	// L1, including the front and back contracts
         for (const auto& s : symL1) {
         	auto bp = new IBBookQType(BookConfig(s,"L1"),false);
         	_book_queue.push_back(bp);
-            reqMDL1(s.c_str(), _next_tickerid++);
         }
 
         // L2
@@ -69,7 +105,23 @@ private:
         		_book_reader = bp->newReader();
         		_book_reader_sym = symL2[0];
         	}
-            reqMDL2(s.c_str(), _next_tickerid++);
+        }
+
+        // the books of the previous run, the queues are never zeroed
+        // so the readers go on as well
+        if (_warm_restart) {
+        	for (auto q : _book_queue) {
+        		const bool seeded = q->theWriter().seedFromQ();
+        		logInfo("%s warm restart %s %s", _name.c_str(), q->_cfg.qname().c_str(),
+        				seeded? "seeded from the queue" : "without a valid book in the queue");
+        	}
+        }
+
+        _rt_volume.assign(symL1.size(), RtVolume());
+
+        _lat_sym.clear();
+        for (const auto q : _book_queue) {
+        	_lat_sym.push_back(_latency? _latency->addSymbol(q->_cfg.qname()) : -1);
         }
 
         if ((!_book_reader) && (_book_queue.size() > 0)) {
@@ -182,15 +234,65 @@ private:
 
 public:
     static const int TickerStart = 2;  // this is the tickerid starts
+    static const int DefaultWaitMilli = 10;
     explicit TPIB (int client_id = 0) :
+    		ClientBaseImp(waitMilli()),
     		_client_id(client_id?client_id:plcc_getInt("TPIBClientId")),
+    		_client_id_step(1),
     		_symL1(plcc_getStringArr("SubL1")),
     		_symL1n(plcc_getStringArr("SubL1n")),
 			_symL2(plcc_getStringArr("SubL2")),
 			_next_tickerid(TickerStart),
 			_ipAddr("127.0.0.1"), _port(0),
-			_book_reader(NULL), _should_run(false),
+			_latency(NULL), _own_latency(true), _cpu(-1), _name("TPIB"),
+			_book_reader(NULL), _should_run(true), _stopped(false),
 			_last_check_micro(0) {
+        bool found;
+        init(plcc_getString("TPIBCapture", &found, ""));
+
+        // wire to queue latency, see latency.hpp
+        if (plcc_getInt("TPIBLatency", &found, 1)) {
+        	_latency = new LatencyStats();
+        }
+    }
+
+    // the shard of TPIBShards, with the client id client_id+shard, the
+    // symbols of the shard and the latency stats of all the shards
+    TPIB (int shard, int shards, int client_id,
+          const std::vector<std::string>& symL1,
+          const std::vector<std::string>& symL1n,
+          const std::vector<std::string>& symL2,
+          LatencyStats* latency, int cpu) :
+    		ClientBaseImp(waitMilli()),
+    		_client_id(client_id+shard),
+    		_client_id_step(shards),
+    		_symL1(symL1), _symL1n(symL1n), _symL2(symL2),
+			_next_tickerid(TickerStart),
+			_ipAddr("127.0.0.1"), _port(0),
+			_latency(latency), _own_latency(false), _cpu(cpu),
+			_name(std::string("TPIB shard ") + std::to_string(shard)),
+			_book_reader(NULL), _should_run(true), _stopped(false),
+			_last_check_micro(0) {
+        bool found;
+        const std::string capture = plcc_getString("TPIBCapture", &found, "");
+        init(capture.empty()? capture : capture + ".shard" + std::to_string(shard));
+    }
+
+private:
+    // up to how long processMessages() blocks on the messages, of the
+    // reader thread or of the direct dispatch without busy poll.  The
+    // loop of run() checks the books and _should_run in between
+    static int waitMilli() {
+        bool found;
+        const int milli = plcc_getInt("TPIBWaitMilli", &found, DefaultWaitMilli);
+        if (milli <= 0) {
+            logError("TPIB failed to run - TPIBWaitMilli(%d) should be positive", milli);
+            throw std::runtime_error("TPIB failed to run - TPIBWaitMilli not positive.");
+        }
+        return milli;
+    }
+
+    void init(const std::string& capture) {
         bool found1, found2;
         _ipAddr = plcc_getString("IBClientIP", &found1, "127.0.0.1");
         _port = plcc_getInt("IBClientPort", &found2, 0);
@@ -202,12 +304,25 @@ public:
         }
 
         if (!_symL1.size() && !_symL2.size()) {
-        	logError("TPIB started without subscription found!");
+        	logError("%s started without subscription found!", _name.c_str());
+        }
+
+        // decode on this thread, without the EReader thread
+        if (plcc_getInt("TPIBDirectDispatch")) {
+        	setDirectDispatch(true, plcc_getInt("TPIBBusyPoll") != 0);
         }
+        // the IB messages to replay by faketws
+        setCapture(capture);
 
-        logInfo("TPIB (%s:%d) initiated with client id %d.", _ipAddr.c_str(), _port, _client_id);
+        // go on with the books and queues of the previous run
+        bool found;
+        _warm_restart = (plcc_getInt("TPIBWarmRestart", &found, 0) != 0);
+
+        logInfo("%s (%s:%d) initiated with client id %d.", _name.c_str(), _ipAddr.c_str(), _port, _client_id);
     }
 
+public:
+
     void md_subscribe() {
     	std::vector<std::string> syml1 = _symL1;
     	for (const auto& s : _symL1n) {
@@ -221,52 +336,67 @@ public:
     // and start the infinite loop
     // which will update market data bookL2, read OrderQ, write Execution/events
     void run() {
+        if ((_cpu >= 0) && !utils::setThreadAffinity(_cpu)) {
+        	logError("%s cannot be pinned to cpu %d", _name.c_str(), _cpu);
+        }
         // connect
-        logInfo("TPIB started.");
-        _should_run = true;
+        logInfo("%s started.", _name.c_str());
         while (_should_run) {
             if (!connect(_ipAddr.c_str(), _port, _client_id)) {
-                _client_id+=1;
+                // the other shards have the ids in between
+                _client_id+=_client_id_step;
                 _port = IBPortSwitch(_port);
                 sleep(2);
                 continue;
             }
             md_subscribe();
+            // the market data decoded into this directly
+            MdDecoder<TPIB> md_decoder(*this, m_pReader->decoder());
             // enter into the main loop
             const int64_t stale_micro = 30*1000*1000LL;
             _last_check_micro = utils::TimeUtil::cur_time_gmt_micro();
             uint64_t check_micro =  _last_check_micro + stale_micro/2;
             while (isConnected() && _should_run) {
-            	processMessages();
+            	processMessages(md_decoder);
             	if (utils::TimeUtil::cur_time_gmt_micro() > check_micro) {
             		if (__builtin_expect(!checkL2(stale_micro), 0)) {
             			disconnect();
             			_should_run = false;
             			break;
             		}
+            		if (_latency) {
+            			_latency->touch();
+            		}
             		check_micro += stale_micro/2;
             	}
             }
-            logInfo("TPIB disconnected.");
+            logInfo("%s disconnected.", _name.c_str());
         }
-        logInfo("TPIB stopped.");
+        logInfo("%s stopped.", _name.c_str());
+        _stopped = true;
+    }
+
+    // for utils::ThreadWrapper
+    void run(void*) {
+    	run();
     }
 
     void stop() {
-        logInfo("Stopping TPIB.");
+        logInfo("Stopping %s.", _name.c_str());
         _should_run = false;
     }
 
+    bool stopped() const {
+    	return _stopped;
+    }
+
     void clearBookQueue() {
         for (auto q : _book_queue) {
         	if (q)
         		delete(q);
         }
         _book_queue.clear();
-        for (auto q : _book_queue_l1_to_l2) {
-        	if (q)
-        		delete(q);
-        }
+        // of _book_queue
         _book_queue_l1_to_l2.clear();
         if (_book_reader) {
         	delete _book_reader;
@@ -277,14 +407,30 @@ public:
 
     ~TPIB() {
     	clearBookQueue();
+    	if (_own_latency) {
+    		delete _latency;
+    	}
     }
 
     // Market Data Stuff
     // position - level in bookL2
     // operation - 0 insert, 1 update, 2 delete
     // side - 0 ask, 1 bid
+    // the latency of the update of ticker id, decoded at decoded_ns and
+    // queued now
+    void stampLatency(TickerId id, int64_t decoded_ns) {
+    	if (_latency && ((size_t)(id-TickerStart) < _lat_sym.size())) {
+    		_latency->add(_lat_sym[id-TickerStart], m_pReader->msgRecvTime(), decoded_ns, LatencyStats::nowNanos());
+    	}
+    }
+
+    int64_t decodedNanos() const {
+    	return _latency? LatencyStats::nowNanos() : 0;
+    }
+
     void updateMktDepth(TickerId id, int position, int operation, int side,
                                           double price, int size) {
+        const int64_t decoded_ns = decodedNanos();
         // log the ticks
         unsigned long long tm = utils::TimeUtil::cur_time_gmt_micro();
         logDebug("TPIB updateMktDepth: %llu %d %d %d %d %.7lf %d\n",
@@ -296,14 +442,17 @@ public:
         case 0: // new
     		logDebug("new %s %d %f\n", is_bid?"Bid":"Offer",(int)position, price);
             _book_queue[id-TickerStart]->theWriter().newPrice(price, size, position, is_bid, tm);
+            stampLatency(id, decoded_ns);
             break;
         case 1: // update
     		logDebug("upd %s %d %f %d\n", is_bid?"Bid":"Offer",(int)position, price, size);
         	_book_queue[id-TickerStart]->theWriter().updPrice(price, size, position, is_bid, tm);
+            stampLatency(id, decoded_ns);
             break;
         case 2: // del
     		logDebug("del %s %d\n", is_bid?"Bid":"Offer",(int)position);
         	_book_queue[id-TickerStart]->theWriter().delPrice(position, is_bid, tm);
+            stampLatency(id, decoded_ns);
             break;
         default:
             logError("IBClient received unknown operation %d", operation);
@@ -311,6 +460,7 @@ public:
     }
 
     void tickPrice(TickerId id, TickType field, double price, const TickAttrib& attribs) {
+        const int64_t decoded_ns = decodedNanos();
         logDebug("TPIB tickPrice: %llu %d %d %.7lf",
                 utils::TimeUtil::cur_time_gmt_micro(), (int)(id), (int) field, price);
         switch (field) {
@@ -318,6 +468,7 @@ public:
         case ASK : {
             bool is_bid = (field == BID?true:false);
             _book_queue[id-TickerStart]->theWriter().updBBOPriceOnly(price, is_bid, utils::TimeUtil::cur_time_gmt_micro());
+            stampLatency(id, decoded_ns);
             break;
         }
         case LAST :
@@ -335,6 +486,7 @@ public:
     }
 
     void tickSize(TickerId id, TickType field, int size) {
+        const int64_t decoded_ns = decodedNanos();
         logDebug("TPIB tickSize: %llu %d %d %d",
                 utils::TimeUtil::cur_time_gmt_micro(), (int)(id), (int) field, size);
         switch (field) {
@@ -342,6 +494,7 @@ public:
         case ASK_SIZE : {
             bool is_bid = (field == BID_SIZE?true:false);
             _book_queue[id-TickerStart]->theWriter().updBBOSizeOnly(size, is_bid, utils::TimeUtil::cur_time_gmt_micro());
+            stampLatency(id, decoded_ns);
             break;
         }
         case LAST_SIZE :
@@ -376,17 +529,22 @@ public:
     void tickString(TickerId id, TickType tickType, const std::string& value) {
         //ClientBaseImp::tickString(id, tickType, value);
         if (tickType == RT_VOLUME) {
-            //bool multi_fill = false;
-            double price = 0;
-            int size = 0;
-            char buf[16];
-            buf[0] = 0;
-            int num_read = 0;
-            sscanf(value.c_str(), "%lf;%d;%*d;%*d;%*f;%s%n", &price, &size, buf, &num_read);
-            //if (num_read >= 3) {
-            //    multi_fill = (buf[0] == 't');
-            //}
-            logDebug("RT_VOLUME: %.7lf %d",price, size);
+            const int64_t decoded_ns = decodedNanos();
+            RtVolume rv;
+            if (__builtin_expect(!rv.parse(value), 0)) {
+            	logError("TPIB RT_VOLUME parse error: %s", value.c_str());
+            	return;
+            }
+            if (__builtin_expect((size_t)(id-TickerStart) < _rt_volume.size(), 1)) {
+            	_rt_volume[id-TickerStart] = rv;
+            }
+            logDebug("RT_VOLUME: %s", rv.toString().c_str());
+            if (!rv.has_price) {
+            	// volume only, no trade to the book
+            	return;
+            }
+            const double price = rv.price;
+            const int size = rv.size;
             auto& writer (_book_queue[id-TickerStart]->theWriter());
             if(__builtin_expect(!writer.updTrade(price, size),0)) {
             	logError("TPIB update trade error [RT_VOLUME price(%.7lf) size(%d)] Book:  %s",
@@ -409,11 +567,18 @@ public:
 					// Same the L2 Delta recording feeds
 					q->theWriter().updTradeFromL1(price, size, bookL1);
 				}
+				stampLatency(id, decoded_ns);
             }
             return;
         }
     }
 
+    // the latest RT_VOLUME of a L1 ticker, with the time, the day's
+    // volume and VWAP that are not in the book
+    const RtVolume& getRtVolume(TickerId id) const {
+    	return _rt_volume[id-TickerStart];
+    }
+
     void tickByTickBidAsk(int reqId, time_t time, double bidPrice, double askPrice, int bidSize, int askSize, const TickAttrib& attribs) {
         logInfo("Tick-By-Tick. ReqId: %d, TickType: BidAsk, Time: %s, BidPrice: %g, AskPrice: %g, BidSize: %d, AskSize: %d, BidPastLow: %d, AskPastHigh: %d",
             reqId, ctime(&time), bidPrice, askPrice, bidSize, askSize, attribs.bidPastLow, attribs.askPastHigh);
@@ -436,7 +601,12 @@ public:
             break;
         case 317:  // reset depth of book
         {
-        	_book_queue[id-TickerStart]->theWriter().resetBook();
+        	// warm, the book stays until the depth comes again
+        	if (_warm_restart) {
+        		_book_queue[id-TickerStart]->theWriter().markStale();
+        	} else {
+        		_book_queue[id-TickerStart]->theWriter().resetBook();
+        	}
             logInfo("TPIB reset book %s", _book_queue[id-TickerStart]->_cfg.toString().c_str());
             break;
         }
@@ -475,4 +645,129 @@ public:
 
 };
 
+// tpib over TPIBShards IB connections.  The symbols are dealt to the
+// shards, each a TPIB of its own client id (TPIBClientId + shard),
+// EReader, book queues, health check and thread, pinned to its cpu of
+// TPIBShardCPU if given, so the bursts of the symbols of one shard don't
+// hold the others.  A shard stopping, on its health check or a lost
+// connection, stops all as tpib of one connection does.  One shard is
+// the TPIB of before, run on the calling thread.
+//
+//     TPIBShards   = 2
+//     TPIBShardCPU = [2,3]
+class TPIBShards {
+public:
+	explicit TPIBShards(int client_id = 0) : _latency(NULL), _should_run(true) {
+		bool found;
+		int shards = plcc_getInt("TPIBShards", &found, 1);
+		const std::vector<std::string> symL1 = plcc_getStringArr("SubL1");
+		const std::vector<std::string> symL1n = plcc_getStringArr("SubL1n");
+		const std::vector<std::string> symL2 = plcc_getStringArr("SubL2");
+		const std::map<std::string, int> shard_of = dealSymbols(symL1, symL1n, symL2, shards);
+		if (shards <= 1) {
+			_shard.push_back(new TPIB(client_id));
+			return;
+		}
+		if (plcc_getInt("TPIBLatency", &found, 1)) {
+			_latency = new LatencyStats();
+		}
+		const std::vector<std::string> cpus = plcc_getStringArr("TPIBShardCPU");
+		if (!client_id) {
+			client_id = plcc_getInt("TPIBClientId");
+		}
+		for (int k = 0; k < shards; ++k) {
+			_shard.push_back(new TPIB(k, shards, client_id,
+					symbolsOf(symL1, shard_of, k), symbolsOf(symL1n, shard_of, k),
+					symbolsOf(symL2, shard_of, k), _latency,
+					k < (int)cpus.size()? atoi(cpus[k].c_str()) : -1));
+			_thread.push_back(new utils::ThreadWrapper<TPIB>(*_shard.back()));
+		}
+		logInfo("TPIB in %d shards", shards);
+	}
+
+	~TPIBShards() {
+		for (auto t : _thread) {
+			delete t;
+		}
+		for (auto s : _shard) {
+			delete s;
+		}
+		delete _latency;
+	}
+
+	// until stop() or a shard stops
+	void run() {
+		if (_thread.empty()) {
+			_shard[0]->run();
+			return;
+		}
+		for (auto t : _thread) {
+			t->run(NULL);
+		}
+		while (_should_run) {
+			for (auto s : _shard) {
+				if (s->stopped()) {
+					_should_run = false;
+				}
+			}
+			usleep(100*1000);
+		}
+		for (auto s : _shard) {
+			s->stop();
+		}
+		for (auto t : _thread) {
+			t->join();
+		}
+	}
+
+	void stop() {
+		_should_run = false;
+		for (auto s : _shard) {
+			s->stop();
+		}
+	}
+
+private:
+	std::vector<TPIB*> _shard;
+	std::vector<utils::ThreadWrapper<TPIB>*> _thread;
+	LatencyStats* _latency;
+	volatile bool _should_run;
+
+	// the shard of each symbol, round robin in the order of the L2
+	// symbols, the busiest, then the L1 only ones.  A symbol's L1 and L2
+	// are of the same shard, for the L1 trades to reach the L2 queue.
+	// No more shards than symbols.
+	static std::map<std::string, int> dealSymbols(const std::vector<std::string>& symL1,
+			const std::vector<std::string>& symL1n, const std::vector<std::string>& symL2, int& shards) {
+		std::vector<std::string> order;
+		std::map<std::string, int> shard_of;
+		for (const auto* syms : { &symL2, &symL1, &symL1n }) {
+			for (const auto& s : *syms) {
+				if (shard_of.insert(std::make_pair(s, 0)).second) {
+					order.push_back(s);
+				}
+			}
+		}
+		if ((shards > 1) && ((int)order.size() < shards)) {
+			logError("TPIB %d shards for %d symbols, using %d", shards, (int)order.size(), (int)order.size());
+			shards = (int)order.size();
+		}
+		for (size_t i = 0; i < order.size(); ++i) {
+			shard_of[order[i]] = (shards > 1)? (int)(i % shards) : 0;
+		}
+		return shard_of;
+	}
+
+	static std::vector<std::string> symbolsOf(const std::vector<std::string>& syms,
+			const std::map<std::string, int>& shard_of, int shard) {
+		std::vector<std::string> ret;
+		for (const auto& s : syms) {
+			if (shard_of.find(s)->second == shard) {
+				ret.push_back(s);
+			}
+		}
+		return ret;
+	}
+};
+
 }
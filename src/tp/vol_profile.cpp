@@ -0,0 +1,196 @@
+#include <volprof.hpp>
+#include <l2query.hpp>
+#include <epoll_util.h>
+
+#include <string>
+#include <iostream>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace tp;
+using namespace utils;
+using namespace std;
+
+typedef BookQ<ShmCircularBuffer> BookQType;
+
+volatile bool user_stopped = false;
+
+void sig_handler(int signo)
+{
+  if (signo == SIGINT || signo == SIGTERM) {
+    printf("Received signal, exiting...\n");
+  }
+  user_stopped = true;
+}
+
+// the L1 queues of SubL1 and SubL1n as tickrec, or the given ones
+std::vector<BookConfig> getBookConfigs(int argc, char** argv, int arg) {
+	std::vector<BookConfig> bcfg;
+	if (argc > arg) {
+		for (; arg < argc; ++arg) {
+			const std::string spec(argv[arg]);
+			const bool isbc = (spec.size() > 4) && (spec.substr(spec.size()-4) == ":L1n");
+			bcfg.push_back(BookConfig(isbc? spec.substr(0, spec.size()-4) : spec, "L1", isbc));
+		}
+		return bcfg;
+	}
+	for (const auto& sym : plcc_getStringArr("SubL1")) {
+		bcfg.push_back(BookConfig(sym, "L1"));
+	}
+	for (const auto& sym : plcc_getStringArr("SubL1n")) {
+		bcfg.push_back(BookConfig(sym, "L1", true));
+	}
+	return bcfg;
+}
+
+// the file tickrecL2 records the trades of a L1 queue to, the L2 one
+// if the symbol is also in SubL2
+BookConfig getRecordedConfig(const BookConfig& bcfg) {
+	const std::vector<std::string> symL2(plcc_getStringArr("SubL2"));
+	const std::string sym(bcfg.venue + "/" + bcfg.symbol);
+	if (std::find(symL2.begin(), symL2.end(), sym) != symL2.end()) {
+		return BookConfig(sym, "L2", bcfg.isbc);
+	}
+	return bcfg;
+}
+
+// trades of the session so far from the recorded file, returns the
+// latest update time replayed, before the session start if none
+int64_t warmUp(VolProfile& vp, int64_t cur_micro) {
+	vp.onTime(cur_micro);
+	const int64_t session_micro = vp.getData().session_start_micro;
+	const BookConfig fcfg(getRecordedConfig(vp.getBookConfig()));
+	struct stat fs;
+	if (stat(fcfg.L2fname().c_str(), &fs) != 0) {
+		logInfo("VolProfile %s: no recorded file %s, from the queue only",
+				vp.getBookConfig().toString().c_str(), fcfg.L2fname().c_str());
+		return session_micro - 1;
+	}
+	struct Handler {
+		VolProfile& vp;
+		int64_t last_ts;
+		void onBook(const BookDepot& book) {
+			vp.onBook(book);
+			last_ts = (int64_t)book.update_ts_micro;
+		}
+	} handler = {vp, session_micro - 1};
+	L2BookQuery query(fcfg, 1);
+	const long long cnt = query.replay(vp.getData().session_start_micro, cur_micro, handler);
+	logInfo("VolProfile %s: %lld books warmed up from %s, %lld trades",
+			vp.getBookConfig().toString().c_str(), cnt, fcfg.L2fname().c_str(),
+			(long long)vp.getData().trades);
+	return handler.last_ts;
+}
+
+// prints the profile written by a running volprof
+int query(const BookConfig& bcfg, int argc, char** argv, int arg) {
+	VolProfileReader vp(bcfg);
+	printf("%s: %s\n", bcfg.toString().c_str(), vp.getStat().toString().c_str());
+	for (; arg < argc; ++arg) {
+		const Price px = atof(argv[arg]);
+		printf("  %.7lf: at(%lld) at_or_above(%lld) at_or_below(%lld)\n", px,
+				(long long)vp.volAt(px), (long long)vp.volAtOrAbove(px), (long long)vp.volAtOrBelow(px));
+	}
+	return 0;
+}
+
+int main(int argc, char**argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [-n] [venue/symbol[:L1n] ...]\n", argv[0]);
+        printf("       %s -q venue/symbol[:L1n] [price ...]\n", argv[0]);
+        printf("    writes the session volume profile and VWAP of the L1 queues to shm <L2stem>_VP,\n");
+        printf("    SubL1 and SubL1n if no symbol given, warmed up from the recorded files unless -n.\n");
+        printf("    -q prints the profile and the volume at/through the prices.\n");
+        return 0;
+    }
+    int arg = 1;
+    bool warm = true;
+    if (argc > arg+1 && strcmp(argv[arg], "-q") == 0) {
+    	utils::PLCC::instance("volprof");
+    	return query(getBookConfigs(arg+2, argv, arg+1)[0], argc, argv, arg+2);
+    }
+    if (argc > arg && strcmp(argv[arg], "-n") == 0) {
+    	warm = false;
+    	++arg;
+    }
+
+    if ((signal(SIGINT, sig_handler) == SIG_ERR) ||
+    	(signal(SIGTERM, sig_handler) == SIG_ERR))
+    {
+            printf("\ncan't catch SIGINT\n");
+            return -1;
+    }
+    utils::PLCC::instance("volprof");
+    const std::vector<BookConfig> bcfg(getBookConfigs(argc, argv, arg));
+    if (bcfg.size() == 0) {
+    	throw std::runtime_error("No L1 symbol in config");
+    }
+
+    // with the warm up the readers start at the oldest update of the
+    // queue, taken before the recorded file is read, so the trades not
+    // recorded yet by tickrecL2 are read from the queue.  The books of
+    // the queue not later than the replayed ones, or of a previous
+    // session, are skipped
+    std::vector<VolProfile*> vps;
+    std::vector<BookQType*> qs;
+    std::vector<BookQType::Reader*> readers;
+    std::vector<int64_t> skip_ts;
+    const int64_t start_micro = (int64_t)TimeUtil::cur_time_micro();
+    for (const auto& cfg : bcfg) {
+    	vps.push_back(new VolProfile(cfg));
+    	qs.push_back(new BookQType(cfg, true));
+    	readers.push_back(qs.back()->newReader());
+    	if (warm) {
+    		readers.back()->seekToOldest();
+    		skip_ts.push_back(warmUp(*vps.back(), start_micro));
+    	} else {
+    		BookDepot book;
+    		readers.back()->getLatestUpdateAndAdvance(book);
+    		skip_ts.push_back(0);
+    	}
+    }
+
+    bool found = false;
+    int poll_milli = plcc_getInt("QueuePollMilli", &found);
+    if (!found) {
+    	poll_milli = 1;
+    }
+    // expires the rolling window every second without a trade
+    TimerFd sec_timer;
+    sec_timer.setAbsMicro((start_micro/1000000LL + 1)*1000000LL, 1000000LL);
+    Epoll ep;
+    ep.add(sec_timer.fd(), EPOLLIN, 0);
+
+    long long cnt = 0;
+    BookDepot book;
+    while (!user_stopped) {
+    	bool has_update = false;
+    	for (size_t i = 0; i < readers.size(); ++i) {
+    		if (readers[i]->getNextUpdate(book)) {
+    			has_update = true;
+    			if ((int64_t)book.update_ts_micro > skip_ts[i]) {
+    				vps[i]->onBook(book);
+    				++cnt;
+    			}
+    		}
+    	}
+    	if (ep.wait(has_update? 0 : poll_milli) > 0) {
+    		sec_timer.read();
+    		const int64_t now = (int64_t)TimeUtil::cur_time_micro();
+    		for (auto vp : vps) {
+    			vp->onTime(now);
+    		}
+    	}
+    }
+    for (size_t i = 0; i < vps.size(); ++i) {
+    	VolProfileReader reader(bcfg[i]);
+    	printf("%s: %s\n", bcfg[i].toString().c_str(), reader.getStat().toString().c_str());
+    	delete readers[i];
+    	delete qs[i];
+    	delete vps[i];
+    }
+    printf("%lld books. Done.\n", cnt);
+    return 0;
+}
@@ -0,0 +1,442 @@
+/*
+ * volprof.hpp
+ *
+ * Volume at price and the VWAP of a symbol, per session, in a shared
+ * memory segment <L2stem>_VP (i.e. NYM_CL_L1_VP) written by volprof
+ * from the trades of the book queue and read by floor and the models.
+ *
+ * The histogram is indexed by tick, VolProfTicks ticks of VolTick
+ * centered at the first trade of the session.  A trade out of the range
+ * is counted at the edge tick (and in clamped).  cum_vol[i] is the volume
+ * at or below tick i, updated on each trade up to the highest traded tick,
+ * so the volume traded at or through a price is one lookup.
+ *
+ * The session is the trading day starting at TradeDayStartHour (local),
+ * the profile is reset by the first trade or time of the next one.  The
+ * rolling VWAP is of the last VolRollSec seconds in one second buckets.
+ * All of the times are the book's update_ts_micro.
+ *
+ * The writer updates under a seqlock, seq is odd during an update.  A
+ * reader copies what it needs and retries until seq is even and the same
+ * before and after the copy.  As the queues, it relies on the x86 store
+ * and load order with compiler barriers.  A writer killed during an
+ * update leaves seq odd, the next writer makes it even again, and a
+ * reader gives up after VolReadTries, the queries then return 0.
+ *
+ * Configurations:
+ *     VolTick      = 0.01    (tick size, VolTick_<L2stem> per symbol)
+ *     VolRollSec   = 300
+ */
+
+#pragma once
+
+#include "bookL2.hpp"
+#include "shm_util.h"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <sched.h>
+
+namespace tp {
+
+static const int VolProfTicks = 8192;
+static const uint32_t VolProfVersion = 1;
+static const int VolReadSpins = 1000;     // before yielding to the writer
+static const int VolReadTries = 100000;
+
+struct VolProfData {
+	char magic[8];            // "KRVPROF"
+	uint32_t version;
+	int32_t nticks;
+	volatile uint64_t seq;    // odd during an update
+	double tick_size;
+	double base_px;           // price of tick 0, 0 before the first trade
+	int32_t trade_day;        // yyyymmdd of the session
+	int32_t roll_sec;
+	int64_t session_start_micro;
+	int64_t update_micro;     // latest trade or time
+	int64_t trades;
+	int64_t vol;
+	int64_t buy_vol;
+	int64_t sell_vol;
+	int64_t clamped;          // volume of the trades out of the tick range
+	double notional;          // sum of price*size
+	int64_t roll_vol;
+	double roll_notional;
+	double last_px;
+	int32_t lo_tick;          // traded tick range, -1 if no trade
+	int32_t hi_tick;
+	int64_t tick_vol[VolProfTicks];
+	int64_t cum_vol[VolProfTicks];  // volume at or below tick i, up to hi_tick
+
+	// tick of px, clamped to the range
+	int tickOf(Price px) const {
+		const long long t = llround((px - base_px)/tick_size);
+		return t < 0? 0 : (t >= nticks? nticks-1 : (int) t);
+	}
+
+	Price priceOf(int tick) const {
+		return base_px + tick*tick_size;
+	}
+
+	// volume at or below tick
+	int64_t cumAt(int tick) const {
+		if ((hi_tick < 0) || (tick < lo_tick)) {
+			return 0;
+		}
+		return cum_vol[tick < hi_tick? tick : hi_tick];
+	}
+};
+
+// consistent copy of the totals of a profile
+struct VolProfStat {
+	int32_t trade_day;
+	int64_t session_start_micro;
+	int64_t update_micro;
+	int64_t trades;
+	int64_t vol;
+	int64_t buy_vol;
+	int64_t sell_vol;
+	double vwap;              // 0 if no trade
+	double roll_vwap;         // 0 if no trade in the window
+	double last_px;
+	double low_px;
+	double high_px;
+
+	std::string toString() const {
+		char buf[256];
+		snprintf(buf, sizeof(buf), "day(%d) trades(%lld) vol(%lld) buy(%lld) sell(%lld) "
+				"vwap(%.7lf) roll_vwap(%.7lf) last(%.7lf) low(%.7lf) high(%.7lf)",
+				trade_day, (long long)trades, (long long)vol, (long long)buy_vol,
+				(long long)sell_vol, vwap, roll_vwap, last_px, low_px, high_px);
+		return std::string(buf);
+	}
+};
+
+static inline
+std::string volProfShmName(const BookConfig& bcfg) {
+	return bcfg.L2stem() + "_VP";
+}
+
+class VolProfile {
+public:
+	explicit VolProfile(const BookConfig& bcfg) :
+		_bcfg(bcfg),
+		_shm(volProfShmName(bcfg), sizeof(VolProfData), false),
+		_d((VolProfData*)_shm.ptr()),
+		_roll_sec(getCfg("VolRollSec", 300)),
+		_start_hour(tradeDayStartHour()),
+		_roll(_roll_sec),
+		_roll_last(0),
+		_session_end_micro(0)
+	{
+		const double tick = getTick(bcfg);
+		if (_roll_sec <= 0) {
+			throw std::runtime_error("VolRollSec should be positive");
+		}
+		// all but seq, a reader of a previous run retries meanwhile.
+		// seq is odd if the previous writer died in an update
+		_d->seq = (_d->seq | 1) + 1;
+		begin();
+		const size_t seq_end = offsetof(VolProfData, seq) + sizeof(_d->seq);
+		memset((char*)_d, 0, offsetof(VolProfData, seq));
+		memset((char*)_d + seq_end, 0, sizeof(VolProfData) - seq_end);
+		strcpy(_d->magic, "KRVPROF");
+		_d->version = VolProfVersion;
+		_d->nticks = VolProfTicks;
+		_d->tick_size = tick;
+		_d->roll_sec = _roll_sec;
+		_d->lo_tick = -1;
+		_d->hi_tick = -1;
+		end();
+	}
+
+	// trades only, books of other updates are ignored
+	void onBook(const BookDepot& book) {
+		if ((book.update_type != 2) || !book.isValidTrade()) {
+			return;
+		}
+		const int64_t ts = (int64_t)book.update_ts_micro;
+		begin();
+		if (ts >= _session_end_micro) {
+			newSession(ts);
+		}
+		const int64_t sec = ts/1000000LL;
+		rollTo(sec);
+		const Price px = book.trade_price;
+		const int64_t sz = book.trade_size;
+		if (_d->hi_tick < 0) {
+			_d->base_px = (llround(px/_d->tick_size) - VolProfTicks/2)*_d->tick_size;
+		}
+		const long long t = llround((px - _d->base_px)/_d->tick_size);
+		if ((t < 0) || (t >= VolProfTicks)) {
+			_d->clamped += sz;
+		}
+		const int k = _d->tickOf(px);
+		if (k > _d->hi_tick) {
+			// the ticks above the old high have the volume so far
+			for (int i = (_d->hi_tick < 0? k : _d->hi_tick+1); i <= k; ++i) {
+				_d->cum_vol[i] = _d->vol;
+			}
+			_d->hi_tick = k;
+		}
+		if ((_d->lo_tick < 0) || (k < _d->lo_tick)) {
+			_d->lo_tick = k;
+		}
+		for (int i = k; i <= _d->hi_tick; ++i) {
+			_d->cum_vol[i] += sz;
+		}
+		_d->tick_vol[k] += sz;
+		++_d->trades;
+		_d->vol += sz;
+		if (book.trade_attr == 0) {
+			_d->buy_vol += sz;
+		} else if (book.trade_attr == 1) {
+			_d->sell_vol += sz;
+		}
+		_d->notional += px*sz;
+		if (sec > _roll_last - _roll_sec) {
+			// a trade older than the window, i.e. of the warm up, is not rolled
+			RollBucket& b(_roll[sec % _roll_sec]);
+			b.vol += sz;
+			b.notional += px*sz;
+			_d->roll_vol += sz;
+			_d->roll_notional += px*sz;
+		}
+		_d->last_px = px;
+		_d->update_micro = ts;
+		end();
+	}
+
+	// expires the rolling window and the session without a trade
+	void onTime(int64_t cur_micro) {
+		begin();
+		if (cur_micro >= _session_end_micro) {
+			newSession(cur_micro);
+		}
+		rollTo(cur_micro/1000000LL);
+		if (cur_micro > _d->update_micro) {
+			_d->update_micro = cur_micro;
+		}
+		end();
+	}
+
+	const VolProfData& getData() const {
+		return *_d;
+	}
+
+	const BookConfig& getBookConfig() const {
+		return _bcfg;
+	}
+
+	// per symbol VolTick_<L2stem>, otherwise VolTick
+	static double getTick(const BookConfig& bcfg) {
+		bool found = false;
+		double tick = plcc_getDouble(("VolTick_" + bcfg.L2stem()).c_str(), &found);
+		if (!found) {
+			tick = plcc_getDouble("VolTick", &found);
+		}
+		if (!found || (tick <= 0)) {
+			logError("no positive VolTick for %s", bcfg.toString().c_str());
+			throw std::runtime_error(std::string("no positive VolTick for ") + bcfg.toString());
+		}
+		return tick;
+	}
+
+private:
+	struct RollBucket {
+		int64_t vol;
+		double notional;
+		RollBucket() : vol(0), notional(0) {};
+	};
+
+	const BookConfig _bcfg;
+	utils::ShmSegment _shm;
+	VolProfData* const _d;
+	const int _roll_sec;
+	const int _start_hour;
+	std::vector<RollBucket> _roll;  // by utc second % _roll_sec
+	int64_t _roll_last;             // second of the latest bucket
+	int64_t _session_end_micro;
+
+	void begin() {
+		++_d->seq;
+		asm volatile("" ::: "memory");
+	}
+
+	void end() {
+		asm volatile("" ::: "memory");
+		++_d->seq;
+	}
+
+	void newSession(int64_t ts) {
+		const int day = utils::TimeUtil::utc_to_trade_day((time_t)(ts/1000000LL), _start_hour);
+		if (_d->hi_tick >= 0) {
+			memset(_d->tick_vol + _d->lo_tick, 0, (_d->hi_tick - _d->lo_tick + 1)*sizeof(int64_t));
+			memset(_d->cum_vol + _d->lo_tick, 0, (_d->hi_tick - _d->lo_tick + 1)*sizeof(int64_t));
+		}
+		_d->trade_day = day;
+		_d->session_start_micro = utils::TimeUtil::trade_day_start_utc(day, _start_hour)*1000000LL;
+		_d->update_micro = 0;
+		_d->trades = 0;
+		_d->vol = 0;
+		_d->buy_vol = 0;
+		_d->sell_vol = 0;
+		_d->clamped = 0;
+		_d->notional = 0;
+		_d->base_px = 0;
+		_d->last_px = 0;
+		_d->lo_tick = -1;
+		_d->hi_tick = -1;
+		_session_end_micro = utils::TimeUtil::trade_day_start_utc(day, _start_hour, 1)*1000000LL;
+		logInfo("VolProfile %s session %d", _bcfg.toString().c_str(), day);
+	}
+
+	// drops the buckets older than the window ending at sec
+	void rollTo(int64_t sec) {
+		if (sec <= _roll_last) {
+			return;
+		}
+		const int64_t from = (sec - _roll_last > _roll_sec)? sec - _roll_sec : _roll_last;
+		for (int64_t s = from + 1; s <= sec; ++s) {
+			RollBucket& b(_roll[s % _roll_sec]);
+			_d->roll_vol -= b.vol;
+			_d->roll_notional -= b.notional;
+			b = RollBucket();
+		}
+		if (_d->roll_vol == 0) {
+			// no drift of the notional from the subtractions
+			_d->roll_notional = 0;
+		}
+		_roll_last = sec;
+	}
+
+	static int getCfg(const char* key, int dflt) {
+		bool found = false;
+		const int val = plcc_getInt(key, &found);
+		return found? val : dflt;
+	}
+};
+
+// read only view of a profile written by volprof, the queries are O(1)
+class VolProfileReader {
+public:
+	explicit VolProfileReader(const BookConfig& bcfg) :
+		_shm(volProfShmName(bcfg), sizeof(VolProfData), true),
+		_d((const VolProfData*)_shm.ptr())
+	{
+		if ((strcmp(_d->magic, "KRVPROF") != 0) ||
+			(_d->version != VolProfVersion) || (_d->nticks != VolProfTicks)) {
+			logError("not a volume profile of version %u: %s", VolProfVersion, _shm.name().c_str());
+			throw std::runtime_error(std::string("not a volume profile: ") + _shm.name());
+		}
+	}
+
+	// session volume traded at or above px
+	int64_t volAtOrAbove(Price px) const {
+		int64_t v = 0;
+		if (!read([&](const VolProfData& d) {
+			v = (d.hi_tick < 0)? 0 : d.vol - d.cumAt(d.tickOf(px)-1);
+		})) {
+			v = 0;
+		}
+		return v;
+	}
+
+	// session volume traded at or below px
+	int64_t volAtOrBelow(Price px) const {
+		int64_t v = 0;
+		if (!read([&](const VolProfData& d) {
+			v = (d.hi_tick < 0)? 0 : d.cumAt(d.tickOf(px));
+		})) {
+			v = 0;
+		}
+		return v;
+	}
+
+	// session volume traded at the tick of px
+	int64_t volAt(Price px) const {
+		int64_t v = 0;
+		if (!read([&](const VolProfData& d) {
+			v = (d.hi_tick < 0)? 0 : d.tick_vol[d.tickOf(px)];
+		})) {
+			v = 0;
+		}
+		return v;
+	}
+
+	VolProfStat getStat() const {
+		VolProfStat st;
+		const bool ok = read([&](const VolProfData& d) {
+			st.trade_day = d.trade_day;
+			st.session_start_micro = d.session_start_micro;
+			st.update_micro = d.update_micro;
+			st.trades = d.trades;
+			st.vol = d.vol;
+			st.buy_vol = d.buy_vol;
+			st.sell_vol = d.sell_vol;
+			st.vwap = d.vol? d.notional/d.vol : 0;
+			st.roll_vwap = d.roll_vol? d.roll_notional/d.roll_vol : 0;
+			st.last_px = d.last_px;
+			st.low_px = (d.hi_tick < 0)? 0 : d.priceOf(d.lo_tick);
+			st.high_px = (d.hi_tick < 0)? 0 : d.priceOf(d.hi_tick);
+		});
+		if (!ok) {
+			memset(&st, 0, sizeof(st));
+		}
+		return st;
+	}
+
+	// copies the volume of the ticks [low_px, high_px] into vol,
+	// returns the price of the first one
+	Price getProfile(Price low_px, Price high_px, std::vector<int64_t>& vol) const {
+		Price px = 0;
+		const bool ok = read([&](const VolProfData& d) {
+			vol.clear();
+			if (d.hi_tick < 0) {
+				return;
+			}
+			const int lo = d.tickOf(low_px), hi = d.tickOf(high_px);
+			vol.assign(d.tick_vol + lo, d.tick_vol + hi + 1);
+			px = d.priceOf(lo);
+		});
+		if (!ok) {
+			vol.clear();
+			px = 0;
+		}
+		return px;
+	}
+
+	const VolProfData& getData() const {
+		return *_d;
+	}
+
+private:
+	utils::ShmSegment _shm;
+	const VolProfData* const _d;
+
+	// false if no consistent copy in VolReadTries, i.e. the writer died
+	// in an update
+	template<typename Func>
+	bool read(Func func) const {
+		for (int i = 0; i < VolReadTries; ++i) {
+			if (i >= VolReadSpins) {
+				sched_yield();
+			}
+			const uint64_t seq = _d->seq;
+			asm volatile("" ::: "memory");
+			if (seq & 1) {
+				continue;
+			}
+			func(*_d);
+			asm volatile("" ::: "memory");
+			if (_d->seq == seq) {
+				return true;
+			}
+		}
+		logError("volume profile %s is in an update for too long, writer died?", _shm.name().c_str());
+		return false;
+	}
+};
+
+}
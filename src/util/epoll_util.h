@@ -0,0 +1,146 @@
+/*
+ * epoll_util.h
+ *
+ * TimerFd and Epoll, thin wrappers of timerfd and epoll for the
+ * event loops, i.e. the bar timer of tickrec.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace utils {
+
+class TimerFd {
+public:
+   // CLOCK_REALTIME to be aligned with TimeUtil::cur_time_micro()
+   explicit TimerFd(int clockid = CLOCK_REALTIME) :
+      _fd(timerfd_create(clockid, TFD_NONBLOCK | TFD_CLOEXEC)) {
+      if (_fd < 0) {
+         throw std::runtime_error(std::string("timerfd_create failed: ") + strerror(errno));
+      }
+   }
+
+   ~TimerFd() {
+      close(_fd);
+   }
+
+   // first expiration at abs_micro, repeated every interval_micro if
+   // not zero, both on the clock of the timer
+   void setAbsMicro(int64_t abs_micro, int64_t interval_micro = 0) {
+      struct itimerspec its;
+      its.it_value.tv_sec = abs_micro / 1000000LL;
+      its.it_value.tv_nsec = (abs_micro % 1000000LL) * 1000LL;
+      its.it_interval.tv_sec = interval_micro / 1000000LL;
+      its.it_interval.tv_nsec = (interval_micro % 1000000LL) * 1000LL;
+      if (timerfd_settime(_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+         throw std::runtime_error(std::string("timerfd_settime failed: ") + strerror(errno));
+      }
+   }
+
+   void disarm() {
+      struct itimerspec its;
+      memset(&its, 0, sizeof(its));
+      timerfd_settime(_fd, 0, &its, NULL);
+   }
+
+   // expirations since the last read, 0 if none
+   uint64_t read() {
+      uint64_t cnt = 0;
+      if (::read(_fd, &cnt, sizeof(cnt)) != (ssize_t)sizeof(cnt)) {
+         return 0;
+      }
+      return cnt;
+   }
+
+   int fd() const {
+      return _fd;
+   }
+
+private:
+   const int _fd;
+   TimerFd(const TimerFd&);
+   TimerFd& operator=(const TimerFd&);
+};
+
+class Epoll {
+public:
+   explicit Epoll(int max_events = 16) :
+      _fd(epoll_create1(EPOLL_CLOEXEC)), _events(max_events) {
+      if (_fd < 0) {
+         throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
+      }
+   }
+
+   ~Epoll() {
+      close(_fd);
+   }
+
+   // data is given back by getData() of the ready event
+   void add(int fd, uint32_t events, uint64_t data) {
+      ctl(EPOLL_CTL_ADD, fd, events, data);
+   }
+
+   void mod(int fd, uint32_t events, uint64_t data) {
+      ctl(EPOLL_CTL_MOD, fd, events, data);
+   }
+
+   void del(int fd) {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      epoll_ctl(_fd, EPOLL_CTL_DEL, fd, &ev);
+   }
+
+   // number of ready events, 0 on timeout or signal, timeout_milli
+   // of -1 waits without timeout
+   int wait(int timeout_milli) {
+      const int n = epoll_wait(_fd, &_events[0], (int)_events.size(), timeout_milli);
+      if (n < 0) {
+         if (errno == EINTR) {
+            return 0;
+         }
+         throw std::runtime_error(std::string("epoll_wait failed: ") + strerror(errno));
+      }
+      return n;
+   }
+
+   uint64_t getData(int i) const {
+      return _events[i].data.u64;
+   }
+
+   uint32_t getEvents(int i) const {
+      return _events[i].events;
+   }
+
+   int fd() const {
+      return _fd;
+   }
+
+private:
+   const int _fd;
+   std::vector<struct epoll_event> _events;
+
+   void ctl(int op, int fd, uint32_t events, uint64_t data) {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = events;
+      ev.data.u64 = data;
+      if (epoll_ctl(_fd, op, fd, &ev) != 0) {
+         throw std::runtime_error(std::string("epoll_ctl failed: ") + strerror(errno));
+      }
+   }
+
+   Epoll(const Epoll&);
+   Epoll& operator=(const Epoll&);
+};
+
+}
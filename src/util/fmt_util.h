@@ -0,0 +1,277 @@
+/*
+ * fmt_util.h
+ *
+ * Allocation free number to text for the csv writers and the toString
+ * of the books, in place of snprintf.
+ *
+ * fmtFixed(p, v, prec) gives the same bytes as printf("%.<prec>f", v),
+ * rounding the exact binary value half to even as glibc does.  The
+ * fast path covers |v| < 1e18 with prec up to 9, others go to snprintf.
+ * fmtShortest(p, v) gives the fewest decimals that read back to v,
+ * i.e. 4.25 instead of 4.2500000.
+ *
+ * The fmt* functions write at p without the terminating '\0' and
+ * return the end of the text.  The buffer needs to have MaxFixedLen
+ * (MaxIntLen for the integers) bytes from p.  FmtBuf builds a line
+ * with the bound checked.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace utils {
+
+class FmtUtil {
+public:
+   static const int MaxFastPrec = 9;
+   static const int MaxIntLen = 21;
+   // "-" + 309 digits of DBL_MAX + "." + MaxFastPrec + '\0'
+   static const int MaxFixedLen = 330;
+
+   static char* fmtUInt(char* p, uint64_t v) {
+      char tmp[MaxIntLen];
+      char* q = tmp + MaxIntLen;
+      while (v >= 100) {
+         const int d = (int)(v % 100);
+         v /= 100;
+         q -= 2;
+         memcpy(q, digits2() + 2*d, 2);
+      }
+      if (v >= 10) {
+         q -= 2;
+         memcpy(q, digits2() + 2*v, 2);
+      } else {
+         *--q = (char)('0' + v);
+      }
+      const int n = (int)(tmp + MaxIntLen - q);
+      memcpy(p, q, n);
+      return p + n;
+   }
+
+   static char* fmtInt(char* p, int64_t v) {
+      if (v < 0) {
+         *p++ = '-';
+         return fmtUInt(p, (uint64_t)0 - (uint64_t)v);
+      }
+      return fmtUInt(p, (uint64_t)v);
+   }
+
+   // the same as "%.<prec>f"
+   static char* fmtFixed(char* p, double v, int prec) {
+      unsigned __int128 q;
+      bool neg;
+      if (__builtin_expect(!scaled(v, prec, q, neg), 0)) {
+         return p + clampLen(snprintf(p, MaxFixedLen, "%.*f", prec, v));
+      }
+      if (neg) {
+         *p++ = '-';
+      }
+      return fmtScaled(p, q, prec);
+   }
+
+   // fewest decimals reading back to v, "%.17g" like beyond the fast path
+   static char* fmtShortest(char* p, double v) {
+      for (int prec = 0; prec <= MaxFastPrec; ++prec) {
+         unsigned __int128 q;
+         bool neg;
+         if (!scaled(v, prec, q, neg)) {
+            break;
+         }
+         // both exact below 2^53, so the division rounds once
+         if ((q <= (1ULL << 53)) && ((double)(uint64_t)q / (double)pow10(prec) == (neg? -v : v))) {
+            if (neg) {
+               *p++ = '-';
+            }
+            return fmtScaled(p, q, prec);
+         }
+      }
+      int n = 0;
+      for (int prec = 1; prec <= 17; ++prec) {
+         n = snprintf(p, MaxFixedLen, "%.*g", prec, v);
+         if (strtod(p, NULL) == v) {
+            break;
+         }
+      }
+      return p + clampLen(n);
+   }
+
+private:
+   static int clampLen(int n) {
+      return n < 0? 0 : (n < MaxFixedLen? n : MaxFixedLen - 1);
+   }
+
+   static const char* digits2() {
+      return "00010203040506070809"
+             "10111213141516171819"
+             "20212223242526272829"
+             "30313233343536373839"
+             "40414243444546474849"
+             "50515253545556575859"
+             "60616263646566676869"
+             "70717273747576777879"
+             "80818283848586878889"
+             "90919293949596979899";
+   }
+
+   static uint64_t pow10(int n) {
+      static const uint64_t p10[MaxFastPrec+1] = {
+            1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+            1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+      return p10[n];
+   }
+
+   // |v|*10^prec rounded half to even from the exact binary value,
+   // false if not in the fast path, i.e. nan, inf or too large
+   static bool scaled(double v, int prec, unsigned __int128& q, bool& neg) {
+      if ((prec < 0) || (prec > MaxFastPrec) || !(v < 1e18 && v > -1e18)) {
+         return false;
+      }
+      uint64_t bits;
+      memcpy(&bits, &v, sizeof(bits));
+      neg = (bits >> 63) != 0;
+      const int biased_exp = (int)((bits >> 52) & 0x7ff);
+      uint64_t mant = bits & ((1ULL << 52) - 1);
+      int e = -1074;
+      if (biased_exp) {
+         mant |= (1ULL << 52);
+         e = biased_exp - 1075;
+      }
+      // mant*10^prec < 2^83
+      const unsigned __int128 m = (unsigned __int128)mant * pow10(prec);
+      if (e >= 0) {
+         // |v| < 2^60 so e < 8
+         q = m << e;
+      } else if (e <= -127) {
+         // less than half of the last digit
+         q = 0;
+      } else {
+         const int s = -e;
+         const unsigned __int128 one = 1;
+         q = m >> s;
+         const unsigned __int128 r = m & ((one << s) - 1);
+         const unsigned __int128 half = one << (s - 1);
+         if ((r > half) || ((r == half) && (q & 1))) {
+            ++q;
+         }
+      }
+      return true;
+   }
+
+   static char* fmtScaled(char* p, unsigned __int128 q, int prec) {
+      const uint64_t p10 = pow10(prec);
+      uint64_t ip, fp;
+      if (__builtin_expect(q < ((unsigned __int128)1 << 64), 1)) {
+         ip = (uint64_t)q / p10;
+         fp = (uint64_t)q % p10;
+      } else {
+         ip = (uint64_t)(q / p10);
+         fp = (uint64_t)(q % p10);
+      }
+      p = fmtUInt(p, ip);
+      if (prec > 0) {
+         *p++ = '.';
+         for (int i = prec - 1; i >= 0; --i) {
+            p[i] = (char)('0' + fp % 10);
+            fp /= 10;
+         }
+         p += prec;
+      }
+      return p;
+   }
+};
+
+// a line of fixed capacity, text beyond it is dropped
+template<int N>
+class FmtBuf {
+public:
+   FmtBuf() : _n(0) { _buf[0] = 0; };
+
+   FmtBuf& str(const char* s) {
+      return str(s, strlen(s));
+   }
+
+   FmtBuf& str(const char* s, size_t len) {
+      if (len > (size_t)(N - 1 - _n)) {
+         len = (size_t)(N - 1 - _n);
+      }
+      memcpy(_buf + _n, s, len);
+      _n += (int)len;
+      return *this;
+   }
+
+   FmtBuf& ch(char c) {
+      if (_n < N - 1) {
+         _buf[_n++] = c;
+      }
+      return *this;
+   }
+
+   FmtBuf& i64(int64_t v) {
+      if (N - 1 - _n >= FmtUtil::MaxIntLen) {
+         _n = (int)(FmtUtil::fmtInt(_buf + _n, v) - _buf);
+         return *this;
+      }
+      char tmp[FmtUtil::MaxIntLen];
+      return str(tmp, FmtUtil::fmtInt(tmp, v) - tmp);
+   }
+
+   FmtBuf& u64(uint64_t v) {
+      if (N - 1 - _n >= FmtUtil::MaxIntLen) {
+         _n = (int)(FmtUtil::fmtUInt(_buf + _n, v) - _buf);
+         return *this;
+      }
+      char tmp[FmtUtil::MaxIntLen];
+      return str(tmp, FmtUtil::fmtUInt(tmp, v) - tmp);
+   }
+
+   FmtBuf& fixed(double v, int prec) {
+      if (N - 1 - _n >= FmtUtil::MaxFixedLen) {
+         _n = (int)(FmtUtil::fmtFixed(_buf + _n, v, prec) - _buf);
+         return *this;
+      }
+      char tmp[FmtUtil::MaxFixedLen];
+      return str(tmp, FmtUtil::fmtFixed(tmp, v, prec) - tmp);
+   }
+
+   FmtBuf& shortest(double v) {
+      if (N - 1 - _n >= FmtUtil::MaxFixedLen) {
+         _n = (int)(FmtUtil::fmtShortest(_buf + _n, v) - _buf);
+         return *this;
+      }
+      char tmp[FmtUtil::MaxFixedLen];
+      return str(tmp, FmtUtil::fmtShortest(tmp, v) - tmp);
+   }
+
+   void clear() {
+      _n = 0;
+      _buf[0] = 0;
+   }
+
+   const char* c_str() {
+      _buf[_n] = 0;
+      return _buf;
+   }
+
+   const char* data() const {
+      return _buf;
+   }
+
+   int size() const {
+      return _n;
+   }
+
+   std::string toString() const {
+      return std::string(_buf, _n);
+   }
+
+private:
+   char _buf[N];
+   int _n;
+};
+
+}
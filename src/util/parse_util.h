@@ -0,0 +1,126 @@
+/*
+ * parse_util.h
+ *
+ * Allocation free and locale free number parsers of a char range, for
+ * the hot paths that take numbers out of the text of the IB api, i.e.
+ * the RT_VOLUME tick string and the market data fields of EDecoder.
+ *
+ * parseDouble gives the same double as strtod: a decimal of up to 19
+ * significant digits with up to 22 fractional digits is converted by
+ * one division by an exact power of 10, correctly rounded as the
+ * mantissa is below 2^53.  Anything else, i.e. an exponent, goes to
+ * strtod through a bounded copy.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace utils {
+
+class ParseUtil {
+public:
+   // each parser takes the number at p, before end, and returns the
+   // position after it, NULL if there is no number
+
+   static const char* parseInt64(const char* p, const char* end, int64_t& v) {
+      bool neg = false;
+      if ((p < end) && ((*p == '-') || (*p == '+'))) {
+         neg = (*p == '-');
+         ++p;
+      }
+      const char* const p0 = p;
+      uint64_t u = 0;
+      while ((p < end) && ((unsigned)(*p - '0') < 10)) {
+         u = u*10 + (uint64_t)(*p - '0');
+         ++p;
+      }
+      if ((p == p0) || (p - p0 > 19)) {
+         return NULL;
+      }
+      v = neg? -(int64_t)u : (int64_t)u;
+      return p;
+   }
+
+   static const char* parseInt(const char* p, const char* end, int& v) {
+      int64_t v64 = 0;
+      p = parseInt64(p, end, v64);
+      if (p) {
+         v = (int) v64;
+      }
+      return p;
+   }
+
+   static const char* parseDouble(const char* p, const char* end, double& v) {
+      const char* const start = p;
+      bool neg = false;
+      if ((p < end) && ((*p == '-') || (*p == '+'))) {
+         neg = (*p == '-');
+         ++p;
+      }
+      uint64_t mant = 0;
+      int digits = 0;       // significant digits in mant
+      int frac = 0;         // of them after the point
+      bool any = false;
+      while ((p < end) && ((unsigned)(*p - '0') < 10)) {
+         if (mant || (*p != '0')) {
+            mant = mant*10 + (uint64_t)(*p - '0');
+            ++digits;
+         }
+         any = true;
+         ++p;
+      }
+      if ((p < end) && (*p == '.')) {
+         ++p;
+         while ((p < end) && ((unsigned)(*p - '0') < 10)) {
+            if (mant || (*p != '0')) {
+               mant = mant*10 + (uint64_t)(*p - '0');
+               ++digits;
+            }
+            ++frac;
+            any = true;
+            ++p;
+         }
+      }
+      if (!any) {
+         return NULL;
+      }
+      if ((p < end) && ((*p == 'e') || (*p == 'E') || (*p == 'x') || (*p == 'X') ||
+                        (*p == 'n') || (*p == 'N') || (*p == 'i') || (*p == 'I'))) {
+         return slowDouble(start, end, v);
+      }
+      if ((digits > 19) || (frac > 22) || (mant >= (1ULL << 53))) {
+         return slowDouble(start, end, v);
+      }
+      static const double pow10[23] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+      const double d = (double) mant / pow10[frac];
+      v = neg? -d : d;
+      return p;
+   }
+
+   // the end of the field at p, the separator or end
+   static const char* fieldEnd(const char* p, const char* end, char sep) {
+      const char* q = (const char*) memchr(p, sep, end - p);
+      return q? q : end;
+   }
+
+private:
+   static const char* slowDouble(const char* p, const char* end, double& v) {
+      char buf[64];
+      const size_t n = ((size_t)(end - p) < sizeof(buf) - 1)? (size_t)(end - p) : sizeof(buf) - 1;
+      memcpy(buf, p, n);
+      buf[n] = 0;
+      char* e = NULL;
+      v = strtod(buf, &e);
+      if (e == buf) {
+         return NULL;
+      }
+      return p + (e - buf);
+   }
+};
+
+}
@@ -1250,4 +1250,75 @@ namespace utils {
         return QStat_OK;
     }
 
+    // This is a fixed size, lossless single writer single reader queue
+    // of typed items, used between threads of the same process.
+    // Unlike SwQueue, the writer never overwrites unread items: put()
+    // returns false on a full queue and the reader gets NULL from
+    // front() on an empty one, so each side decides how to wait.
+    // QItems has to be power of 2.
+    template<int QItems, typename T>
+    class SpscQueue
+    {
+    public:
+        SpscQueue() : m_items(new T[QItems]), m_wpos(0), m_rpos(0) {
+            static_assert(((QItems-1)&(QItems)) == 0, "SpscQueue: QItems not power of 2");
+        };
+
+        ~SpscQueue() {
+            delete[] m_items;
+        }
+
+        // writer side, for in-place writes:
+        // getNextWritePtr(), fill the item, advanceWritePtr()
+        T* getNextWritePtr() {
+            if (__builtin_expect((m_wpos - m_rpos >= QItems), 0)) {
+                return NULL;
+            }
+            return &(m_items[m_wpos & QMask]);
+        }
+
+        void advanceWritePtr() {
+            asm volatile("" ::: "memory");
+            ++m_wpos;
+        }
+
+        bool put(const T& item) {
+            T* ptr = getNextWritePtr();
+            if (__builtin_expect(!ptr, 0)) {
+                return false;
+            }
+            *ptr = item;
+            advanceWritePtr();
+            return true;
+        }
+
+        // reader side, front() is valid until pop()
+        T* front() {
+            if (__builtin_expect((m_wpos == m_rpos), 0)) {
+                return NULL;
+            }
+            asm volatile("" ::: "memory");
+            return &(m_items[m_rpos & QMask]);
+        }
+
+        void pop() {
+            asm volatile("" ::: "memory");
+            ++m_rpos;
+        }
+
+        bool empty() const { return m_wpos == m_rpos; };
+        int size() const { return (int) (m_wpos - m_rpos); };
+
+    private:
+        static const QPos QMask = QItems - 1;
+        T* const m_items;
+        // writer and reader positions on separate cache lines
+        volatile QPos m_wpos;
+        char m_pad[64 - sizeof(QPos)];
+        volatile QPos m_rpos;
+
+        SpscQueue(const SpscQueue&);
+        SpscQueue& operator=(const SpscQueue&);
+    };
+
 }
@@ -0,0 +1,81 @@
+/*
+ * shm_util.h
+ *
+ * ShmSegment, a fixed size posix shared memory segment mapped as one
+ * struct, i.e. the volume profile of volprof.  The writer creates and
+ * sizes it, a reader maps an existing one read only.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <string>
+
+namespace utils {
+
+class ShmSegment {
+public:
+   ShmSegment(const std::string& name, size_t size, bool readonly) :
+      _name(name), _size(size), _fd(-1), _ptr(NULL) {
+      if (readonly) {
+         _fd = shm_open(_name.c_str(), O_RDONLY, S_IRUSR);
+      } else {
+         _fd = shm_open(_name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+      }
+      if (_fd == -1) {
+         throw std::runtime_error(_name + ": shm_open failed: " + strerror(errno));
+      }
+      struct stat st;
+      if (fstat(_fd, &st) != 0) {
+         ::close(_fd);
+         throw std::runtime_error(_name + ": fstat failed: " + strerror(errno));
+      }
+      if ((size_t)st.st_size != _size) {
+         if (readonly || (ftruncate(_fd, _size) != 0)) {
+            ::close(_fd);
+            throw std::runtime_error(_name + ": shm size mismatch, "
+                  + std::to_string((long long)st.st_size) + " expected " + std::to_string((long long)_size));
+         }
+      }
+      _ptr = mmap(NULL, _size, readonly? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, _fd, 0);
+      if (_ptr == MAP_FAILED) {
+         ::close(_fd);
+         throw std::runtime_error(_name + ": mmap failed: " + strerror(errno));
+      }
+   }
+
+   ~ShmSegment() {
+      munmap(_ptr, _size);
+      ::close(_fd);
+   }
+
+   void* ptr() const {
+      return _ptr;
+   }
+
+   size_t size() const {
+      return _size;
+   }
+
+   const std::string& name() const {
+      return _name;
+   }
+
+private:
+   const std::string _name;
+   const size_t _size;
+   int _fd;
+   void* _ptr;
+
+   ShmSegment(const ShmSegment&);
+   ShmSegment& operator=(const ShmSegment&);
+};
+
+}
@@ -0,0 +1,84 @@
+#include "fmt_util.h"
+#include "time_util.h"
+#include <math.h>
+
+using namespace utils;
+
+// compares FmtUtil with snprintf over random and edge values,
+// then times both
+static int check(double v, int prec) {
+    char a[512], b[512];
+    int n = snprintf(a, sizeof(a), "%.*f", prec, v);
+    char* e = FmtUtil::fmtFixed(b, v, prec);
+    if ((e - b != n) || memcmp(a, b, n) != 0) {
+        *e = 0;
+        printf("fixed mismatch %.17g prec %d: %s %s\n", v, prec, a, b);
+        return 1;
+    }
+    e = FmtUtil::fmtShortest(b, v);
+    *e = 0;
+    if (!isnan(v) && strtod(b, NULL) != v) {
+        printf("shortest mismatch %.17g: %s\n", v, b);
+        return 1;
+    }
+    return 0;
+}
+
+static int checkInt(long long v) {
+    char a[64], b[64];
+    int n = snprintf(a, sizeof(a), "%lld", v);
+    char* e = FmtUtil::fmtInt(b, v);
+    if ((e - b != n) || memcmp(a, b, n) != 0) {
+        printf("int mismatch %lld\n", v);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int fails = 0;
+    const double edge[] = { 0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 1e-8, 5e-8, 4.9999999e-8,
+                            0.00000005, 1e17, 9.99999999e17, 1e18, 1e300, -1e300, 5e-324,
+                            INFINITY, -INFINITY, NAN, 2.675, 1.0000000005, 61.23, 1.1 };
+    for (double v : edge) {
+        for (int prec = 0; prec <= 12; ++prec) {
+            fails += check(v, prec);
+        }
+    }
+    srand48(1);
+    for (int i = 0; i < 2000000; ++i) {
+        double v;
+        switch (i % 4) {
+        case 0: v = drand48() * 1000.0; break;
+        case 1: v = floor(drand48() * 1e9) / 1e7; break;  // 7 decimal prices
+        case 2: v = (drand48() - 0.5) * pow(10.0, (int)(drand48() * 40) - 20); break;
+        default: v = floor(drand48() * 100000) / 8.0 + 1/1024.0; break;  // ties
+        }
+        fails += check(v, i % (FmtUtil::MaxFastPrec + 1));
+        fails += checkInt((long long)(lrand48()) * lrand48() * (i % 2? 1 : -1));
+    }
+    fails += checkInt(0) + checkInt(INT64_MAX) + checkInt(INT64_MIN);
+    char b[64];
+    *FmtUtil::fmtShortest(b, 4.25) = 0;
+    if (strcmp(b, "4.25") != 0) {
+        printf("shortest 4.25: %s\n", b);
+        ++fails;
+    }
+
+    const int N = 1000000;
+    char buf[512];
+    uint64_t t0 = TimeUtil::cur_time_micro();
+    int len = 0;
+    for (int i = 0; i < N; ++i) {
+        len += snprintf(buf, sizeof(buf), "%.7lf", 60.0 + i * 0.0001);
+    }
+    uint64_t t1 = TimeUtil::cur_time_micro();
+    for (int i = 0; i < N; ++i) {
+        len += (int)(FmtUtil::fmtFixed(buf, 60.0 + i * 0.0001, 7) - buf);
+    }
+    uint64_t t2 = TimeUtil::cur_time_micro();
+    printf("%.7lf %d: snprintf %.1f ns, fmtFixed %.1f ns\n", 1.0, len,
+           (double)(t1 - t0) * 1000.0 / N, (double)(t2 - t1) * 1000.0 / N);
+    printf("%s, %d failures\n", fails? "FAILED" : "PASSED", fails);
+    return fails? 1 : 0;
+}
@@ -1 +1,2 @@
 g++ -std=c++11 -O3 -o qtest_shm qtest_shm.cpp -I..  -lpthread -lrt
+g++ -std=c++11 -O3 -o fmt_test fmt_test.cpp -I..
@@ -19,6 +19,18 @@
 
 namespace utils {
 
+	/// pins the calling thread to cpu, false if it can't, i.e. on cygwin
+	static inline bool setThreadAffinity(int cpu) {
+#if defined(__CYGWIN__)
+		return false;
+#else
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		CPU_SET(cpu, &mask);
+		return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#endif
+	}
+
 	/// a template for Runnable
 	class Runnable {
 	public:
@@ -29,7 +41,7 @@ namespace utils {
 	template<typename Runnable>
 	class ThreadWrapper {
 	public:
-		ThreadWrapper(Runnable& runnable) : m_runnable(runnable), m_param(NULL), m_isRunning(false), m_thread(0) {};
+		ThreadWrapper(Runnable& runnable) : m_runnable(runnable), m_param(NULL), m_isRunning(false), m_isJoined(false), m_thread(0) {};
 		void run(void* para) {
 			if (!m_isRunning) {
 				m_param = para;
@@ -38,11 +50,15 @@ namespace utils {
 					throw std::runtime_error(std::string("pthread creation error! errno=") + std::to_string(errno));
 				}
 				m_isRunning = true;
+				m_isJoined = false;
 			}
 		}
 		void join() {
-			if (m_isRunning)
+			if (m_isRunning) {
 				pthread_join(m_thread, NULL);
+				m_isRunning = false;
+				m_isJoined = true;
+			}
 		}
 		void stop() {
 			if (m_isRunning) {
@@ -71,7 +87,9 @@ namespace utils {
 				tspec.tv_nsec = 100000000 ;
 				nanosleep(&tspec, &tspec);
 			}
-			pthread_cancel(m_thread);
+			// a joined thread is gone, its id could have been reused
+			if (!m_isJoined)
+				pthread_cancel(m_thread);
 		};
 
 		// getters
@@ -82,6 +100,7 @@ namespace utils {
 		Runnable& m_runnable;
 		void* m_param;
 		bool m_isRunning;
+		bool m_isJoined;
 		pthread_t m_thread;
 		static void* threadFunc(void* para) {
 			ThreadWrapper<Runnable> *wrapper = (ThreadWrapper<Runnable>*)para;
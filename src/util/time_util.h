@@ -13,6 +13,7 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <stdexcept>
 
 namespace utils {
 
@@ -220,6 +221,37 @@ public:
 	   throw std::runtime_error("invalid utc");
    }
 
+   // trading day of utc as yyyymmdd, a trading day starts at start_hour
+   // (local) of the previous calendar day, i.e. 18:00 for the futures
+   static int utc_to_trade_day(time_t utc, int start_hour = 18)
+   {
+	   struct tm t;
+	   if (!localtime_r(&utc, &t)) {
+		   throw std::runtime_error("invalid utc");
+	   }
+	   if (t.tm_hour >= start_hour) {
+		   t.tm_mday += 1;
+		   t.tm_hour = 12;
+		   t.tm_isdst = -1;
+		   mktime(&t);
+	   }
+	   return (t.tm_year+1900)*10000 + (t.tm_mon+1)*100 + t.tm_mday;
+   }
+
+   // utc of the start of the trading day yyyymmdd, days_after=1 gives
+   // the end of it
+   static time_t trade_day_start_utc(int yyyymmdd, int start_hour = 18, int days_after = 0)
+   {
+	   struct tm t;
+	   memset(&t, 0, sizeof(t));
+	   t.tm_year = yyyymmdd/10000 - 1900;
+	   t.tm_mon = (yyyymmdd/100)%100 - 1;
+	   t.tm_mday = yyyymmdd%100 - 1 + days_after;
+	   t.tm_hour = start_hour;
+	   t.tm_isdst = -1;
+	   return mktime(&t);
+   }
+
 };
 
 }